@@ -0,0 +1,134 @@
+/*
+  Copyright 2013 Shannon Weyrick <weyrick@mozek.us>
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+  See xxhash.h.
+ */
+
+#include "xxhash.h"
+
+#include <string.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+/* the spec reads input little endian, memcpy keeps unaligned reads legal */
+static int
+is_little_endian(void)
+{
+    const int one = 1;
+    return *(const char *)&one;
+}
+
+static uint64_t
+swap64(uint64_t x)
+{
+    return ((x << 56) & 0xff00000000000000ULL) |
+           ((x << 40) & 0x00ff000000000000ULL) |
+           ((x << 24) & 0x0000ff0000000000ULL) |
+           ((x << 8)  & 0x000000ff00000000ULL) |
+           ((x >> 8)  & 0x00000000ff000000ULL) |
+           ((x >> 24) & 0x0000000000ff0000ULL) |
+           ((x >> 40) & 0x000000000000ff00ULL) |
+           ((x >> 56) & 0x00000000000000ffULL);
+}
+
+static uint64_t
+read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return is_little_endian() ? v : swap64(v);
+}
+
+static uint32_t
+read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    if (is_little_endian())
+        return v;
+    return ((v << 24) & 0xff000000) | ((v << 8) & 0x00ff0000) |
+           ((v >> 8) & 0x0000ff00) | ((v >> 24) & 0x000000ff);
+}
+
+static uint64_t
+round64(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t
+merge64(uint64_t acc, uint64_t val)
+{
+    acc ^= round64(0, val);
+    return acc * PRIME64_1 + PRIME64_4;
+}
+
+uint64_t
+xxh64(const void *input, size_t len, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)input;
+    const unsigned char *end = p + len;
+    uint64_t h;
+
+    if (len >= 32) {
+        /* four independent lanes, so the cpu can work on them at once */
+        const unsigned char *limit = end - 32;
+        uint64_t v1 = seed + PRIME64_1 + PRIME64_2;
+        uint64_t v2 = seed + PRIME64_2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - PRIME64_1;
+        do {
+            v1 = round64(v1, read64(p));
+            v2 = round64(v2, read64(p + 8));
+            v3 = round64(v3, read64(p + 16));
+            v4 = round64(v4, read64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        h = merge64(h, v1);
+        h = merge64(h, v2);
+        h = merge64(h, v3);
+        h = merge64(h, v4);
+    }
+    else {
+        h = seed + PRIME64_5;
+    }
+
+    h += (uint64_t)len;
+
+    while (p + 8 <= end) {
+        h ^= round64(0, read64(p));
+        h = ROTL64(h, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+    }
+    if (p + 4 <= end) {
+        h ^= (uint64_t)read32(p) * PRIME64_1;
+        h = ROTL64(h, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+    }
+    while (p < end) {
+        h ^= (*p) * PRIME64_5;
+        h = ROTL64(h, 11) * PRIME64_1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= PRIME64_2;
+    h ^= h >> 29;
+    h *= PRIME64_3;
+    h ^= h >> 32;
+
+    return h;
+}
@@ -0,0 +1,35 @@
+/*
+  Copyright 2013 Shannon Weyrick <weyrick@mozek.us>
+
+    This Source Code Form is subject to the terms of the Mozilla Public
+    License, v. 2.0. If a copy of the MPL was not distributed with this
+    file, You can obtain one at http://mozilla.org/MPL/2.0/.
+
+  Independent implementation of XXH64, the 64 bit variant of Yann
+  Collet's xxHash, from the description of the algorithm at
+    https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md
+  It gives the same results as the reference implementation.
+
+  xxHash is not a cryptographic hash. It's here to tell whether a file
+  has changed, which it does many times faster than md5.
+ */
+
+#ifndef xxhash_INCLUDED
+#  define xxhash_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C"
+{
+#endif
+
+/* Hash len bytes at input in one go. */
+uint64_t xxh64(const void *input, size_t len, uint64_t seed);
+
+#ifdef __cplusplus
+}  /* end extern "C" */
+#endif
+
+#endif /* xxhash_INCLUDED */
@@ -0,0 +1,318 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+// builds a model of the php stubs in base/ and writes the functions, classes
+// and constants in it out as the tables in pBuiltins.h
+//
+// usage: corvus-builtins-gen <base dir> <output .cpp>
+
+#include "corvus/pSourceManager.h"
+#include "corvus/pModel.h"
+#include "corvus/pBuiltins.h"
+#include "corvus/pSymbolIndex.h"
+
+#include "xxhash.h"
+
+#include <sqlite3.h>
+#include <stdio.h>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace corvus;
+
+namespace {
+
+struct function {
+    std::string name;
+    int minArity;
+    int maxArity;
+};
+
+struct cls {
+    std::string name;
+    int type;
+    std::string parents;
+    std::vector<std::string> constants;
+    std::vector<function> methods;
+};
+
+std::string quote(const std::string& s) {
+
+    std::string result("\"");
+    for (std::size_t i = 0; i < s.size(); ++i) {
+        if (s[i] == '\\' || s[i] == '"')
+            result.push_back('\\');
+        result.push_back(s[i]);
+    }
+    result.push_back('"');
+    return result;
+
+}
+
+std::string column(sqlite3_stmt *stmt, int i) {
+
+    const char *text = (const char*)sqlite3_column_text(stmt, i);
+    return text ? text : "";
+
+}
+
+sqlite3_stmt* prepare(sqlite3 *db, const char *sql) {
+
+    sqlite3_stmt *stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+        std::cerr << "sqlite error: " << sql << "\n" << sqlite3_errmsg(db) << std::endl;
+        exit(1);
+    }
+    return stmt;
+
+}
+
+struct bySize {
+    const std::vector<std::vector<std::size_t> >& buckets;
+    bySize(const std::vector<std::vector<std::size_t> >& b): buckets(b) { }
+    bool operator()(std::size_t a, std::size_t b) const {
+        return buckets[a].size() > buckets[b].size();
+    }
+};
+
+// the slots table for keys, see pBuiltins.h, and which key ends up in each
+// slot. the buckets with the most keys are placed first, each trying seeds
+// until its keys all hash to free slots. buckets of one key just take the
+// next free slot
+void perfectHash(const std::vector<std::string>& keys,
+                 std::vector<int>& slots,
+                 std::vector<std::size_t>& order) {
+
+    std::size_t n = keys.size();
+    slots.assign(n, 0);
+    order.assign(n, 0);
+
+    std::vector<std::vector<std::size_t> > buckets(n);
+    for (std::size_t i = 0; i < n; ++i)
+        buckets[pBuiltins::hash(0, keys[i]) % n].push_back(i);
+
+    std::vector<std::size_t> bucketOrder(n);
+    for (std::size_t i = 0; i < n; ++i)
+        bucketOrder[i] = i;
+    std::stable_sort(bucketOrder.begin(), bucketOrder.end(), bySize(buckets));
+
+    std::vector<bool> used(n, false);
+    std::vector<std::size_t> tried;
+    std::size_t b = 0;
+    for (; b < n && buckets[bucketOrder[b]].size() > 1; ++b) {
+        const std::vector<std::size_t>& bucket = buckets[bucketOrder[b]];
+        for (int seed = 1; ; ++seed) {
+            tried.clear();
+            for (std::size_t k = 0; k < bucket.size(); ++k) {
+                std::size_t s = pBuiltins::hash(seed, keys[bucket[k]]) % n;
+                if (used[s] || std::find(tried.begin(), tried.end(), s) != tried.end())
+                    break;
+                tried.push_back(s);
+            }
+            if (tried.size() != bucket.size())
+                continue;
+            for (std::size_t k = 0; k < bucket.size(); ++k) {
+                used[tried[k]] = true;
+                order[tried[k]] = bucket[k];
+            }
+            slots[bucketOrder[b]] = seed;
+            break;
+        }
+    }
+
+    std::size_t free = 0;
+    for (; b < n && buckets[bucketOrder[b]].size() == 1; ++b) {
+        while (used[free])
+            free++;
+        used[free] = true;
+        order[free] = buckets[bucketOrder[b]][0];
+        slots[bucketOrder[b]] = -(int)free - 1;
+    }
+
+}
+
+void writeSlots(std::ostream& out, const char *name, const std::vector<int>& slots) {
+
+    out << "const int " << name << "[] = {";
+    for (std::size_t i = 0; i < slots.size(); ++i)
+        out << ((i % 16) ? " " : "\n    ") << slots[i] << ",";
+    if (slots.empty())
+        out << " 0";
+    out << "\n};\n\n";
+
+}
+
+}
+
+int main(int argc, char* argv[]) {
+
+    if (argc != 3) {
+        std::cerr << "usage: " << argv[0] << " <base dir> <output .cpp>" << std::endl;
+        return 1;
+    }
+
+    pSourceManager sm;
+    sm.addIncludeDir(argv[1], "php");
+    sm.refreshModel();
+    sqlite3 *db = sm.model()->db();
+
+    // a name declared more than once is taken from the first stub to
+    // declare it
+    std::map<std::string, function> functions;
+    sqlite3_stmt *stmt = prepare(db, "SELECT name, minArity, maxArity FROM function"
+                                     " WHERE class_id IS NULL AND type=1 ORDER BY id");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        function f;
+        f.name = pSymbolIndex::lower(column(stmt, 0));
+        f.minArity = sqlite3_column_int(stmt, 1);
+        f.maxArity = sqlite3_column_int(stmt, 2);
+        functions.insert(std::make_pair(f.name, f));
+    }
+    sqlite3_finalize(stmt);
+
+    std::map<std::string, cls> classes;
+    sqlite3_stmt *decls = prepare(db, "SELECT name FROM class_decl WHERE class_id=? AND type=0 ORDER BY id");
+    sqlite3_stmt *methods = prepare(db, "SELECT name, minArity, maxArity FROM function"
+                                        " WHERE class_id=? ORDER BY id");
+    stmt = prepare(db, "SELECT id, name, type, extends, implements FROM class ORDER BY id");
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        cls c;
+        c.name = pSymbolIndex::lower(column(stmt, 1));
+        if (classes.find(c.name) != classes.end())
+            continue;
+        c.type = sqlite3_column_int(stmt, 2);
+        c.parents = pSymbolIndex::lower(column(stmt, 3));
+        std::string implements = pSymbolIndex::lower(column(stmt, 4));
+        if (!c.parents.empty() && !implements.empty())
+            c.parents.push_back(',');
+        c.parents.append(implements);
+
+        sqlite3_bind_int64(decls, 1, sqlite3_column_int64(stmt, 0));
+        while (sqlite3_step(decls) == SQLITE_ROW)
+            c.constants.push_back(column(decls, 0));
+        sqlite3_reset(decls);
+
+        sqlite3_bind_int64(methods, 1, sqlite3_column_int64(stmt, 0));
+        while (sqlite3_step(methods) == SQLITE_ROW) {
+            function m;
+            m.name = pSymbolIndex::lower(column(methods, 0));
+            m.minArity = sqlite3_column_int(methods, 1);
+            m.maxArity = sqlite3_column_int(methods, 2);
+            c.methods.push_back(m);
+        }
+        sqlite3_reset(methods);
+
+        classes[c.name] = c;
+    }
+    sqlite3_finalize(stmt);
+    sqlite3_finalize(decls);
+    sqlite3_finalize(methods);
+
+    std::vector<std::string> constants;
+    stmt = prepare(db, "SELECT DISTINCT name FROM constant ORDER BY name");
+    while (sqlite3_step(stmt) == SQLITE_ROW)
+        constants.push_back(column(stmt, 0));
+    sqlite3_finalize(stmt);
+
+    std::stringstream out;
+    std::vector<std::string> keys;
+    std::vector<int> slots;
+    std::vector<std::size_t> order;
+
+    // functions
+    std::vector<const function*> fs;
+    keys.clear();
+    for (std::map<std::string, function>::iterator i = functions.begin(); i != functions.end(); ++i) {
+        keys.push_back(i->first);
+        fs.push_back(&i->second);
+    }
+    perfectHash(keys, slots, order);
+    out << "const bFunction functions[] = {\n";
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        const function& f = *fs[order[i]];
+        out << "    { " << quote(f.name) << ", " << f.minArity << ", " << f.maxArity << " },\n";
+    }
+    if (order.empty())
+        out << "    { \"\", 0, 0 }\n";
+    out << "};\n\n";
+    writeSlots(out, "functionSlots", slots);
+    out << "const std::size_t functionCount = " << order.size() << ";\n\n";
+
+    // classes, with their constants and methods in tables of their own
+    std::vector<const cls*> cs;
+    keys.clear();
+    for (std::map<std::string, cls>::iterator i = classes.begin(); i != classes.end(); ++i) {
+        keys.push_back(i->first);
+        cs.push_back(&i->second);
+    }
+    perfectHash(keys, slots, order);
+    std::stringstream classConstants, classMethods;
+    std::size_t constantTotal = 0, methodTotal = 0;
+    out << "const bClass classes[] = {\n";
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        const cls& c = *cs[order[i]];
+        out << "    { " << quote(c.name) << ", " << c.type << ", " << quote(c.parents) << ", "
+            << constantTotal << ", " << c.constants.size() << ", "
+            << methodTotal << ", " << c.methods.size() << " },\n";
+        for (std::size_t j = 0; j < c.constants.size(); ++j)
+            classConstants << "    " << quote(c.constants[j]) << ",\n";
+        for (std::size_t j = 0; j < c.methods.size(); ++j)
+            classMethods << "    { " << quote(c.methods[j].name) << ", " << c.methods[j].minArity
+                         << ", " << c.methods[j].maxArity << " },\n";
+        constantTotal += c.constants.size();
+        methodTotal += c.methods.size();
+    }
+    if (order.empty())
+        out << "    { \"\", 0, \"\", 0, 0, 0, 0 }\n";
+    out << "};\n\n";
+    writeSlots(out, "classSlots", slots);
+    out << "const std::size_t classCount = " << order.size() << ";\n\n";
+    out << "const char* const classConstants[] = {\n" << classConstants.str() << "    \"\"\n};\n\n";
+    out << "const bFunction methods[] = {\n" << classMethods.str() << "    { \"\", 0, 0 }\n};\n\n";
+
+    // constants
+    perfectHash(constants, slots, order);
+    out << "const char* const constants[] = {\n";
+    for (std::size_t i = 0; i < order.size(); ++i)
+        out << "    " << quote(constants[order[i]]) << ",\n";
+    if (order.empty())
+        out << "    \"\"\n";
+    out << "};\n\n";
+    writeSlots(out, "constantSlots", slots);
+    out << "const std::size_t constantCount = " << order.size() << ";\n\n";
+
+    std::string tables = out.str();
+    char stamp[17];
+    snprintf(stamp, sizeof(stamp), "%016llx",
+             (unsigned long long)xxh64(tables.data(), tables.size(), 0));
+
+    std::ofstream file(argv[2]);
+    file << "// generated by corvus-builtins-gen from " << argv[1] << ", don't edit\n\n"
+         << "#include \"corvus/pBuiltins.h\"\n\n"
+         << "namespace corvus { namespace builtins {\n\n"
+         << tables
+         << "const char stamp[] = \"" << stamp << "\";\n\n"
+         << "} }\n";
+    file.close();
+    if (!file) {
+        std::cerr << "unable to write " << argv[2] << std::endl;
+        return 1;
+    }
+
+    std::cout << "builtins: " << functions.size() << " functions, " << classes.size()
+              << " classes, " << constants.size() << " constants" << std::endl;
+    return 0;
+
+}
@@ -0,0 +1,35 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+// empty builtin tables for corvus-builtins-gen, which is built from the same
+// objects as libcorvus (and so looks builtins up) but writes the real ones
+
+#include "corvus/pBuiltins.h"
+
+namespace corvus { namespace builtins {
+
+const bFunction functions[1] = { { "", 0, 0 } };
+const int functionSlots[1] = { 0 };
+const std::size_t functionCount = 0;
+
+const bClass classes[1] = { { "", 0, "", 0, 0, 0, 0 } };
+const int classSlots[1] = { 0 };
+const std::size_t classCount = 0;
+
+const char* const constants[1] = { "" };
+const int constantSlots[1] = { 0 };
+const std::size_t constantCount = 0;
+
+const char* const classConstants[1] = { "" };
+const bFunction methods[1] = { { "", 0, 0 } };
+
+const char stamp[] = "";
+
+} }
@@ -21,17 +21,19 @@
 using namespace corvus;
 
 #define CTXT               pMod->context()
-#define TOKEN_RANGE(T)     CTXT.getRange(T)
-#define CURRENT_LINE       CTXT.currentLineNum()
+#define TOKEN_RANGE(T)     CTXT.getSpan(T)
+#define TOKEN_TEXT(T)      CTXT.getText(T)
+#define CURRENT_LINE       CTXT.currentLine()
 
-AST::literalExpr* extractLiteralString(pSourceRef* B, pSourceModule* pMod, bool isSimple) {
+AST::literalExpr* extractLiteralString(const pToken* B, pSourceModule* pMod, bool isSimple) {
   // substring out the quotes, special case for empty string
   AST::literalString* A;
-  if ((*B).size() <= 2) {
+  pSourceRef text(TOKEN_TEXT(B));
+  if (text.size() <= 2) {
     A = new (CTXT) AST::literalString();
   }
   else {
-    A = new (CTXT) AST::literalString((*B).slice(1, (*B).size()-1));
+    A = new (CTXT) AST::literalString(text.slice(1, text.size()-1));
   }
   A->setIsSimple(isSimple);
   return A;
@@ -40,8 +42,8 @@ AST::literalExpr* extractLiteralString(pSourceRef* B, pSourceModule* pMod, bool
 }  
 
 %name corvusParse
-%token_type {pSourceRef*}
-%default_type {pSourceRef*}
+%token_type {const pToken*}
+%default_type {const pToken*}
 %extra_argument {pSourceModule* pMod}
 
 
@@ -182,7 +184,7 @@ AST::literalExpr* extractLiteralString(pSourceRef* B, pSourceModule* pMod, bool
 %type T_DQ_ESCAPE  {int}
 
 %syntax_error {  
-  CTXT.parseError(TOKEN, TOKEN_RANGE(TOKEN));
+  CTXT.parseError(TOKEN, CTXT.getRange(TOKEN_RANGE(TOKEN)));
 }
 %stack_size 500
 %stack_overflow {  
@@ -259,7 +261,7 @@ statementBlock(A) ::= T_LEFTCURLY(LC) statement_list(B) T_RIGHTCURLY(RC).
 {
     A = new (CTXT) AST::block(CTXT, B);
     A->setRange(TOKEN_RANGE(LC));
-    A->setEndCol(TOKEN_RANGE(RC));
+    A->setEndRange(TOKEN_RANGE(RC));
     delete B;
 }
 
@@ -268,12 +270,12 @@ statementBlock(A) ::= T_LEFTCURLY(LC) statement_list(B) T_RIGHTCURLY(RC).
 namespaceName(A) ::= T_IDENTIFIER(PART).
 {
     A = new AST::namespaceName(TOKEN_RANGE(PART));
-    A->push_back(*PART);
+    A->push_back(TOKEN_TEXT(PART));
 }
 namespaceName(A) ::= namespaceName(PARTS) T_NS_SEPARATOR T_IDENTIFIER(PART).
 {
-    PARTS->push_back(*PART);
-    PARTS->setEndCol(TOKEN_RANGE(PART).endCol);
+    PARTS->push_back(TOKEN_TEXT(PART));
+    PARTS->setEndRange(TOKEN_RANGE(PART));
     A = PARTS;
 }
 
@@ -284,7 +286,7 @@ namespaceDecl(A) ::= T_NAMESPACE(NS) namespaceName(NSNAME) T_SEMI.
     A = new (CTXT) AST::namespaceDecl(NSNAME, CTXT);
     // namespace decls are always absolute?
     A->setRange(TOKEN_RANGE(NS));
-    A->setEndRange(NSNAME->range());
+    A->setEndRange(NSNAME->span());
     delete NSNAME;
 }
 namespaceDecl(A) ::= T_NAMESPACE(NS) namespaceName(NSNAME) statementBlock(BODY).
@@ -293,7 +295,7 @@ namespaceDecl(A) ::= T_NAMESPACE(NS) namespaceName(NSNAME) statementBlock(BODY).
     A = new (CTXT) AST::namespaceDecl(NSNAME, BODY, CTXT);
     // namespace decls are always absolute?
     A->setRange(TOKEN_RANGE(NS));
-    A->setEndRange(NSNAME->range());
+    A->setEndRange(NSNAME->span());
     delete NSNAME;
 }
 
@@ -332,7 +334,7 @@ useIdent(A) ::= namespaceName(NSNAME).
 }
 useIdent(A) ::= namespaceName(NSNAME) T_AS T_IDENTIFIER(ID).
 {
-    A = new (CTXT) AST::useIdent(NSNAME, *ID, CTXT);
+    A = new (CTXT) AST::useIdent(NSNAME, TOKEN_TEXT(ID), CTXT);
     delete NSNAME;
 }
 useIdent(A) ::= T_NS_SEPARATOR namespaceName(NSNAME).
@@ -344,7 +346,7 @@ useIdent(A) ::= T_NS_SEPARATOR namespaceName(NSNAME).
 useIdent(A) ::= T_NS_SEPARATOR namespaceName(NSNAME) T_AS T_IDENTIFIER(ID).
 {
     NSNAME->setAbsolute();
-    A = new (CTXT) AST::useIdent(NSNAME, *ID, CTXT);
+    A = new (CTXT) AST::useIdent(NSNAME, TOKEN_TEXT(ID), CTXT);
     delete NSNAME;
 }
 
@@ -362,14 +364,14 @@ constDecl(A) ::= T_CONST constVarList(LIST).
 constVarList(A) ::= T_IDENTIFIER(ID) T_ASSIGN staticScalar(DEFAULT).
 {
     A = new AST::exprPairList();
-    AST::literalID* cid = new (CTXT) AST::literalID(*ID, CTXT);
+    AST::literalID* cid = new (CTXT) AST::literalID(TOKEN_TEXT(ID), CTXT);
     cid->setRange(CURRENT_LINE);
     DEFAULT->setRange(CURRENT_LINE);
     A->push_back(AST::exprPair(cid, DEFAULT));
 }
 constVarList(A) ::= constVarList(LIST) T_COMMA T_IDENTIFIER(ID) T_ASSIGN staticScalar(DEFAULT).
 {
-    AST::literalID* cid = new (CTXT) AST::literalID(*ID, CTXT);
+    AST::literalID* cid = new (CTXT) AST::literalID(TOKEN_TEXT(ID), CTXT);
     cid->setRange(CURRENT_LINE);
     DEFAULT->setRange(CURRENT_LINE);
     LIST->push_back(AST::exprPair(cid, DEFAULT));
@@ -447,7 +449,7 @@ global(A) ::= T_GLOBAL globalVarList(B).
 %type inlineHTML {AST::inlineHtml*}
 inlineHTML(A) ::= T_INLINE_HTML(B).
 {
-    A = new (CTXT) AST::inlineHtml(*B);
+    A = new (CTXT) AST::inlineHtml(TOKEN_TEXT(B));
     A->setRange(CURRENT_LINE);
 }
 
@@ -496,32 +498,32 @@ nonEmptyCatches(A) ::= nonEmptyCatches(LIST) catch(C).
 catch(A) ::= T_CATCH(CT) T_LEFTPAREN namespaceName(CLASSNAME) T_VARIABLE(VAR) T_RIGHTPAREN
              statementBlock(CATCHBODY).
 {
-    AST::var *v = new (CTXT) AST::var((*VAR).substr(1), CTXT);
+    AST::var *v = new (CTXT) AST::var(TOKEN_TEXT(VAR).substr(1), CTXT);
     v->setRange(TOKEN_RANGE(VAR));
     AST::literalID *id = new (CTXT) AST::literalID(CLASSNAME, CTXT);
-    id->setRange(CLASSNAME->range());
+    id->setRange(CLASSNAME->span());
     A = new (CTXT) AST::catchStmt(CTXT,
                                   id,
                                   v,
                                   new (CTXT) AST::block(CTXT, CATCHBODY));
     A->setRange(TOKEN_RANGE(CT));
-    A->setEndRange(CATCHBODY->range());
+    A->setEndRange(CATCHBODY->span());
     delete CLASSNAME;
 }
 catch(A) ::= T_CATCH(CT) T_LEFTPAREN T_NS_SEPARATOR namespaceName(CLASSNAME) T_VARIABLE(VAR) T_RIGHTPAREN
              statementBlock(CATCHBODY).
 {
     CLASSNAME->setAbsolute();
-    AST::var *v = new (CTXT) AST::var((*VAR).substr(1), CTXT);
+    AST::var *v = new (CTXT) AST::var(TOKEN_TEXT(VAR).substr(1), CTXT);
     v->setRange(TOKEN_RANGE(VAR));
     AST::literalID *id = new (CTXT) AST::literalID(CLASSNAME, CTXT);
-    id->setRange(CLASSNAME->range());
+    id->setRange(CLASSNAME->span());
     A = new (CTXT) AST::catchStmt(CTXT,
                                   id,
                                   v,
                                   new (CTXT) AST::block(CTXT, CATCHBODY));
     A->setRange(TOKEN_RANGE(CT));
-    A->setEndRange(CATCHBODY->range());
+    A->setEndRange(CATCHBODY->span());
     delete CLASSNAME;
 }
 
@@ -719,7 +721,7 @@ staticDecl(A) ::= T_STATIC staticVarList(VARLIST) T_ASSIGN staticScalar(DEF).
 %type formalParam {AST::formalParam*}
 formalParam(A) ::= maybeHint(HINT) T_VARIABLE(PARAM).
 {
-    A = new (CTXT) AST::formalParam((*PARAM).substr(1),
+    A = new (CTXT) AST::formalParam(TOKEN_TEXT(PARAM).substr(1),
                               CTXT, false/*ref*/);
     if (HINT) {
         A->setHint(*HINT);
@@ -729,7 +731,7 @@ formalParam(A) ::= maybeHint(HINT) T_VARIABLE(PARAM).
 }
 formalParam(A) ::= maybeHint(HINT) T_AND T_VARIABLE(PARAM).
 {
-    A = new (CTXT) AST::formalParam((*PARAM).substr(1),
+    A = new (CTXT) AST::formalParam(TOKEN_TEXT(PARAM).substr(1),
                               CTXT, true/*ref*/);
     if (HINT) {
         A->setHint(*HINT);
@@ -739,7 +741,7 @@ formalParam(A) ::= maybeHint(HINT) T_AND T_VARIABLE(PARAM).
 }
 formalParam(A) ::= maybeHint(HINT) T_VARIABLE(PARAM) T_ASSIGN staticScalar(DEF).
 {
-    A = new (CTXT) AST::formalParam((*PARAM).substr(1),
+    A = new (CTXT) AST::formalParam(TOKEN_TEXT(PARAM).substr(1),
                               CTXT, false/*ref*/, DEF);
     if (HINT) {
         A->setHint(*HINT);
@@ -749,7 +751,7 @@ formalParam(A) ::= maybeHint(HINT) T_VARIABLE(PARAM) T_ASSIGN staticScalar(DEF).
 }
 formalParam(A) ::= maybeHint(HINT) T_AND T_VARIABLE(PARAM) T_ASSIGN staticScalar(DEF).
 {
-    A = new (CTXT) AST::formalParam((*PARAM).substr(1),
+    A = new (CTXT) AST::formalParam(TOKEN_TEXT(PARAM).substr(1),
                               CTXT, true/*ref*/, DEF);
     if (HINT) {
         A->setHint(*HINT);
@@ -792,13 +794,13 @@ formalParamList(A) ::= .
 %type signature {AST::signature*}
 signature(A) ::= T_IDENTIFIER(NAME) T_LEFTPAREN formalParamList(PARAMS) T_RIGHTPAREN.
 {
-    A = new (CTXT) AST::signature(*NAME, CTXT, PARAMS, false/*ref*/);
+    A = new (CTXT) AST::signature(TOKEN_TEXT(NAME), CTXT, PARAMS, false/*ref*/);
     A->setRange(TOKEN_RANGE(NAME));
     delete PARAMS;
 }
 signature(A) ::= T_AND T_IDENTIFIER(NAME) T_LEFTPAREN formalParamList(PARAMS) T_RIGHTPAREN.
 {
-    A = new (CTXT) AST::signature(*NAME, CTXT, PARAMS, true/*ref*/);
+    A = new (CTXT) AST::signature(TOKEN_TEXT(NAME), CTXT, PARAMS, true/*ref*/);
     A->setRange(TOKEN_RANGE(NAME));
     delete PARAMS;
 }
@@ -833,13 +835,13 @@ classDecl(A) ::= T_CLASS(C) T_IDENTIFIER(NAME) classExtends(EXTENDS) classImplem
                  T_LEFTCURLY classStatements(MEMBERS) T_RIGHTCURLY(RC).
 {
     A = new (CTXT) AST::classDecl(CTXT,
-                                  *NAME,
+                                  TOKEN_TEXT(NAME),
                                   AST::classDecl::NORMAL,
                                   EXTENDS,
                                   IMPLEMENTS,
                                   new (CTXT) AST::block(CTXT, MEMBERS));
     A->setRange(TOKEN_RANGE(C));
-    A->setEndCol(TOKEN_RANGE(RC));
+    A->setEndRange(TOKEN_RANGE(RC));
     // EXTENDS and IMPLEMENTS memory managed in classDecl constructor
     delete MEMBERS;
 }
@@ -847,13 +849,13 @@ classDecl(A) ::= T_FINAL T_CLASS(C) T_IDENTIFIER(NAME) classExtends(EXTENDS) cla
                  T_LEFTCURLY classStatements(MEMBERS) T_RIGHTCURLY(RC).
 {
     A = new (CTXT) AST::classDecl(CTXT,
-                                  *NAME,
+                                  TOKEN_TEXT(NAME),
                                   AST::classDecl::FINAL,
                                   EXTENDS,
                                   IMPLEMENTS,
                                   new (CTXT) AST::block(CTXT, MEMBERS));
     A->setRange(TOKEN_RANGE(C));
-    A->setEndCol(TOKEN_RANGE(RC));
+    A->setEndRange(TOKEN_RANGE(RC));
     // EXTENDS and IMPLEMENTS memory managed in classDecl constructor
     delete MEMBERS;
 }
@@ -861,13 +863,13 @@ classDecl(A) ::= T_ABSTRACT T_CLASS(C) T_IDENTIFIER(NAME) classExtends(EXTENDS)
                  T_LEFTCURLY classStatements(MEMBERS) T_RIGHTCURLY(RC).
 {
     A = new (CTXT) AST::classDecl(CTXT,
-                                  *NAME,
+                                  TOKEN_TEXT(NAME),
                                   AST::classDecl::ABSTRACT,
                                   EXTENDS,
                                   IMPLEMENTS,
                                   new (CTXT) AST::block(CTXT, MEMBERS));
     A->setRange(TOKEN_RANGE(C));
-    A->setEndCol(TOKEN_RANGE(RC));
+    A->setEndRange(TOKEN_RANGE(RC));
     // EXTENDS and IMPLEMENTS memory managed in classDecl constructor
     delete MEMBERS;
 }
@@ -875,13 +877,13 @@ classDecl(A) ::= T_INTERFACE(C) T_IDENTIFIER(NAME) interfaceExtends(EXTENDS)
                  T_LEFTCURLY classStatements(MEMBERS) T_RIGHTCURLY(RC).
 {
     A = new (CTXT) AST::classDecl(CTXT,
-                                  *NAME,
+                                  TOKEN_TEXT(NAME),
                                   AST::classDecl::IFACE,
                                   EXTENDS,
                                   NULL, /* interfaces can't implement */
                                   new (CTXT) AST::block(CTXT, MEMBERS));
     A->setRange(TOKEN_RANGE(C));
-    A->setEndCol(TOKEN_RANGE(RC));
+    A->setEndRange(TOKEN_RANGE(RC));
     // XXX this is double freeing??
     //if (EXTENDS)
         //delete EXTENDS;
@@ -960,31 +962,31 @@ classStatement(A) ::= methodFlags(FLAGS) T_AND T_FUNCTION signature(SIG) methodB
 classVar(A) ::= classVar(LIST) T_COMMA T_VARIABLE(VAR).
 {
     // strip $
-    LIST->push_back(new (CTXT) AST::propertyDecl(CTXT, (*VAR).substr(1), NULL));
+    LIST->push_back(new (CTXT) AST::propertyDecl(CTXT, TOKEN_TEXT(VAR).substr(1), NULL));
     A = LIST;
 }
 classVar(A) ::= classVar(LIST) T_COMMA T_VARIABLE(VAR) T_ASSIGN staticScalar(DEFAULT).
 {
     // strip $
-    LIST->push_back(new (CTXT) AST::propertyDecl(CTXT, (*VAR).substr(1), DEFAULT));
+    LIST->push_back(new (CTXT) AST::propertyDecl(CTXT, TOKEN_TEXT(VAR).substr(1), DEFAULT));
     A = LIST;
 }
 classVar(A) ::= T_VARIABLE(VAR).
 {
     A = new AST::statementList();
     // strip $
-    A->push_back(new (CTXT) AST::propertyDecl(CTXT, (*VAR).substr(1), NULL));
+    A->push_back(new (CTXT) AST::propertyDecl(CTXT, TOKEN_TEXT(VAR).substr(1), NULL));
 }
 classVar(A) ::= T_VARIABLE(VAR) T_ASSIGN staticScalar(DEFAULT).
 {
     A = new AST::statementList();
     // strip $
-    A->push_back(new (CTXT) AST::propertyDecl(CTXT, (*VAR).substr(1), DEFAULT));
+    A->push_back(new (CTXT) AST::propertyDecl(CTXT, TOKEN_TEXT(VAR).substr(1), DEFAULT));
 }
 %type classConstantDecl {AST::statementList*}
 classConstantDecl(A) ::= classConstantDecl(LIST) T_COMMA T_IDENTIFIER(ID) T_ASSIGN staticScalar(DEFAULT).
 {
-    AST::propertyDecl* prop = new (CTXT) AST::propertyDecl(CTXT, *ID, DEFAULT);
+    AST::propertyDecl* prop = new (CTXT) AST::propertyDecl(CTXT, TOKEN_TEXT(ID), DEFAULT);
     prop->setFlags(AST::memberFlags::CONST);
     LIST->push_back(prop);
     A = LIST;
@@ -992,7 +994,7 @@ classConstantDecl(A) ::= classConstantDecl(LIST) T_COMMA T_IDENTIFIER(ID) T_ASSI
 classConstantDecl(A) ::= T_CONST T_IDENTIFIER(ID) T_ASSIGN staticScalar(DEFAULT).
 {
     A = new AST::statementList();
-    AST::propertyDecl* prop = new (CTXT) AST::propertyDecl(CTXT, *ID, DEFAULT);
+    AST::propertyDecl* prop = new (CTXT) AST::propertyDecl(CTXT, TOKEN_TEXT(ID), DEFAULT);
     prop->setFlags(AST::memberFlags::CONST);
     A->push_back(prop);
 }
@@ -1262,7 +1264,7 @@ globalVarList(A) ::= globalVarList(LIST) T_COMMA globalVar(B).
 globalVar(A) ::= T_VARIABLE(B).
 {
     // strip $
-    A = new (CTXT) AST::var((*B).substr(1), CTXT);
+    A = new (CTXT) AST::var(TOKEN_TEXT(B).substr(1), CTXT);
     A->setRange(CURRENT_LINE);
 }
 globalVar(A) ::= T_DOLLAR rVar(B).
@@ -1277,14 +1279,14 @@ globalVar(A) ::= T_DOLLAR rVar(B).
 staticVarList(A) ::= T_VARIABLE(B).
 {
     A = new AST::expressionList();
-    AST::var* V= new (CTXT) AST::var((*B).substr(1), CTXT);
+    AST::var* V= new (CTXT) AST::var(TOKEN_TEXT(B).substr(1), CTXT);
     V->setRange(CURRENT_LINE);
     A->push_back(V);
 }
 staticVarList(A) ::= staticVarList(LIST) T_COMMA T_VARIABLE(B).
 {
     // strip $
-    AST::var* V= new (CTXT) AST::var((*B).substr(1), CTXT);
+    AST::var* V= new (CTXT) AST::var(TOKEN_TEXT(B).substr(1), CTXT);
     V->setRange(CURRENT_LINE);
     LIST->push_back(V);
     A = LIST;
@@ -1390,21 +1392,21 @@ scalar(A) ::= T_NS_SEPARATOR namespaceName(B).
 %type classConstant {AST::expr*}
 classConstant(A) ::= namespaceName(TARGET) T_DBL_COLON T_IDENTIFIER(ID).
 {
-    A = new (CTXT) AST::literalConstant(*ID, CTXT, new (CTXT) AST::literalID(TARGET, TOKEN_RANGE(ID), CTXT));
+    A = new (CTXT) AST::literalConstant(TOKEN_TEXT(ID), CTXT, new (CTXT) AST::literalID(TARGET, TOKEN_RANGE(ID), CTXT));
     A->setRange(CURRENT_LINE);
     delete TARGET;
 }
 classConstant(A) ::= T_NS_SEPARATOR namespaceName(TARGET) T_DBL_COLON T_IDENTIFIER(ID).
 {
     TARGET->setAbsolute();
-    A = new (CTXT) AST::literalConstant(*ID, CTXT, new (CTXT) AST::literalID(TARGET, TOKEN_RANGE(ID), CTXT));
+    A = new (CTXT) AST::literalConstant(TOKEN_TEXT(ID), CTXT, new (CTXT) AST::literalID(TARGET, TOKEN_RANGE(ID), CTXT));
     A->setRange(CURRENT_LINE);
     delete TARGET;
 }
 // variable class constant
 classConstant(A) ::= refVar(TARGET) T_DBL_COLON T_IDENTIFIER(ID).
 {
-    A = new (CTXT) AST::literalConstant(*ID, CTXT, TARGET);
+    A = new (CTXT) AST::literalConstant(TOKEN_TEXT(ID), CTXT, TARGET);
     A->setRange(CURRENT_LINE);
 }
 
@@ -1420,7 +1422,7 @@ staticScalar(A) ::= T_MINUS staticScalar(R).
 }
 staticScalar(A) ::= T_HEREDOC_START T_HEREDOC_STRING(B) T_HEREDOC_END.
 {
-  AST::literalString *hd = new (CTXT) AST::literalString(*B);
+  AST::literalString *hd = new (CTXT) AST::literalString(TOKEN_TEXT(B));
   hd->setIsSimple(false);
   hd->setRange(CURRENT_LINE);
   A = hd;
@@ -1445,7 +1447,7 @@ literal(A) ::= T_TICK_STRING(B).
 }
 literal(A) ::= T_HEREDOC_START T_HEREDOC_STRING(B) T_HEREDOC_END.
 {
-  AST::literalString *hd = new (CTXT) AST::literalString(*B);
+  AST::literalString *hd = new (CTXT) AST::literalString(TOKEN_TEXT(B));
   hd->setIsSimple(false);
   hd->setRange(CURRENT_LINE);
   A = hd;
@@ -1454,14 +1456,14 @@ literal(A) ::= T_HEREDOC_START T_HEREDOC_STRING(B) T_HEREDOC_END.
 // literal integers (decimal)
 literal(A) ::= T_LNUMBER(B).
 {
-    A = new (CTXT) AST::literalInt(*B);
+    A = new (CTXT) AST::literalInt(TOKEN_TEXT(B));
     A->setRange(CURRENT_LINE);
 }
 
 // literal integers (float)
 literal(A) ::= T_DNUMBER(B).
 {
-    A = new (CTXT) AST::literalFloat(*B);
+    A = new (CTXT) AST::literalFloat(TOKEN_TEXT(B));
     A->setRange(CURRENT_LINE);
 }
 
@@ -1485,32 +1487,32 @@ literal(A) ::= T_NULL.
 %type literalMagic {AST::expr*}
 literalMagic(A) ::= T_MAGIC_FILE(ID).
 {
-    A = new (CTXT) AST::literalID(*ID, TOKEN_RANGE(ID), CTXT);
+    A = new (CTXT) AST::literalID(TOKEN_TEXT(ID), TOKEN_RANGE(ID), CTXT);
     A->setRange(CURRENT_LINE);
 }
 literalMagic(A) ::= T_MAGIC_LINE(ID).
 {
-    A = new (CTXT) AST::literalID(*ID, TOKEN_RANGE(ID), CTXT);
+    A = new (CTXT) AST::literalID(TOKEN_TEXT(ID), TOKEN_RANGE(ID), CTXT);
     A->setRange(CURRENT_LINE);
 }
 literalMagic(A) ::= T_MAGIC_CLASS(ID).
 {
-    A = new (CTXT) AST::literalID(*ID, TOKEN_RANGE(ID), CTXT);
+    A = new (CTXT) AST::literalID(TOKEN_TEXT(ID), TOKEN_RANGE(ID), CTXT);
     A->setRange(CURRENT_LINE);
 }
 literalMagic(A) ::= T_MAGIC_METHOD(ID).
 {
-    A = new (CTXT) AST::literalID(*ID, TOKEN_RANGE(ID), CTXT);
+    A = new (CTXT) AST::literalID(TOKEN_TEXT(ID), TOKEN_RANGE(ID), CTXT);
     A->setRange(CURRENT_LINE);
 }
 literalMagic(A) ::= T_MAGIC_FUNCTION(ID).
 {
-    A = new (CTXT) AST::literalID(*ID, TOKEN_RANGE(ID), CTXT);
+    A = new (CTXT) AST::literalID(TOKEN_TEXT(ID), TOKEN_RANGE(ID), CTXT);
     A->setRange(CURRENT_LINE);
 }
 literalMagic(A) ::= T_MAGIC_NS(ID).
 {
-    A = new (CTXT) AST::literalID(*ID, TOKEN_RANGE(ID), CTXT);
+    A = new (CTXT) AST::literalID(TOKEN_TEXT(ID), TOKEN_RANGE(ID), CTXT);
     A->setRange(CURRENT_LINE);
 }
 
@@ -2032,13 +2034,13 @@ baseVar(A) ::= staticMember(B). { A = B; }
 refVar(A) ::= T_VARIABLE(B).
 {
     // strip $
-    A = new (CTXT) AST::var((*B).substr(1), CTXT);
+    A = new (CTXT) AST::var(TOKEN_TEXT(B).substr(1), CTXT);
     A->setRange(CURRENT_LINE);
 }
 refVar(A) ::= T_VARIABLE(B) arrayIndices(C).
 {
     // strip $
-    A = new (CTXT) AST::var((*B).substr(1), CTXT, C);
+    A = new (CTXT) AST::var(TOKEN_TEXT(B).substr(1), CTXT, C);
     A->setRange(CURRENT_LINE);
     delete C;
 }
@@ -2048,12 +2050,12 @@ refVar(A) ::= T_VARIABLE(B) arrayIndices(C).
 %type objProperty {AST::var*}
 objProperty(A) ::= T_IDENTIFIER(ID).
 {
-    A = new (CTXT) AST::var(*ID, CTXT);
+    A = new (CTXT) AST::var(TOKEN_TEXT(ID), CTXT);
     A->setRange(CURRENT_LINE);
 }
 objProperty(A) ::= T_IDENTIFIER(ID) arrayIndices(INDICES).
 {
-    A = new (CTXT) AST::var(*ID, CTXT, INDICES);
+    A = new (CTXT) AST::var(TOKEN_TEXT(ID), CTXT, INDICES);
     A->setRange(CURRENT_LINE);
     delete INDICES;
 }
@@ -2147,7 +2149,7 @@ functionInvoke(A) ::= namespaceName(TARGET) T_DBL_COLON T_IDENTIFIER(ID) T_LEFTP
 {
     // args come in backward, reverse them
     std::reverse(ARGS->begin(), ARGS->end());
-    A = new (CTXT) AST::functionInvoke(new (CTXT) AST::literalID(*ID, CTXT), // f name
+    A = new (CTXT) AST::functionInvoke(new (CTXT) AST::literalID(TOKEN_TEXT(ID), CTXT), // f name
                                        CTXT,
                                        ARGS,  // expression list: arguments, copied
                                        new (CTXT) AST::literalID(TARGET, CTXT)
@@ -2174,7 +2176,7 @@ functionInvoke(A) ::= T_NS_SEPARATOR namespaceName(TARGET) T_DBL_COLON T_IDENTIF
     // args come in backward, reverse them
     std::reverse(ARGS->begin(), ARGS->end());
     TARGET->setAbsolute();
-    A = new (CTXT) AST::functionInvoke(new (CTXT) AST::literalID(*ID, CTXT), // f name
+    A = new (CTXT) AST::functionInvoke(new (CTXT) AST::literalID(TOKEN_TEXT(ID), CTXT), // f name
                                        CTXT,
                                        ARGS,  // expression list: arguments, copied
                                        new (CTXT) AST::literalID(TARGET, CTXT)
@@ -2202,7 +2204,7 @@ functionInvoke(A) ::= refVar(TARGET) T_DBL_COLON T_IDENTIFIER(ID) T_LEFTPAREN ar
 {
     // args come in backward, reverse them
     std::reverse(ARGS->begin(), ARGS->end());
-    A = new (CTXT) AST::functionInvoke(new (CTXT) AST::literalID(*ID, CTXT), // f name
+    A = new (CTXT) AST::functionInvoke(new (CTXT) AST::literalID(TOKEN_TEXT(ID), CTXT), // f name
                                        CTXT,
                                        ARGS,  // expression list: arguments, copied
                                        TARGET
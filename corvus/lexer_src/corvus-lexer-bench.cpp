@@ -0,0 +1,172 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+// lexer throughput of the table driven and direct coded lexers, over the
+// given files and a synthetic corpus, so the faster may be picked for a
+// platform (see COR_DIRECT_LEXER). the two must lex the same, which is
+// checked as well. with --check, that's all it does, which "make check"
+// uses to keep them from drifting apart
+//
+// corvus-lexer-bench [-n runs] [--check] [file ...]
+// e.g. corvus-lexer-bench ../base/*.php
+
+#include "corvus/pLexer.h"
+#include "corvus/pTime.h"
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+using namespace corvus;
+
+namespace {
+
+// a bit of everything the lexer sees: doc comments, classes, strings with
+// escapes, numbers, casts, line comments and inline html
+std::string synthetic(std::size_t size) {
+
+    std::stringstream s;
+    s << "<html>\n<body>\n<?php\n";
+    for (int i = 0; s.tellp() < (std::streampos)size; ++i) {
+        s << "/**\n * class " << i << "\n * @param int $a\n */\n"
+          << "class Foo" << i << " extends Bar" << (i / 10) << " implements \\Baz\\Qux {\n"
+          << "    const LIMIT = " << (i * 7) << ";\n"
+          << "    protected static $cache = array('a' => 1, \"b\" => 2.5, 'c' => 0x1f);\n"
+          << "    public function run" << i << "($a, &$b = null) {\n"
+          << "        // single line comment " << i << "\n"
+          << "        # another one\n"
+          << "        if ($a >= self::LIMIT && !isset($this->items[$a])) {\n"
+          << "            $b = (int)$a . \"escaped \\\"quote\\\" and \\n newline\";\n"
+          << "            return $this->items[$a] = strlen('single \\'quoted\\'') + " << i << ";\n"
+          << "        }\n"
+          << "        /* multi\n           line */\n"
+          << "        foreach ($b as $k => $v) { $a += $v * 2; }\n"
+          << "        return $a;\n"
+          << "    }\n"
+          << "}\n";
+        if (i % 8 == 0)
+            s << "?>\n<div class=\"row\"><span>" << i << "</span>\n  <p>some inline html</p></div>\n<?php\n";
+    }
+    return s.str();
+
+}
+
+struct corpus {
+    std::string name;
+    std::vector<std::string> sources;
+    std::size_t bytes;
+    corpus(const std::string& n): name(n), bytes(0) { }
+    void add(const std::string& src) { sources.push_back(src); bytes += src.size(); }
+};
+
+// MB/s lexing all of c, runs times
+double throughput(const corpus& c, lexer::langLexer next, int runs) {
+
+    lexer::pTokenStream s;
+    double start = now();
+    for (int r = 0; r < runs; ++r) {
+        for (std::size_t i = 0; i < c.sources.size(); ++i) {
+            lexer::pLexer l(c.sources[i]);
+            l.tokenize(s, next);
+        }
+    }
+    double secs = now() - start;
+    return (c.bytes * (double)runs / (1024 * 1024)) / secs;
+
+}
+
+bool sameTokens(const corpus& c, lexer::langLexer a, lexer::langLexer b) {
+
+    lexer::pTokenStream sa, sb;
+    for (std::size_t i = 0; i < c.sources.size(); ++i) {
+        lexer::pLexer l(c.sources[i]);
+        l.tokenize(sa, a);
+        l.tokenize(sb, b);
+        if (sa.size() != sb.size())
+            return false;
+        for (std::size_t t = 0; t < sa.size(); ++t) {
+            if (sa[t].offset != sb[t].offset ||
+                sa[t].length != sb[t].length ||
+                sa[t].id != sb[t].id)
+                return false;
+        }
+    }
+    return true;
+
+}
+
+}
+
+int main(int argc, char* argv[]) {
+
+    int runs = 10;
+    bool checkOnly = false;
+    corpus files("files");
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            runs = std::atoi(argv[++i]);
+            continue;
+        }
+        if (std::strcmp(argv[i], "--check") == 0) {
+            checkOnly = true;
+            continue;
+        }
+        std::ifstream in(argv[i], std::ios::in | std::ios::binary);
+        if (!in.is_open()) {
+            std::cerr << "unable to open " << argv[i] << std::endl;
+            return 1;
+        }
+        std::stringstream src;
+        src << in.rdbuf();
+        files.add(src.str());
+    }
+    if (runs < 1)
+        runs = 1;
+
+    corpus synth("synthetic");
+    synth.add(synthetic(4 * 1024 * 1024));
+
+    std::vector<corpus*> all;
+    if (!files.sources.empty())
+        all.push_back(&files);
+    all.push_back(&synth);
+
+    lexer::langLexer table = &corvus_nextLangTokenTable<pSourceCharIterator, std::size_t>;
+    lexer::langLexer direct = &corvus_nextLangTokenDirect<pSourceCharIterator, std::size_t>;
+
+    bool ok = true;
+    for (std::size_t i = 0; i < all.size(); ++i) {
+        const corpus& c = *all[i];
+        if (!sameTokens(c, table, direct)) {
+            std::cerr << c.name << ": the table and direct lexers don't agree" << std::endl;
+            ok = false;
+            continue;
+        }
+        if (checkOnly) {
+            std::cout << c.name << " (" << c.sources.size() << " sources): "
+                      << "the table and direct lexers agree" << std::endl;
+            continue;
+        }
+        // once each to warm up
+        throughput(c, table, 1);
+        throughput(c, direct, 1);
+        std::cout << c.name << " (" << c.sources.size() << " sources, "
+                  << std::fixed << std::setprecision(1) << (c.bytes / (1024.0 * 1024)) << " MB): "
+                  << "table " << throughput(c, table, runs) << " MB/s, "
+                  << "direct " << throughput(c, direct, runs) << " MB/s" << std::endl;
+    }
+    return ok ? 0 : 1;
+
+}
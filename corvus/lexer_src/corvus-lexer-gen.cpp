@@ -20,10 +20,231 @@
 
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdlib>
 
 #define IDCHARS "[a-zA-Z_\x7f-\xff][a-zA-Z0-9_\x7f-\xff]*"
 
-int main(void) {
+namespace {
+
+typedef lexertl::state_machine::internals internals;
+typedef std::size_t id_type;
+
+std::string idValue(id_type v) {
+
+    if (v == static_cast<id_type>(~0))
+        return "results::npos ()";
+    std::stringstream s;
+    s << v;
+    return s.str();
+
+}
+
+std::string label(std::size_t dfa, std::size_t state) {
+
+    std::stringstream s;
+    s << "d" << dfa << "_s" << state;
+    return s.str();
+
+}
+
+// what the table driven lexer does on reaching an accepting state
+void outputAccept(const id_type *row, std::ostream& os) {
+
+    if (!row[lexertl::end_state_index])
+        return;
+    os << "    end_state_ = true;\n";
+    os << "    pop_ = " << ((row[lexertl::end_state_index] & lexertl::pop_dfa_bit) ? "true" : "false") << ";\n";
+    os << "    id_ = " << idValue(row[lexertl::id_index]) << ";\n";
+    os << "    uid_ = " << idValue(row[lexertl::user_id_index]) << ";\n";
+    os << "    push_dfa_ = " << idValue(row[lexertl::push_dfa_index]) << ";\n";
+    os << "    start_state_ = " << idValue(row[lexertl::next_dfa_index]) << ";\n";
+    os << "    end_token_ = curr_;\n";
+
+}
+
+// write the state machine out as code, a label per dfa state and a switch
+// on the next character's class for its transitions, in place of the
+// tables table_based_cpp writes. the two match the same way. characters
+// are mapped to classes by a byte table per dfa, which is the dfa's lookup
+// table less its header columns
+void generateDirect(const std::string& name, const lexertl::state_machine& sm, std::ostream& os) {
+
+    const internals& in = sm.data();
+    const id_type supported = lexertl::eol_bit | lexertl::again_bit |
+                              lexertl::multi_state_bit | lexertl::recursive_bit;
+    if ((in._features & ~supported) || !(in._features & lexertl::recursive_bit)) {
+        std::cerr << "the direct coded lexer doesn't support these rules" << std::endl;
+        exit(-1);
+    }
+    const bool eol = (in._features & lexertl::eol_bit) != 0;
+    const std::size_t dfas = in._lookup->size();
+
+    // table_based_cpp leaves the stream in hex
+    os << std::dec;
+
+    os << "template<typename iter_type, typename id_type>\n";
+    os << "void " << name << " (lexertl::recursive_match_results<iter_type, id_type> &results_)\n";
+    os << "{\n";
+    os << "    typedef lexertl::recursive_match_results<iter_type, id_type> results;\n";
+    os << "    typename results::iter_type end_token_ = results_.end;\n";
+    os << "    typename results::iter_type curr_ = results_.end;\n";
+    os << "    bool end_state_ = false;\n";
+    os << "    bool pop_ = false;\n";
+    os << "    id_type id_ = 0;\n";
+    os << "    id_type uid_ = 0;\n";
+    os << "    id_type push_dfa_ = 0;\n";
+    os << "    id_type start_state_ = 0;\n\n";
+    os << "    results_.start = curr_;\n\n";
+
+    for (std::size_t d = 0; d < dfas; ++d) {
+        const std::vector<id_type>& lookup = *(*in._lookup)[d];
+        os << "    static const unsigned char classes" << d << "_[256] = {";
+        for (std::size_t c = 0; c < 256; ++c) {
+            // dead_state_index, where all the characters no rule uses go,
+            // becomes class 0
+            id_type cls = lookup[c] - lexertl::dead_state_index;
+            if (cls > 255) {
+                std::cerr << "too many character classes for the direct coded lexer" << std::endl;
+                exit(-1);
+            }
+            os << ((c % 16) ? " " : "\n        ") << cls << ((c < 255) ? "," : "");
+        }
+        os << "};\n";
+    }
+
+    os << "\nagain:\n";
+    os << "    if (curr_ == results_.eoi)\n";
+    os << "    {\n";
+    os << "        results_.id = " << in._eoi << ";\n";
+    os << "        results_.user_id = results::npos ();\n";
+    os << "        return;\n";
+    os << "    }\n\n";
+
+    // the start state of each dfa is row 1. row 0 is the dead state
+    os << "    start_state_ = results_.state;\n";
+    os << "    end_token_ = curr_;\n\n";
+    os << "    switch (results_.state)\n";
+    os << "    {\n";
+    for (std::size_t d = 0; d < dfas; ++d) {
+        const id_type *row = &(*(*in._dfa)[d])[in._dfa_alphabet[d]];
+        os << "    case " << d << ":\n";
+        os << "        end_state_ = " << (row[lexertl::end_state_index] ? "true" : "false") << ";\n";
+        os << "        pop_ = " << ((row[lexertl::end_state_index] & lexertl::pop_dfa_bit) ? "true" : "false") << ";\n";
+        os << "        id_ = " << idValue(row[lexertl::id_index]) << ";\n";
+        os << "        uid_ = " << idValue(row[lexertl::user_id_index]) << ";\n";
+        os << "        push_dfa_ = " << idValue(row[lexertl::push_dfa_index]) << ";\n";
+        os << "        goto " << label(d, 1) << "_next;\n";
+    }
+    os << "    }\n\n";
+
+    for (std::size_t d = 0; d < dfas; ++d) {
+
+        const std::vector<id_type>& dfa = *(*in._dfa)[d];
+        const std::size_t alphabet = in._dfa_alphabet[d];
+        const std::size_t states = dfa.size() / alphabet;
+
+        for (std::size_t st = 1; st < states; ++st) {
+
+            const id_type *row = &dfa[st * alphabet];
+            const bool hasEOL = eol && row[lexertl::eol_index];
+
+            os << label(d, st) << ":\n";
+            outputAccept(row, os);
+            os << label(d, st) << "_next:\n";
+            os << "    if (curr_ == results_.eoi)\n";
+            os << "        goto " << (hasEOL ? label(d, st) + "_eoi" : std::string("done_")) << ";\n";
+            if (hasEOL) {
+                os << "    if (*curr_ == '\\n')\n";
+                os << "        goto " << label(d, row[lexertl::eol_index]) << ";\n";
+            }
+
+            // group the classes by the state they go to
+            std::map<id_type, std::vector<std::size_t> > targets;
+            for (std::size_t col = lexertl::transitions_index; col < alphabet; ++col) {
+                if (row[col])
+                    targets[row[col]].push_back(col - lexertl::dead_state_index);
+            }
+
+            os << "    switch (classes" << d << "_[static_cast<unsigned char>(*curr_++)])\n";
+            os << "    {\n";
+            for (std::map<id_type, std::vector<std::size_t> >::const_iterator t = targets.begin();
+                 t != targets.end();
+                 ++t) {
+                os << "   ";
+                for (std::size_t i = 0; i < t->second.size(); ++i)
+                    os << " case " << t->second[i] << ":";
+                os << "\n        goto " << label(d, t->first) << ";\n";
+            }
+            os << "    }\n";
+            if (hasEOL) {
+                os << "    if (curr_ == results_.eoi)\n";
+                os << "        goto " << label(d, st) << "_eoi;\n";
+            }
+            os << "    goto done_;\n";
+
+            if (hasEOL) {
+                // at the end of input, $ matches
+                os << label(d, st) << "_eoi:\n";
+                outputAccept(&dfa[row[lexertl::eol_index] * alphabet], os);
+                os << "    goto done_;\n";
+            }
+
+        }
+
+    }
+
+    os << "\ndone_:\n";
+    os << "    if (end_state_)\n";
+    os << "    {\n";
+    os << "        // Return longest match\n";
+    os << "        if (pop_)\n";
+    os << "        {\n";
+    os << "            start_state_ =  results_.stack.top ().first;\n";
+    os << "            results_.stack.pop ();\n";
+    os << "        }\n";
+    os << "        else if (push_dfa_ != results_.npos ())\n";
+    os << "        {\n";
+    os << "            results_.stack.push (typename results::id_type_pair\n";
+    os << "                (push_dfa_, id_));\n";
+    os << "        }\n\n";
+    os << "        results_.state = start_state_;\n";
+    os << "        results_.end = end_token_;\n";
+    if (in._features & lexertl::again_bit) {
+        os << "\n        if (id_ == " << in._eoi << " || (pop_ && !results_.stack.empty () &&\n";
+        os << "            results_.stack.top ().second == " << in._eoi << "))\n";
+        os << "        {\n";
+        os << "            curr_ = end_token_;\n";
+        os << "            goto again;\n";
+        os << "        }\n";
+    }
+    os << "    }\n";
+    os << "    else\n";
+    os << "    {\n";
+    os << "        // No match causes char to be skipped\n";
+    os << "        results_.end = end_token_;\n";
+    os << "        results_.start = results_.end;\n";
+    os << "        ++results_.end;\n";
+    os << "        id_ = results::npos ();\n";
+    os << "        uid_ = results::npos ();\n";
+    os << "    }\n\n";
+    os << "    results_.id = id_;\n";
+    os << "    results_.user_id = uid_;\n";
+    os << "}\n\n";
+
+}
+
+}
+
+// with --direct, corvus_nextLangToken is the direct coded lexer rather than
+// the table driven one. both are always written, see corvus-lexer-bench
+int main(int argc, char* argv[]) {
+
+    bool direct = (argc > 1 && std::strcmp(argv[1], "--direct") == 0);
 
     // language lexer
     lexertl::rules langRules_((lexertl::regex_flags)(lexertl::icase | lexertl::dot_not_newline));
@@ -213,7 +434,14 @@ int main(void) {
         exit(-1);
     }
     outFile << "#include \"lexertl/match_results.hpp\"" << std::endl;
-    lexertl::table_based_cpp::generate_cpp("corvus_nextLangToken", langState_, false, outFile);
+    lexertl::table_based_cpp::generate_cpp("corvus_nextLangTokenTable", langState_, false, outFile);
+    outFile << std::endl;
+    generateDirect("corvus_nextLangTokenDirect", langState_, outFile);
+    outFile << "template<typename iter_type, typename id_type>" << std::endl;
+    outFile << "inline void corvus_nextLangToken (lexertl::recursive_match_results<iter_type, id_type> &results_)" << std::endl;
+    outFile << "{" << std::endl;
+    outFile << "    " << (direct ? "corvus_nextLangTokenDirect" : "corvus_nextLangTokenTable") << " (results_);" << std::endl;
+    outFile << "}" << std::endl;
     outFile.close();
 
 }
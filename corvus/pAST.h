@@ -131,7 +131,7 @@ class stmt {
     pUInt refCount_;
 
 protected:
-    pSourceRange range_;
+    pSourceSpan span_;
     typedef boost::unordered_map<std::string, std::string> PropertyMap;
     PropertyMap properties_;
 
@@ -157,7 +157,7 @@ protected:
   void destroyChildren(pParseContext& C);
   
   // we do not copy properties
-  stmt(const stmt& other): kind_(other.kind_), refCount_(1), range_(other.range_), properties_() { }
+  stmt(const stmt& other): kind_(other.kind_), refCount_(1), span_(other.span_), properties_() { }
     
   // This method assists in deep-copys of stmt**'s which are present for example in block nodes.
   void deepCopyChildren(stmt**& newChildren, stmt** const& oldChildren, pUInt numChildren, pParseContext& C) {
@@ -227,21 +227,11 @@ public:
 
     nodeKind kind(void) const { return kind_; }
 
-    void setRange(const pSourceRange& range) { range_ = range; }
-    void setEndRange(const pSourceRange& range) {
-        range_.endLine = range.endLine;
-        range_.endCol = range.endCol;
-    }
-
-    void setEndLine(const pSourceRange& range) { range_.endLine = range.endLine; }
-    void setEndCol(const pSourceRange& range) { range_.endCol = range.endCol; }
+    void setRange(const pSourceSpan& span) { span_ = span; }
+    void setEndRange(const pSourceSpan& span) { span_.end = span.end; }
 
-    pUInt startLineNum(void) const { return range_.startLine; }
-    pUInt endLineNum(void) const { return range_.endLine; }
-    pUInt startCol(void) const { return range_.startCol; }
-    pUInt endCol(void) const { return range_.endCol; }
-
-    const pSourceRange& range() const { return range_; }
+    // the lines and columns are found from the source, see pSourceFile::range
+    const pSourceSpan& span() const { return span_; }
 
     void setProp(pStringRef key, pStringRef val) {
         properties_[key.str()] = val.str();
@@ -447,20 +437,18 @@ public:
     typedef std::vector<std::string> partsType;
 
 protected:
-    pSourceRange range_;
+    pSourceSpan span_;
     partsType parts_;
     bool absolute_;
 
 public:
-    namespaceName(const pSourceRange& range): absolute_(false) {
-        range_ = range;
-    }
+    namespaceName(const pSourceSpan& span): span_(span), absolute_(false) { }
 
-    void setEndCol(int endCol) {
-        range_.endCol = endCol;
+    void setEndRange(const pSourceSpan& span) {
+        span_.end = span.end;
     }
 
-    pSourceRange range() const { return range_; }
+    const pSourceSpan& span() const { return span_; }
 
     void push_back(pStringRef part) {
         parts_.push_back(part);
@@ -1807,11 +1795,11 @@ protected:
     literalID(const literalID& other, pParseContext& C): expr(other), name_(other.name_) {}
     
 public:
-    literalID(const pSourceRef& name, pSourceRange r, pParseContext& C):
+    literalID(const pSourceRef& name, const pSourceSpan& s, pParseContext& C):
         expr(literalIDKind),
         name_(name)
     {
-        range_ = r;
+        span_ = s;
     }
 
     literalID(const pSourceRef& name, pParseContext& C):
@@ -1827,19 +1815,19 @@ public:
 
     }
 
-    literalID(const namespaceName* name, pSourceRange r, pParseContext& C):
+    literalID(const namespaceName* name, const pSourceSpan& s, pParseContext& C):
         expr(literalIDKind),
         name_(name->getFullName())
     {
-        range_ = r;
+        span_ = s;
     }
 
     pStringRef name(void) const {
         return name_;
     }
 
-    static literalID* create(pStringRef name, pSourceRange r, pParseContext& C) {
-        return new (C) literalID(name, r, C);
+    static literalID* create(pStringRef name, const pSourceSpan& s, pParseContext& C) {
+        return new (C) literalID(name, s, C);
     }
 
     stmt::child_iterator child_begin() { return child_iterator(); }
@@ -0,0 +1,102 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#include "corvus/pBuiltins.h"
+#include "corvus/pSymbolIndex.h"
+
+#include <llvm/ADT/SmallVector.h>
+#include <string>
+
+namespace corvus {
+
+namespace {
+
+// where key is, if it's in the table at all
+std::size_t slotOf(const int *slots, std::size_t count, pStringRef key) {
+
+    int s = slots[pBuiltins::hash(0, key) % count];
+    if (s < 0)
+        return -s - 1;
+    return pBuiltins::hash(s, key) % count;
+
+}
+
+// the builtins are all in the global namespace
+bool globalName(pStringRef& name) {
+
+    if (name.startswith("\\"))
+        name = name.substr(1);
+    return !name.empty() && name.find('\\') == pStringRef::npos;
+
+}
+
+}
+
+// fnv-1a, with the seed mixed into the offset basis
+unsigned pBuiltins::hash(unsigned seed, pStringRef key) {
+
+    unsigned h = 2166136261u ^ (seed * 0x9e3779b9u);
+    for (std::size_t i = 0; i < key.size(); ++i) {
+        h ^= (unsigned char)key[i];
+        h *= 16777619u;
+    }
+    return h ^ (h >> 15);
+
+}
+
+const builtins::bFunction* pBuiltins::lookupFunction(pStringRef name) {
+
+    if (!builtins::functionCount || !globalName(name))
+        return NULL;
+    std::string key = pSymbolIndex::lower(name);
+    const builtins::bFunction *f = &builtins::functions[slotOf(builtins::functionSlots,
+                                                             builtins::functionCount, key)];
+    return (key == f->name) ? f : NULL;
+
+}
+
+const builtins::bClass* pBuiltins::lookupClass(pStringRef name) {
+
+    if (!builtins::classCount || !globalName(name))
+        return NULL;
+    std::string key = pSymbolIndex::lower(name);
+    const builtins::bClass *c = &builtins::classes[slotOf(builtins::classSlots,
+                                                        builtins::classCount, key)];
+    return (key == c->name) ? c : NULL;
+
+}
+
+bool pBuiltins::lookupConstant(pStringRef name) {
+
+    if (!builtins::constantCount || !globalName(name))
+        return false;
+    return name == builtins::constants[slotOf(builtins::constantSlots, builtins::constantCount, name)];
+
+}
+
+bool pBuiltins::hasClassConstant(const builtins::bClass *c, pStringRef name) {
+
+    for (std::size_t i = 0; i < c->constantCount; ++i) {
+        if (name == builtins::classConstants[c->firstConstant + i])
+            return true;
+    }
+
+    llvm::SmallVector<pStringRef, 8> parents;
+    pStringRef(c->parents).split(parents, ",");
+    for (std::size_t i = 0; i < parents.size(); ++i) {
+        const builtins::bClass *p = lookupClass(parents[i]);
+        if (p && p != c && hasClassConstant(p, name))
+            return true;
+    }
+    return false;
+
+}
+
+} // namespace
@@ -0,0 +1,94 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#ifndef COR_PBUILTINS_H_
+#define COR_PBUILTINS_H_
+
+#include "corvus/pTypes.h"
+
+#include <cstddef>
+
+namespace corvus {
+
+// the functions, classes and constants declared by the php stubs in base/.
+// corvus-builtins-gen builds a model of the stubs at build time and writes
+// it out as tables, see corvus_builtins.cpp in the build dir, so the stubs
+// needn't be parsed at runtime. ModelChecker looks here before the model.
+//
+// each table is keyed by a minimal perfect hash: the key's slot is found
+// from its bucket's entry in the slots table, either directly (negative
+// entries are -slot-1) or as the key's hash, seeded with the entry. keys are
+// lower case, except for constants, as in php
+namespace builtins {
+
+struct bFunction {
+    const char *name;
+    int minArity;
+    int maxArity;
+};
+
+struct bClass {
+    const char *name;
+    // pModel::CLASS or pModel::IFACE
+    int type;
+    // what it extends and implements, comma separated
+    const char *parents;
+    // into constants and methods below
+    std::size_t firstConstant;
+    std::size_t constantCount;
+    std::size_t firstMethod;
+    std::size_t methodCount;
+};
+
+extern const bFunction functions[];
+extern const int functionSlots[];
+extern const std::size_t functionCount;
+
+extern const bClass classes[];
+extern const int classSlots[];
+extern const std::size_t classCount;
+
+extern const char* const constants[];
+extern const int constantSlots[];
+extern const std::size_t constantCount;
+
+// of the classes, by bClass::firstConstant and firstMethod
+extern const char* const classConstants[];
+extern const bFunction methods[];
+
+// a hash of the tables, which changes when the stubs do
+extern const char stamp[];
+
+}
+
+class pBuiltins {
+
+public:
+
+    // the slot hash, see builtins above
+    static unsigned hash(unsigned seed, pStringRef key);
+
+    // NULL if name isn't a builtin. a leading \ is allowed, any other
+    // namespace isn't
+    static const builtins::bFunction* lookupFunction(pStringRef name);
+    static const builtins::bClass* lookupClass(pStringRef name);
+    static bool lookupConstant(pStringRef name);
+
+    // whether the class, or a builtin it extends or implements, has the
+    // constant
+    static bool hasClassConstant(const builtins::bClass *c, pStringRef name);
+
+    static const char* stamp(void) { return builtins::stamp; }
+
+};
+
+} // namespace
+
+#endif
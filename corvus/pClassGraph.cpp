@@ -80,57 +80,123 @@ void pClassGraph::writeDot(pStringRef fileName) {
 
 }
 
-void pClassGraph::cache_class_decls(db::pDB::oid in_class_id, db::pDB::oid parent_class_id) {
+void pClassGraph::parents(db::pDB::oid c_id, IDList& result) {
 
-    //    work_id = (parent_class_id != NULLID) ? parent_class_id : in_class_id
-    db::pDB::oid work_id = (parent_class_id != db::pDB::NULLID) ? parent_class_id : in_class_id;
-    if (db_->trace())
-        std::cout << "cache_class_decl(" << work_id << "," << parent_class_id << ")" << std::endl;
+    result.clear();
 
-    //    [LOOP] for each method|decl X in work_id list that doesn't match a symbol already in cache for in_class_id
-    //      cache X for in_class_id
-    db::pDB::RowList result;
-    std::stringstream query, iquery;
-    query << "SELECT id FROM function WHERE class_id=" << work_id;
-    db_->list_query(query.str(), result);
-    for (int i = 0; i < result.size(); ++i) {
-        iquery << "INSERT INTO class_model_function VALUES (NULL, "
-               << in_class_id << ","
-               << result[i].getAsOID("id") << ")";
-        db_->sql_execute(iquery.str());
-        iquery.str("");
+    // classes without relations have no vertex
+    std::map<db::pDB::oid, GraphType::vertex_descriptor>::iterator v = vcache_.find(c_id);
+    if (v == vcache_.end())
+        return;
+
+    typedef GraphType::in_edge_iterator parent_iter;
+    parent_iter iter, end;
+    for (boost::tie(iter,end) = boost::in_edges(v->second, *graph_);
+         iter != end;
+         ++iter) {
+        result.push_back(boost::source(*iter, *graph_));
     }
 
+}
+
+namespace {
+
+// a class being walked in flatten, and which of its parents is next
+struct frame {
+    db::pDB::oid id;
+    std::vector<db::pDB::oid> parents;
+    std::size_t next;
+};
+
+void append(std::vector<db::pDB::oid>& to, const std::vector<db::pDB::oid>& from,
+            boost::unordered_set<db::pDB::oid>& seen) {
 
-    query.str(""); result.clear();
-    query << "SELECT id FROM class_decl WHERE class_id=" << work_id;
-    db_->list_query(query.str(), result);
-    for (int i = 0; i < result.size(); ++i) {
-        iquery << "INSERT INTO class_model_decl VALUES (NULL, "
-               << in_class_id << ","
-               << result[i].getAsOID("id") << ")";
-        db_->sql_execute(iquery.str());
-        iquery.str("");
+    for (std::size_t i = 0; i < from.size(); ++i) {
+        if (seen.insert(from[i]).second)
+            to.push_back(from[i]);
     }
 
-    // see if vertex exists in the graph, to recurse for parents
-    if (vcache_.find(work_id) == vcache_.end()) {
+}
+
+}
+
+// walks up from c_id and flattens each class on the way back down, after its
+// parents, so a class shared by many below it is only flattened once. it's a
+// loop rather than recursion, hierarchies can be deep. a parent that is still
+// being walked means the relations are cyclic, that edge is left out
+const pClassGraph::members& pClassGraph::flatten(db::pDB::oid c_id) {
+
+    boost::unordered_map<db::pDB::oid, members>::iterator found = flat_.find(c_id);
+    if (found != flat_.end())
+        return found->second;
+
+    db::pStmt& functions = db_->statement("classModelFunctions",
+            "SELECT id FROM function WHERE class_id=? ORDER BY id");
+    db::pStmt& decls = db_->statement("classModelDecls",
+            "SELECT id FROM class_decl WHERE class_id=? ORDER BY id");
+
+    boost::unordered_set<db::pDB::oid> walking;
+    std::vector<frame> stack(1);
+    stack.back().id = c_id;
+    stack.back().next = 0;
+    parents(c_id, stack.back().parents);
+    walking.insert(c_id);
+
+    while (!stack.empty()) {
+
+        frame& top = stack.back();
+        if (top.next < top.parents.size()) {
+            db::pDB::oid p_id = top.parents[top.next++];
+            if (flat_.find(p_id) != flat_.end())
+                continue;
+            if (walking.find(p_id) != walking.end()) {
+                if (db_->trace())
+                    std::cout << "class relations are cyclic at " << top.id << " -> " << p_id << std::endl;
+                continue;
+            }
+            walking.insert(p_id);
+            stack.push_back(frame());
+            stack.back().id = p_id;
+            stack.back().next = 0;
+            parents(p_id, stack.back().parents);
+            continue;
+        }
+
         if (db_->trace())
-            std::cout << " -- no vertex (no relations)\n";
-        return;
-    }
+            std::cout << "flatten class " << top.id << std::endl;
+
+        // its own, then each parent's in turn
+        members& m = flat_[top.id];
+        boost::unordered_set<db::pDB::oid> seenFunctions, seenDecls;
+
+        functions.bind(1, top.id);
+        while (functions.step())
+            m.functions.push_back(functions.getOID(0));
+        functions.reset();
+        seenFunctions.insert(m.functions.begin(), m.functions.end());
+
+        decls.bind(1, top.id);
+        while (decls.step())
+            m.decls.push_back(decls.getOID(0));
+        decls.reset();
+        seenDecls.insert(m.decls.begin(), m.decls.end());
+
+        for (std::size_t i = 0; i < top.parents.size(); ++i) {
+            boost::unordered_map<db::pDB::oid, members>::iterator p = flat_.find(top.parents[i]);
+            // left out, as cyclic
+            if (p == flat_.end() || p->first == top.id)
+                continue;
+            append(m.functions, p->second.functions, seenFunctions);
+            append(m.decls, p->second.decls, seenDecls);
+        }
+
+        walking.erase(top.id);
+        stack.pop_back();
 
-    //    [LOOP] for each parent P of work_id
-    //      recurse [in_class_id P]
-    GraphType::vertex_descriptor source = vcache_[work_id];
-    typedef GraphType::in_edge_iterator parent_iter;
-    parent_iter iter, end;
-    for (boost::tie(iter,end) = boost::in_edges(source, *graph_);
-         iter != end;
-         ++iter) {
-        cache_class_decls(in_class_id, boost::source(*iter, *graph_));
     }
 
+    return flat_[c_id];
+
 }
 
 void pClassGraph::build() {
@@ -161,14 +227,33 @@ void pClassGraph::build() {
     // NOTE this excludes classes with NO (parent or child) relations
     build_graph();
 
+    db::pInsertBatch functions(db_, "class_model_function", 2);
+    db::pInsertBatch decls(db_, "class_model_decl", 2);
+
     db_->begin();
 
     // cache decls for each class we're interested in
     for (int i = 0; i < result.size(); i++) {
         if (db_->trace())
             std::cout << "cache_class_decl top level on: " << result[i].get("name") << std::endl;
-        cache_class_decls(result[i].getAsOID("in_class_id"), db::pDB::NULLID);
+        db::pDB::oid c_id = result[i].getAsOID("in_class_id");
+        const members& m = flatten(c_id);
+        for (std::size_t j = 0; j < m.functions.size(); ++j) {
+            functions.add(c_id);
+            functions.add(m.functions[j]);
+        }
+        for (std::size_t j = 0; j < m.decls.size(); ++j) {
+            decls.add(c_id);
+            decls.add(m.decls[j]);
+        }
+        // keep the batches from growing with the whole model
+        if (functions.rows() + decls.rows() > 8192) {
+            functions.flush();
+            decls.flush();
+        }
     }
+    functions.flush();
+    decls.flush();
 
     db_->commit();
 
@@ -12,7 +12,10 @@
 #define PCLASSGRAPH_H
 
 #include <boost/graph/adjacency_list.hpp>
+#include <boost/unordered_map.hpp>
+#include <boost/unordered_set.hpp>
 #include <map>
+#include <vector>
 
 #include "pDB.h"
 #include "corvus/pTypes.h"
@@ -32,6 +35,15 @@ public:
 
 private:
 
+    typedef std::vector<db::pDB::oid> IDList;
+
+    // the functions and decls of a class, its own and those of every class
+    // above it, each once
+    struct members {
+        IDList functions;
+        IDList decls;
+    };
+
     // we do not own
     db::pDB* db_;
 
@@ -41,9 +53,13 @@ private:
     // cache of vertexes by id
     std::map<db::pDB::oid, GraphType::vertex_descriptor> vcache_;
 
+    // flattened classes, by id
+    boost::unordered_map<db::pDB::oid, members> flat_;
+
     void build_graph();
 
-    void cache_class_decls(db::pDB::oid in_class_id, db::pDB::oid parent_class_id);
+    void parents(db::pDB::oid c_id, IDList& result);
+    const members& flatten(db::pDB::oid c_id);
 
 public:
     pClassGraph(db::pDB* db): db_(db), graph_(0) { }
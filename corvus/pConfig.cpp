@@ -72,6 +72,9 @@ bool pConfigMgr::read(const llvm::Twine &file, pConfig &c) {
             else if (key == "db") {
                 c.dbName = val.str();
             }
+            else if (key == "model_layer") {
+                c.modelLayer = val.str();
+            }
             else if (key == "exts") {
                 c.exts = val.str();
             }
@@ -80,6 +83,21 @@ bool pConfigMgr::read(const llvm::Twine &file, pConfig &c) {
                 val.getAsInteger(10, result);
                 c.verbosity = result.getLimitedValue();
             }
+            else if (key == "jobs") {
+                llvm::APInt result;
+                val.getAsInteger(10, result);
+                c.jobs = result.getLimitedValue();
+            }
+            else if (key == "db_on_disk") {
+                llvm::APInt result;
+                val.getAsInteger(10, result);
+                c.dbOnDisk = result.getBoolValue();
+            }
+            else if (key == "diagnostic_files_only") {
+                llvm::APInt result;
+                val.getAsInteger(10, result);
+                c.diagFilesOnly = result.getBoolValue();
+            }
             else {
                 std::cerr << "unknown key in config file: " << key.str() << std::endl;
             }
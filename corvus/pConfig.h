@@ -26,13 +26,20 @@ struct pConfig {
     StringListType diagFiles;
     std::string rootDir;
     std::string dbName;
+    // a prebuilt model db to layer under the model, see pModel::attachLayer
+    std::string modelLayer;
     std::string exts;
     int verbosity;
+    int jobs;
     bool debugParse;
     bool debugModel;
     bool debugDiags;
-    pConfig(): exts("php"), verbosity(0), debugParse(false), debugModel(false),
-               debugDiags(false) { }
+    // only parse and check diagFiles, taking everything else from the model
+    bool diagFilesOnly;
+    // use the model db file in place instead of loading it into memory
+    bool dbOnDisk;
+    pConfig(): exts("php"), verbosity(0), jobs(1), debugParse(false), debugModel(false),
+               debugDiags(false), diagFilesOnly(false), dbOnDisk(false) { }
 
 };
 
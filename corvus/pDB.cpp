@@ -33,6 +33,119 @@ sqlite3_int64 dbRow::getAsOID(pStringRef key) const {
     return atoll(v->second.c_str());
 }
 
+void dbRow::read(const pStmt &row) {
+    for (int i = 0; i < row.columnCount(); i++) {
+        set(row.columnName(i), row.getText(i));
+    }
+}
+
+void pStmt::check(int rc) const {
+    if (rc != SQLITE_OK) {
+        std::cerr << "sqlite error: " << sql_ << "\n";
+        std::cerr << sqlite3_errmsg(sqlite3_db_handle(stmt_)) << "\n";
+        exit(1);
+    }
+}
+
+bool pStmt::step(void) {
+    if (owner_->trace()) {
+        std::cerr << "TRACE: " << sql_ << std::endl;
+    }
+    int rc = sqlite3_step(stmt_);
+    if (rc == SQLITE_ROW)
+        return true;
+    if (rc != SQLITE_DONE) {
+        std::cerr << "sqlite error: " << sql_ << "\n";
+        std::cerr << sqlite3_errmsg(sqlite3_db_handle(stmt_)) << "\n";
+        exit(1);
+    }
+    return false;
+}
+
+// sqlite's default limit on host parameters in one statement
+#define MAX_BATCH_PARAMS 999
+#define MAX_BATCH_ROWS   64
+
+pInsertBatch::pInsertBatch(const pDB *db, pStringRef table, int columns):
+    db_(db), columns_(columns)
+{
+
+    rowsPerInsert_ = MAX_BATCH_PARAMS / columns_;
+    if (rowsPerInsert_ > MAX_BATCH_ROWS)
+        rowsPerInsert_ = MAX_BATCH_ROWS;
+
+    std::stringstream row;
+    row << "(NULL";
+    for (int i = 0; i < columns_; ++i)
+        row << ",?";
+    row << ")";
+
+    std::stringstream sql;
+    sql << "INSERT INTO " << table.str() << " VALUES " << row.str();
+    singleSQL_ = sql.str();
+    for (int i = 1; i < rowsPerInsert_; ++i)
+        sql << "," << row.str();
+    multiSQL_ = sql.str();
+
+    singleName_ = "batch " + table.str();
+    multiName_ = singleName_ + " multi";
+
+}
+
+void pInsertBatch::insert(pStmt &stmt, std::size_t first, int rows) {
+
+    int param = 1;
+    for (std::size_t i = first; i < first + (rows * columns_); ++i, ++param) {
+        const value &v = values_[i];
+        if (v.type == SQLITE_INTEGER)
+            stmt.bind(param, v.i);
+        else if (v.type == SQLITE_TEXT)
+            stmt.bind(param, v.s);
+        else
+            stmt.bindNull(param);
+    }
+    stmt.execute();
+
+}
+
+void pInsertBatch::flush(void) {
+
+    std::size_t total = rows();
+    std::size_t done = 0;
+
+    if (total >= (std::size_t)rowsPerInsert_) {
+        pStmt &multi = db_->statement(multiName_.c_str(), multiSQL_.c_str());
+        for (; total - done >= (std::size_t)rowsPerInsert_; done += rowsPerInsert_)
+            insert(multi, done * columns_, rowsPerInsert_);
+    }
+
+    if (done < total) {
+        pStmt &single = db_->statement(singleName_.c_str(), singleSQL_.c_str());
+        for (; done < total; ++done)
+            insert(single, done * columns_, 1);
+    }
+
+    values_.clear();
+
+}
+
+pDB::~pDB(void) {
+    for (StmtMap::iterator i = stmts_.begin(); i != stmts_.end(); ++i)
+        delete i->second;
+}
+
+pStmt& pDB::statement(const char *name, const char *sql) const {
+
+    StmtMap::iterator i = stmts_.find(name);
+    if (i != stmts_.end())
+        return *i->second;
+
+    pStmt *result = prepare(sql);
+    stmts_[name] = result;
+    return *result;
+
+}
+
 void pDB::sql_execute(pStringRef query) const {
     char *errMsg;
     int rc = sqlite3_exec(db_, query.begin(), NULL, NULL, &errMsg);
@@ -105,7 +218,9 @@ std::string pDB::sql_select_single_string(pStringRef query) const {
 
     rc = sqlite3_step(stmt);
     if (rc == SQLITE_ROW) {
-        result = (char*)sqlite3_column_text(stmt, 0);
+        const char *val = (const char*)sqlite3_column_text(stmt, 0);
+        if (val)
+            result = val;
         if (trace_)
             std::cerr << "TRACE: found 1 row\n";
     }
@@ -174,35 +289,15 @@ std::string pDB::sql_string(pStringRef val, bool allowNull) {
     }
 }
 
-//template <typename LTYPE>
-void pDB::list_query(pStringRef query, RowList &result) const {
+pStmt* pDB::prepare(pStringRef sql) const {
     sqlite3_stmt *stmt;
-    if (trace_) {
-        std::cerr << "TRACE: " << query.str() << "\n";
-    }
-    int rc = sqlite3_prepare_v2(db_, query.str().c_str(), -1, &stmt, NULL);
+    int rc = sqlite3_prepare_v2(db_, sql.data(), sql.size(), &stmt, NULL);
     if (rc != SQLITE_OK) {
-        std::cerr << "sqlite error: " << query.str() << "\n";
+        std::cerr << "sqlite error: " << sql.str() << "\n";
         std::cerr << sqlite3_errmsg(db_) << "\n";
         exit(1);
     }
-    while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
-        //typename LTYPE::value_type f;
-        RowList::value_type f;
-        for (int i = 0; i < sqlite3_column_count(stmt); i++) {
-            pStringRef key = sqlite3_column_name(stmt, i);
-            pStringRef val;
-            char *cVal = (char*)sqlite3_column_text(stmt, i);
-            if (cVal)
-                val = cVal;
-            f.set(key, val);
-        }
-        result.push_back(f);
-    }
-    if (trace_) {
-        std::cerr << "TRACE: " << result.size() << " rows returned\n";
-    }
-    sqlite3_finalize(stmt);
+    return new pStmt(this, stmt, sql);
 }
 
 
@@ -15,6 +15,7 @@
 
 #include <sqlite3.h>
 #include <map>
+#include <string>
 #include <vector>
 
 #include <iostream>
@@ -24,6 +25,8 @@ namespace corvus {
 // these are for caching data retrieved from sqlite
 namespace db {
 
+class pStmt;
+
 // a simple wrapper for a row in the model db
 // which saves us from having to make structs for each row
 // here we can just access it by field name
@@ -58,6 +61,158 @@ public:
     void set(pStringRef key, pStringRef val) {
         fields_[key] = val;
     }
+    // all columns of the current row, by name
+    void read(const pStmt &row);
+};
+
+class pDB;
+
+// a prepared statement owned and cached by pDB, see pDB::statement().
+// parameters are numbered from 1 and columns from 0, as in sqlite.
+// bound strings aren't copied, they must stay alive until the statement
+// is reset
+class pStmt {
+public:
+    typedef sqlite3_int64 oid;
+
+private:
+    const pDB *owner_;
+    sqlite3_stmt *stmt_;
+    std::string sql_;
+
+    pStmt(const pStmt&);
+    pStmt& operator=(const pStmt&);
+
+    void check(int rc) const;
+
+public:
+
+    pStmt(const pDB *owner, sqlite3_stmt *stmt, pStringRef sql):
+        owner_(owner), stmt_(stmt), sql_(sql) { }
+    ~pStmt(void) {
+        sqlite3_finalize(stmt_);
+    }
+
+    const std::string& sql(void) const { return sql_; }
+
+    void bind(int i, int val) { check(sqlite3_bind_int(stmt_, i, val)); }
+    void bind(int i, oid val) { check(sqlite3_bind_int64(stmt_, i, val)); }
+    void bind(int i, pUInt val) { bind(i, (oid)val); }
+    void bind(int i, pStringRef val) {
+        // an empty text value is '' and not NULL
+        check(sqlite3_bind_text(stmt_, i, val.data() ? val.data() : "", val.size(), SQLITE_STATIC));
+    }
+    void bindNull(int i) { check(sqlite3_bind_null(stmt_, i)); }
+    // NULLID binds NULL, like pDB::oidOrNull
+    void bindOrNull(int i, oid val) {
+        if (val)
+            bind(i, val);
+        else
+            bindNull(i);
+    }
+    // an empty string binds NULL, like pDB::sql_string
+    void bindOrNull(int i, pStringRef val) {
+        if (!val.empty())
+            bind(i, val);
+        else
+            bindNull(i);
+    }
+
+    // true if there's a row to read. errors are fatal
+    bool step(void);
+    // when finished with the statement, to release its locks and bindings
+    void reset(void) {
+        sqlite3_reset(stmt_);
+        sqlite3_clear_bindings(stmt_);
+    }
+    // step a statement which returns no rows, then reset it
+    void execute(void) {
+        step();
+        reset();
+    }
+    // execute an INSERT, returning the new row id
+    oid insert(void) {
+        execute();
+        return sqlite3_last_insert_rowid(sqlite3_db_handle(stmt_));
+    }
+
+    int columnCount(void) const { return sqlite3_column_count(stmt_); }
+    const char *columnName(int col) const { return sqlite3_column_name(stmt_, col); }
+    bool isNull(int col) const { return sqlite3_column_type(stmt_, col) == SQLITE_NULL; }
+    int getInt(int col) const { return sqlite3_column_int(stmt_, col); }
+    oid getOID(int col) const { return sqlite3_column_int64(stmt_, col); }
+    // NULL is returned as an empty string
+    pStringRef getText(int col) const {
+        const char *val = (const char*)sqlite3_column_text(stmt_, col);
+        return val ? pStringRef(val, sqlite3_column_bytes(stmt_, col)) : pStringRef();
+    }
+
+};
+
+// collects rows for one table and inserts them many to a statement. the
+// first column is the row id, which is always NULL, and the rest are added
+// in order. as with pStmt, strings aren't copied, they must stay alive
+// until flush()
+class pInsertBatch {
+public:
+    typedef sqlite3_int64 oid;
+
+private:
+    struct value {
+        int type;
+        oid i;
+        pStringRef s;
+    };
+
+    const pDB *db_;
+    int columns_;
+    int rowsPerInsert_;
+    std::string singleName_;
+    std::string singleSQL_;
+    std::string multiName_;
+    std::string multiSQL_;
+    std::vector<value> values_;
+
+    pInsertBatch(const pInsertBatch&);
+    pInsertBatch& operator=(const pInsertBatch&);
+
+    void push(int type, oid i, pStringRef s) {
+        values_.push_back(value());
+        values_.back().type = type;
+        values_.back().i = i;
+        values_.back().s = s;
+    }
+    void insert(pStmt &stmt, std::size_t first, int rows);
+
+public:
+
+    // columns doesn't include the row id
+    pInsertBatch(const pDB *db, pStringRef table, int columns);
+
+    void add(int val) { push(SQLITE_INTEGER, val, pStringRef()); }
+    void add(oid val) { push(SQLITE_INTEGER, val, pStringRef()); }
+    void add(pUInt val) { push(SQLITE_INTEGER, (oid)val, pStringRef()); }
+    void add(pStringRef val) { push(SQLITE_TEXT, 0, val); }
+    void addNull(void) { push(SQLITE_NULL, 0, pStringRef()); }
+    void addOrNull(oid val) {
+        if (val)
+            add(val);
+        else
+            addNull();
+    }
+    void addOrNull(pStringRef val) {
+        if (!val.empty())
+            add(val);
+        else
+            addNull();
+    }
+
+    std::size_t rows(void) const { return values_.size() / columns_; }
+    bool empty(void) const { return values_.empty(); }
+
+    // insert all rows added so far, in the order they were added
+    void flush(void);
+
 };
 
 class pDB {
@@ -72,14 +227,26 @@ public:
 
 private:
 
+    typedef std::map<std::string, pStmt*> StmtMap;
+
     sqlite3 *db_;
     bool trace_;
+    mutable StmtMap stmts_;
+
+    pDB(const pDB&);
+    pDB& operator=(const pDB&);
 
 public:
 
     pDB(sqlite3 *db, bool trace=false): db_(db), trace_(trace) {
         sql_setup();
     }
+    ~pDB(void);
+
+    // the statement cached under name, which is prepared from sql the
+    // first time it's asked for. statements are per connection, and like the
+    // connection itself must only be used by one thread at a time
+    pStmt& statement(const char *name, const char *sql) const;
 
     void sql_execute(pStringRef query) const;
     oid sql_insert(pStringRef query) const;
@@ -98,8 +265,32 @@ public:
     std::string oidOrNull(oid val);
     std::string sql_string(pStringRef val, bool allowNull=true);
 
-    //template <typename LTYPE>
-    void list_query(pStringRef query, RowList &result) const;
+    // prepare a statement which isn't cached. the caller deletes it
+    pStmt* prepare(pStringRef sql) const;
+
+    // steps a bound statement to the end, then resets it. each row is
+    // read into a new LTYPE::value_type with its read(const pStmt&)
+    template <typename LTYPE>
+    void list_query(pStmt &stmt, LTYPE &result) const {
+        std::size_t start = result.size();
+        while (stmt.step()) {
+            result.push_back(typename LTYPE::value_type());
+            result.back().read(stmt);
+        }
+        stmt.reset();
+        if (trace_) {
+            std::cerr << "TRACE: " << (result.size() - start) << " rows returned\n";
+        }
+    }
+
+    template <typename LTYPE>
+    void list_query(pStringRef query, LTYPE &result) const {
+        pStmt *stmt = prepare(query);
+        list_query(*stmt, result);
+        delete stmt;
+    }
+
+    sqlite3* db(void) const { return db_; }
 
     void setTrace(bool trace) { trace_ = trace; }
     bool trace(void) const { return trace_; }
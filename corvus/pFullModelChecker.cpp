@@ -34,22 +34,34 @@ void pFullModelChecker::run() {
 
 void pFullModelChecker::declUse() {
 
+    if (modules_.empty()) {
+        declUse(pModel::NULLID);
+        return;
+    }
+    for (std::size_t i = 0; i < modules_.size(); ++i)
+        declUse(modules_[i]);
+
+}
+
+// NULLID is every module
+void pFullModelChecker::declUse(pModel::oid m_id) {
+
     std::stringstream diag;
 
     // diag any uses which had no decl
-    pModel::UndeclList undecl = model_->getUndeclaredUses();
+    pModel::UndeclList undecl = model_->getUndeclaredUses(m_id);
     for (int i = 0; i < undecl.size(); ++i) {
-        diag << "$" << undecl[i].get("name") << " used but not defined";
-        addDiagnostic(undecl[i].get("realpath"),
-                      undecl[i].getAsInt("start_line"),
-                      undecl[i].getAsInt("start_col"),
+        diag << "$" << undecl[i].name << " used but not defined";
+        addDiagnostic(undecl[i].realPath,
+                      undecl[i].range.startLine,
+                      undecl[i].range.startCol,
                       diag.str()
                     );
         diag.str("");
     }
 
     // diag any decls where the same symbol had more than one decl
-    pModel::MultipleDeclList redecl = model_->getMultipleDecls();
+    pModel::MultipleDeclList redecl = model_->getMultipleDecls(m_id);
     for (int i = 0; i < redecl.size(); ++i) {
         for (int j = 0; j < redecl[i].redecl_locs.size(); ++j) {
             if (j == 0)
@@ -66,12 +78,12 @@ void pFullModelChecker::declUse() {
     }
 
     // diag any decls which had no uses
-    pModel::UnusedList unused = model_->getUnusedDecls();
+    pModel::UnusedList unused = model_->getUnusedDecls(m_id);
     for (int i = 0; i < unused.size(); ++i) {
-        diag << "$" << unused[i].get("name") << " unused";
-        addDiagnostic(unused[i].get("realpath"),
-                      unused[i].getAsInt("start_line"),
-                      unused[i].getAsInt("start_col"),
+        diag << "$" << unused[i].name << " unused";
+        addDiagnostic(unused[i].realPath,
+                      unused[i].range.startLine,
+                      unused[i].range.startCol,
                       diag.str()
                     );
         diag.str("");
@@ -84,32 +96,32 @@ void pFullModelChecker::classRelations() {
     // make sure all classes are resolved (extends and implements)
     pModel::ClassList unresolved = model_->getUnresolvedClasses();
     for (int i = 0; i < unresolved.size(); ++i) {
-        std::string unresolved_extends = unresolved[i].get("unresolved_extends");
-        std::string unresolved_implements = unresolved[i].get("unresolved_implements");
+        std::string unresolved_extends = unresolved[i].unresolvedExtends;
+        std::string unresolved_implements = unresolved[i].unresolvedImplements;
         if (unresolved_extends.size()) {
             std::stringstream diag;
-            diag << "class " << unresolved[i].get("name") << " extends " << unresolved_extends << " which ";
+            diag << "class " << unresolved[i].name << " extends " << unresolved_extends << " which ";
             if (unresolved_extends.find(',') != std::string::npos)
                 diag << "are ";
             else
                 diag << "is ";
             diag << "unresolved";
-            addDiagnostic(unresolved[i].get("realpath"),
-                          unresolved[i].getAsInt("start_line"),
-                          unresolved[i].getAsInt("start_col"),
+            addDiagnostic(unresolved[i].realPath,
+                          unresolved[i].range.startLine,
+                          unresolved[i].range.startCol,
                           diag.str());
         }
         if (unresolved_implements.size()) {
             std::stringstream diag;
-            diag << "class " << unresolved[i].get("name") << " implements " << unresolved_implements << " which ";
+            diag << "class " << unresolved[i].name << " implements " << unresolved_implements << " which ";
             if (unresolved_implements.find(',') != std::string::npos)
                 diag << "are ";
             else
                 diag << "is ";
             diag << "unresolved";
-            addDiagnostic(unresolved[i].get("realpath"),
-                          unresolved[i].getAsInt("start_line"),
-                          unresolved[i].getAsInt("start_col"),
+            addDiagnostic(unresolved[i].realPath,
+                          unresolved[i].range.startLine,
+                          unresolved[i].range.startCol,
                           diag.str());
         }
     }
@@ -12,11 +12,13 @@
 #define COR_PFULLMODELCHECKER_H_
 
 #include "pTypes.h"
+#include "pModel.h"
+
+#include <vector>
 
 namespace corvus {
 
 class pSourceManager;
-class pModel;
 
 class pFullModelChecker {
 
@@ -24,17 +26,25 @@ private:
 
     pSourceManager* sourceMgr_;
     const pModel* model_;
+    // if not empty, the only modules whose decls are checked
+    std::vector<pModel::oid> modules_;
 
     void addDiagnostic(pStringRef realPath, int sl, int sc, pStringRef msg);
 
     void classRelations();
     void declUse();
+    void declUse(pModel::oid m_id);
 
 public:
 
     pFullModelChecker(pSourceManager *s, const pModel* m):
         sourceMgr_(s), model_(m) { }
 
+    // check the decls in m_id rather than the whole model. the class checks
+    // still go through all classes, diagnostics for modules the source
+    // manager doesn't have are dropped either way
+    void limitTo(pModel::oid m_id) { modules_.push_back(m_id); }
+
     void run();
 
 };
@@ -16,6 +16,9 @@
 #include <fstream>
 #include <string>
 #include <sstream>
+#include <algorithm>
+#include <cstddef>
+#include <string.h>
 #include <assert.h>
 
 namespace corvus { namespace lexer {
@@ -28,6 +31,14 @@ pLexer::pLexer(const pSourceFile* s):
 
 
 
+}
+
+pLexer::pLexer(pStringRef text):
+    source_(NULL),
+    sourceBegin_(text.begin()),
+    sourceEnd_(text.end())
+{
+
 }
 
 const pSourceCharIterator pLexer::sourceBegin(void) const {
@@ -38,100 +49,247 @@ const pSourceCharIterator pLexer::sourceEnd(void) const {
     return sourceEnd_;
 }
 
-void pLexer::dumpTokens(void) {
+namespace {
 
-    std::string tokID;
-    std::stringstream val;
-    std::string HEREDOC_ID;
+// the id of a heredoc, from its start token, i.e. <<<"EOT" and a newline
+std::string heredocID(pSourceCharIterator start, pSourceCharIterator end) {
 
-    rmatch match(sourceBegin_, sourceEnd_);
+    while (*start == '<' ||
+           *start == ' ' ||
+           *start == '\t' ||
+           *start == '\'' ||
+           *start == '"'
+           )
+        start++;
+    if (*(end-2) == '"' || *(end-2) == '\'')
+        return std::string(start, end-2); // cut end quote and newline
+    else
+        return std::string(start, end-1); // just cut newline
 
-    do {
+}
+
+// look for the line starting with the heredoc id, from the start of the
+// heredoc body. on success match.end is left at the id
+bool findHeredocEnd(const std::string& id, rmatch& match, pSourceCharIterator sourceEnd) {
 
-        corvus_nextLangToken(match);
-        if (match.id == 0) {
-            // end of input
+    // we need to reverse this once to check for the case of a heredoc
+    // with no body, only a newline
+    match.end--;
+    while (sourceEnd - match.end >= (std::ptrdiff_t)id.length()) {
+        if (std::equal(id.begin(), id.end(), match.end))
+            return true;
+        while ((match.end != sourceEnd) && (*match.end != '\n'))
+            match.end++;
+        if (match.end == sourceEnd)
             break;
-        }
-        else if (match.id == match.npos()) {
-            // if state is HTML, collect characters for INLINE HTML token
-            if (match.state == 0) {
-                while ((*match.end != '<') && (match.end != sourceEnd_)) {
-                    match.end++;
-                }
-                std::cout << match.str() << " " << getTokenDescription(T_INLINE_HTML) << std::endl;
-            }
-            // if state is HEREDOC, collect heredoc string, looking for heredoc id
-            else if (match.state == 3) {
-                // assert we have a heredoc ID
-                assert(HEREDOC_ID.length() && "no heredoc id");
-                match.end--; // we need to reverse this once to check for the
-                             // case of a heredoc with no body, only a newline
-                look_for_id:
-                if (sourceEnd_ - match.end < HEREDOC_ID.length()) {
-                    // the remaining source text is shorter than the heredocid length,
-                    // which means we're never going to match it
-                    std::cout << "dangling HEREDOC looking for: \"" << HEREDOC_ID << "\"" << std::endl;
-                    break;
-                }
-                pSourceCharIterator ms = match.end;
-                pSourceCharIterator me = match.end+HEREDOC_ID.length();
-                std::string maybeID(ms, me);
-                if (maybeID != HEREDOC_ID) {
-                    while ((*match.end != '\n') && (match.end != sourceEnd_)) {
-                        match.end++;
-                    }
-                    match.end++; // skip newline
-                    goto look_for_id;
-                }
-                // if we get here, we matched the heredoc id
-                std::cout << match.str() << " " << getTokenDescription(T_DQ_STRING) << std::endl;
-                match.start = ms;
-                match.end = me;
-                std::cout << match.str() << " " << getTokenDescription(T_HEREDOC_END) << std::endl;
-                match.state = 1;
-                HEREDOC_ID.clear();
+        match.end++; // skip newline
+    }
+    // the remaining source text is shorter than the heredoc id, which
+    // means we're never going to match it
+    return false;
+
+}
+
+// just past the first */ from p, or NULL
+pSourceCharIterator commentEnd(pSourceCharIterator p, pSourceCharIterator sourceEnd) {
+
+    while (p < sourceEnd) {
+        const void *star = memchr(p, '*', sourceEnd-p);
+        if (!star)
+            return NULL;
+        p = (pSourceCharIterator)star + 1;
+        if (p != sourceEnd && *p == '/')
+            return p + 1;
+    }
+    return NULL;
+
+}
+
+// whitespace and comments, which are common, and simple enough to be found
+// faster by hand than by the dfa. these match as the lexer's rules do. state
+// is the lexer's, where 1 is PHP and 2 is OBJPROP (which has whitespace but
+// no comments). false if the next token isn't one, including a comment
+// that isn't closed, which the dfa will lex as something else
+bool lexTrivia(rmatch& match, pSourceCharIterator sourceEnd) {
+
+    pSourceCharIterator p = match.end;
+    if (p == sourceEnd || (match.state != 1 && match.state != 2))
+        return false;
+
+    std::size_t id;
+    switch (*p) {
+        case ' ':
+        case '\t':
+        case '\r':
+        case '\n':
+            while (p != sourceEnd && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n'))
+                ++p;
+            id = T_WHITESPACE;
+            break;
+        case '#':
+        case '/':
+        {
+            if (match.state != 1)
+                return false;
+            if (*p == '/' && (p+1 == sourceEnd || (p[1] != '/' && p[1] != '*')))
+                return false;
+            if (*p == '#' || p[1] == '/') {
+                // to the end of the line, or of input
+                const void *nl = memchr(p, '\n', sourceEnd-p);
+                p = nl ? (pSourceCharIterator)nl : sourceEnd;
+                id = T_SINGLELINE_COMMENT;
+                break;
             }
-            else {
-                // unmatched character in PHP state
-                std::cout << "breaking on unmatched: " << match.str() << std::endl;
+            // to the first */ after the /*, or after the /** of a doc
+            // comment. as the longer match, a doc comment wins, so /**/
+            // only stands alone when there's no */ after it
+            pSourceCharIterator start = p;
+            if (start+2 != sourceEnd && start[2] == '*' &&
+                (p = commentEnd(start+3, sourceEnd))) {
+                id = T_DOC_COMMENT;
                 break;
             }
+            if (!(p = commentEnd(start+2, sourceEnd)))
+                return false;
+            id = T_MULTILINE_COMMENT;
+            break;
         }
-        else {
-            // matched
-            // skip plain newlines in html state
-            val.str("");
-            if (match.id == T_HEREDOC_START) {
-                // save the heredoc id so we can match the end
-                pSourceCharIterator ms = match.start;
-                while (*ms == '<' ||
-                       *ms == ' ' ||
-                       *ms == '\t' ||
-                       *ms == '\'' ||
-                       *ms == '"'
-                       )
-                    ms++;
-                if (*(match.end-2) == '"' || *(match.end-2) == '\'')
-                    HEREDOC_ID.assign(ms, match.end-2); // cut end quote and newline
-                else
-                    HEREDOC_ID.assign(ms, match.end-1); // just cut newline
-                std::cout << std::string(match.start, match.end-1) << " T_HEREDOC_START" << std::endl;
-                continue;
+        default:
+            return false;
+    }
+
+    match.start = match.end;
+    match.end = p;
+    match.id = id;
+    return true;
+
+}
+
+// the build's lexer, called directly so it may be inlined
+struct buildLexer {
+    void operator()(rmatch& match) const { corvus_nextLangToken(match); }
+};
+
+struct givenLexer {
+    langLexer next;
+    givenLexer(langLexer n): next(n) { }
+    void operator()(rmatch& match) const { next(match); }
+};
+
+}
+
+void pLexer::tokenize(pTokenStream& s) const {
+    lex(s, buildLexer());
+}
+
+void pLexer::tokenize(pTokenStream& s, langLexer next) const {
+    lex(s, givenLexer(next));
+}
+
+template <typename nextToken>
+void pLexer::lex(pTokenStream& s, const nextToken& next) const {
+
+    std::vector<pToken>& tokens = s.tokens_;
+    tokens.clear();
+    // most php runs to 4 or more bytes a token, whitespace included, so
+    // this is usually the only allocation, and there's none at all once
+    // the stream has held a file as big
+    tokens.reserve((sourceEnd_-sourceBegin_)/4 + 16);
+    s.base_ = sourceBegin_;
+
+    std::string HEREDOC_ID;
+    rmatch match(sourceBegin_, sourceEnd_);
+
+    do {
+
+        if (!lexTrivia(match, sourceEnd_))
+            next(match);
+
+        if (match.id != match.npos()) {
+            if (match.id == T_HEREDOC_START)
+                HEREDOC_ID = heredocID(match.start, match.end);
+            tokens.push_back(pToken(match.start-sourceBegin_, match.end-match.start, match.id));
+        }
+        // if state is HTML, collect characters for INLINE HTML token
+        else if (match.state == 0) {
+            // we go until a single < is found, or end of input
+            // this potentially breaks up inline htmls
+            // at tags that don't turn out to be php open tags,
+            // but that way we let the lexer handle the matching
+            // and limit the special handler code here
+            const void *lt = memchr(match.end, '<', sourceEnd_-match.end);
+            match.end = lt ? (pSourceCharIterator)lt : sourceEnd_;
+            tokens.push_back(pToken(match.start-sourceBegin_, match.end-match.start, T_INLINE_HTML));
+        }
+        // if state is HEREDOC, collect heredoc string, looking for heredoc id
+        else if (match.state == 3) {
+            // assert we have a heredoc ID
+            assert(HEREDOC_ID.length() && "no heredoc id");
+            if (!findHeredocEnd(HEREDOC_ID, match, sourceEnd_)) {
+                tokens.push_back(pToken(match.start-sourceBegin_, 0, pToken::DANGLING_HEREDOC));
+                return;
             }
-            if (match.id != T_WHITESPACE)
-                val << match.str();
-            if ((match.state == 0) && (val.str() == "\n"))
-                continue;
-            tokID = getTokenDescription(match.id);
-            if (tokID.size() == 0)
-                tokID = val.str();
-            std::cout << val.str() << " " << tokID << std::endl;
+            tokens.push_back(pToken(match.start-sourceBegin_, match.end-match.start, T_HEREDOC_STRING));
+            match.start = match.end;
+            match.end += HEREDOC_ID.length();
+            tokens.push_back(pToken(match.start-sourceBegin_, match.end-match.start, T_HEREDOC_END));
+            match.state = 1;
+            HEREDOC_ID.clear();
+        }
+        else {
+            // unmatched character in PHP state
+            tokens.push_back(pToken(match.start-sourceBegin_, match.end-match.start, pToken::UNMATCHED));
+            return;
         }
 
     }
     while (match.id != 0);
 
+}
+
+void pLexer::dumpTokens(void) {
+
+    std::string tokID;
+    std::stringstream val;
+    std::string HEREDOC_ID;
+
+    pTokenStream s;
+    tokenize(s);
+
+    for (std::size_t i = 0; i < s.size(); ++i) {
+
+        const pToken& t = s[i];
+        pSourceRef text = s.text(t);
+
+        switch (t.id) {
+            case 0:
+                // end of input
+                break;
+            case pToken::DANGLING_HEREDOC:
+                std::cout << "dangling HEREDOC looking for: \"" << HEREDOC_ID << "\"" << std::endl;
+                break;
+            case pToken::UNMATCHED:
+                std::cout << "breaking on unmatched: " << text.str() << std::endl;
+                break;
+            case T_HEREDOC_START:
+                HEREDOC_ID = heredocID(text.begin(), text.end());
+                std::cout << text.substr(0, text.size()-1).str() << " T_HEREDOC_START" << std::endl;
+                break;
+            case T_HEREDOC_STRING:
+                std::cout << text.str() << " " << getTokenDescription(T_DQ_STRING) << std::endl;
+                break;
+            default:
+                val.str("");
+                if (t.id != T_WHITESPACE)
+                    val << text.str();
+                tokID = getTokenDescription(t.id);
+                if (tokID.size() == 0)
+                    tokID = val.str();
+                std::cout << val.str() << " " << tokID << std::endl;
+                break;
+        }
+
+    }
 
 }
 
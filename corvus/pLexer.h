@@ -18,6 +18,8 @@
 #include "corvus_grammar.h"
 #include "corvus_lang_lexer.h"
 
+#include <vector>
+
 namespace corvus {
 
 class pSourceFile;
@@ -26,6 +28,32 @@ namespace lexer {
 
 typedef lexertl::recursive_match_results<pSourceCharIterator> rmatch;
 
+// a generated lexer, see corvus-lexer-gen. corvus_nextLangToken is the one
+// the build chose, either corvus_nextLangTokenTable or
+// corvus_nextLangTokenDirect
+typedef void (*langLexer)(rmatch&);
+
+// the tokens of a source file, in order, in one flat array. a stream may be
+// used again for another file, which keeps the array's memory, so each parse
+// worker holds on to one
+class pTokenStream {
+
+    friend class pLexer;
+
+    std::vector<pToken> tokens_;
+    pSourceCharIterator base_;
+
+public:
+
+    pTokenStream(void): tokens_(), base_(NULL) { }
+
+    std::size_t size(void) const { return tokens_.size(); }
+    const pToken& operator[](std::size_t i) const { return tokens_[i]; }
+
+    pSourceRef text(const pToken& t) const { return pSourceRef(base_+t.offset, t.length); }
+
+};
+
 class pLexer {
 
 private:
@@ -34,13 +62,25 @@ private:
     pSourceCharIterator sourceBegin_;
     pSourceCharIterator sourceEnd_;
 
+    template <typename nextToken>
+    void lex(pTokenStream& s, const nextToken& next) const;
+
 public:
 
     pLexer(const pSourceFile* s);
+    // source that isn't from a file
+    pLexer(pStringRef text);
 
     const pSourceCharIterator sourceBegin(void) const;
     const pSourceCharIterator sourceEnd(void) const;
 
+    // lex the whole source into s, replacing what it had. the last token is
+    // the end of input (id 0), unless lexing stopped short at one of
+    // pToken's error ids
+    void tokenize(pTokenStream& s) const;
+    // the same, with the given lexer, e.g. to compare them
+    void tokenize(pTokenStream& s, langLexer next) const;
+
     void dumpTokens(void);
     const char* getTokenDescription(const std::size_t t) const;
 
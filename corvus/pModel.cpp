@@ -10,10 +10,16 @@
 
 #include "pModel.h"
 #include "pClassGraph.h"
+#include "pSymbolIndex.h"
+#include "pBuiltins.h"
+
+#include "xxhash.h"
 
 #include <iostream>
 #include <sstream>
+#include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 #include <algorithm>
 #include <iterator>
 #include <llvm/ADT/SmallVector.h>
@@ -34,9 +40,180 @@ namespace {
 
 namespace corvus { 
 
+// the columns each model row type is read from, in order
+#define FUNCTION_COLUMNS "function.id, function.name, function.type, function.flags, " \
+             "function.visibility, function.minArity, function.maxArity, " \
+             "function.start_line, function.start_col, sourceModule.realPath"
+#define CLASS_COLUMNS "class.id, class.namespace_id, class.name, class.type, class.flags, " \
+             "class.extends_count, class.implements_count, class.extends, class.implements, " \
+             "class.unresolved_extends, class.unresolved_implements, " \
+             "class.start_line, class.start_col, sourceModule.realPath"
+#define CLASS_DECL_COLUMNS "class.id, class_decl.name, class.name, class_decl.type, " \
+             "class_decl.flags, class_decl.visibility, class_decl.defaultVal, " \
+             "class_decl.start_line, class_decl.start_col, sourceModule.realPath"
+#define CONSTANT_COLUMNS "constant.id, constant.name, constant.type, " \
+             "constant.start_line, constant.start_col, sourceModule.realPath"
+#define FUNCTION_VAR_COLUMNS "function_var.id, function_var.function_id, function_var.name, " \
+             "function_var.type, function_var.flags, function_var.datatype, " \
+             "function_var.blockDepth, function_var.branch, " \
+             "function_var.start_line, function_var.start_col, sourceModule.realPath"
+#define VAR_USE_COLUMNS "function_var_usenodecl.id, function_var_usenodecl.function_id, " \
+             "function_var_usenodecl.name, function_var_usenodecl.start_line, " \
+             "function_var_usenodecl.start_col, sourceModule.realPath"
+
+namespace model {
+
+void mFunction::read(const db::pStmt &row) {
+    id = row.getOID(0);
+    name = row.getText(1);
+    type = row.getInt(2);
+    flags = row.getInt(3);
+    visibility = row.getInt(4);
+    minArity = row.getInt(5);
+    maxArity = row.getInt(6);
+    range = pSourceRange(row.getInt(7), row.getInt(8));
+    realPath = row.getText(9);
+}
+
+void mClass::read(const db::pStmt &row) {
+    id = row.getOID(0);
+    namespaceID = row.getOID(1);
+    name = row.getText(2);
+    type = row.getInt(3);
+    flags = row.getInt(4);
+    extendsCount = row.getInt(5);
+    implementsCount = row.getInt(6);
+    extends = row.getText(7);
+    implements = row.getText(8);
+    unresolvedExtends = row.getText(9);
+    unresolvedImplements = row.getText(10);
+    range = pSourceRange(row.getInt(11), row.getInt(12));
+    realPath = row.getText(13);
+    // getUnresolvedClasses selects the resolved counts after the rest
+    if (row.columnCount() > 15) {
+        resolvedExtendsCount = row.getInt(14);
+        resolvedImplementsCount = row.getInt(15);
+    }
+}
+
+void mClassDecl::read(const db::pStmt &row) {
+    classID = row.getOID(0);
+    name = row.getText(1);
+    className = row.getText(2);
+    type = row.getInt(3);
+    flags = row.getInt(4);
+    visibility = row.getInt(5);
+    defaultVal = row.getText(6);
+    range = pSourceRange(row.getInt(7), row.getInt(8));
+    realPath = row.getText(9);
+}
+
+void mConstant::read(const db::pStmt &row) {
+    id = row.getOID(0);
+    name = row.getText(1);
+    type = row.getInt(2);
+    range = pSourceRange(row.getInt(3), row.getInt(4));
+    realPath = row.getText(5);
+}
+
+void mFunctionVar::read(const db::pStmt &row) {
+    id = row.getOID(0);
+    functionID = row.getOID(1);
+    name = row.getText(2);
+    type = row.getInt(3);
+    flags = row.getInt(4);
+    datatype = row.getInt(5);
+    blockDepth = row.getInt(6);
+    branch = row.getInt(7);
+    range = pSourceRange(row.getInt(8), row.getInt(9));
+    realPath = row.getText(10);
+}
+
+void mDiagnostic::read(const db::pStmt &row) {
+    range = pSourceRange(row.getInt(0), row.getInt(1), row.getInt(2), row.getInt(3));
+    msg = row.getText(4);
+}
+
+void mVarUse::read(const db::pStmt &row) {
+    id = row.getOID(0);
+    functionID = row.getOID(1);
+    name = row.getText(2);
+    range = pSourceRange(row.getInt(3), row.getInt(4));
+    realPath = row.getText(5);
+}
+
+} // end model namespace
+
+pModel::pModel(sqlite3 *db, bool trace, bool readOnly, const pModel *shareIndex):
+    db_(0), writer_(0), readOnly_(readOnly), fresh_(true), tracking_(false),
+    layerModules_(shareIndex ? shareIndex->layerModules_ : static_cast<oid>(NULLID)),
+    index_(0), ownIndex_(!shareIndex), batching_(false) {
+
+    db_ = new db::pDB(db, trace);
+    if (!readOnly_)
+        makeTables();
+    classDeclBatch_ = new db::pInsertBatch(db_, "class_decl", 8);
+    functionVarBatch_ = new db::pInsertBatch(db_, "function_var", 14);
+    varUseBatch_ = new db::pInsertBatch(db_, "function_var_usenodecl", 4);
+    constantBatch_ = new db::pInsertBatch(db_, "constant", 7);
+    dependencyBatch_ = new db::pInsertBatch(db_, "module_dep", 3);
+    symbolBatch_ = new db::pInsertBatch(db_, "module_symbol", 3);
+
+    if (shareIndex) {
+        index_ = shareIndex->index_;
+    }
+    else {
+        index_ = new pSymbolIndex();
+        loadIndex();
+    }
+
+}
+
+pModel::~pModel() {
+
+    if (ownIndex_)
+        delete index_;
+    delete classDeclBatch_;
+    delete functionVarBatch_;
+    delete varUseBatch_;
+    delete constantBatch_;
+    delete dependencyBatch_;
+    delete symbolBatch_;
+    delete db_;
+
+}
+
+// a model db from a different version of corvus is thrown away and rebuilt
+// rather than migrated. it's only a cache of the source after all
+void pModel::checkVersion() {
+
+    if (!db_->sql_select_single_id("SELECT COUNT(*) FROM sqlite_master WHERE type='table'"))
+        return;
+
+    std::string version;
+    if (db_->sql_select_single_id("SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name='corvus'"))
+        version = db_->sql_select_single_string("SELECT val FROM corvus WHERE key='version'");
+    if (version == CORVUS_DBMODEL_VERSION) {
+        fresh_ = false;
+        return;
+    }
+
+    RowList tables;
+    db_->list_query("SELECT name FROM sqlite_master WHERE type='table' AND name NOT LIKE 'sqlite_%'", tables);
+
+    // cascades would just be wasted work here
+    db_->sql_execute("PRAGMA foreign_keys = OFF");
+    for (RowList::iterator i = tables.begin(); i != tables.end(); ++i)
+        db_->sql_execute("DROP TABLE " + i->get("name"));
+    db_->sql_execute("PRAGMA foreign_keys = ON");
+
+}
+
 void pModel::makeTables() {
 
-    #define CORVUS_DBMODEL_VERSION "1.0"
+    // index names are global to the db, so they're prefixed with their table
+
+    checkVersion();
 
     db_->begin();
 
@@ -46,14 +223,23 @@ void pModel::makeTables() {
             ")";
     db_->sql_execute(META);
 
+    // tokens and nodes are from the last parse, for scheduling. size and
+    // mtime are from the file, so unchanged files needn't be hashed. the
+    // diag_ columns key the diagnostics cached in module_diag
     const char *SM = "CREATE TABLE IF NOT EXISTS sourceModule (" \
                          "id INTEGER PRIMARY KEY,"
                          "realpath TEXT UNIQUE NOT NULL," \
-                         "hash TEXT" \
+                         "hash TEXT," \
+                         "tokens INTEGER NOT NULL DEFAULT 0," \
+                         "nodes INTEGER NOT NULL DEFAULT 0," \
+                         "size INTEGER NOT NULL DEFAULT 0," \
+                         "mtime INTEGER NOT NULL DEFAULT 0," \
+                         "diag_hash TEXT," \
+                         "diag_fingerprint TEXT" \
                          ");";
     db_->sql_execute(SM);
 
-    const char *SM_I1 = "CREATE INDEX IF NOT EXISTS i1 ON sourceModule (realpath)";
+    const char *SM_I1 = "CREATE INDEX IF NOT EXISTS sourceModule_i1 ON sourceModule (realpath)";
     db_->sql_execute(SM_I1);
 
     // type:
@@ -72,9 +258,9 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(SD);
 
-    const char *SD_I1 = "CREATE INDEX IF NOT EXISTS i1 ON constant (sourceModule_id)";
+    const char *SD_I1 = "CREATE INDEX IF NOT EXISTS constant_i1 ON constant (sourceModule_id)";
     db_->sql_execute(SD_I1);
-    const char *SD_I2 = "CREATE INDEX IF NOT EXISTS i2 ON constant (type, name)";
+    const char *SD_I2 = "CREATE INDEX IF NOT EXISTS constant_i2 ON constant (type, name)";
     db_->sql_execute(SD_I2);
 
     const char *SU = "CREATE TABLE IF NOT EXISTS constant_use (" \
@@ -86,7 +272,7 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(SU);
 
-    const char *SU_I1 = "CREATE INDEX IF NOT EXISTS i1 ON constant_use (constant_id)";
+    const char *SU_I1 = "CREATE INDEX IF NOT EXISTS constant_use_i1 ON constant_use (constant_id)";
     db_->sql_execute(SU_I1);
 
     const char *NS = "CREATE TABLE IF NOT EXISTS namespace (" \
@@ -124,11 +310,11 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(CL);
 
-    const char *CL_I1 = "CREATE INDEX IF NOT EXISTS i1 ON class (sourceModule_id)";
+    const char *CL_I1 = "CREATE INDEX IF NOT EXISTS class_i1 ON class (sourceModule_id)";
     db_->sql_execute(CL_I1);
-    const char *CL_I2 = "CREATE INDEX IF NOT EXISTS i2 ON class (namespace_id)";
+    const char *CL_I2 = "CREATE INDEX IF NOT EXISTS class_i2 ON class (namespace_id)";
     db_->sql_execute(CL_I2);
-    const char *CL_I3 = "CREATE INDEX IF NOT EXISTS i3 ON class (name)";
+    const char *CL_I3 = "CREATE INDEX IF NOT EXISTS class_i3 ON class (name)";
     db_->sql_execute(CL_I3);
 
     // the relations go "lhs TYPE rhs"
@@ -145,9 +331,9 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(CR);
 
-    const char *CR_I1 = "CREATE INDEX IF NOT EXISTS i1 ON class_relations (lhs_class_id,type)";
+    const char *CR_I1 = "CREATE INDEX IF NOT EXISTS class_relations_i1 ON class_relations (lhs_class_id,type)";
     db_->sql_execute(CR_I1);
-    const char *CR_I2 = "CREATE INDEX IF NOT EXISTS i2 ON class_relations (rhs_class_id)";
+    const char *CR_I2 = "CREATE INDEX IF NOT EXISTS class_relations_i2 ON class_relations (rhs_class_id)";
     db_->sql_execute(CR_I2);
 
 
@@ -175,9 +361,9 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(CD);
 
-    const char *CD_I1 = "CREATE INDEX IF NOT EXISTS i1 ON class_decl (class_id)";
+    const char *CD_I1 = "CREATE INDEX IF NOT EXISTS class_decl_i1 ON class_decl (class_id)";
     db_->sql_execute(CD_I1);
-    const char *CD_I2 = "CREATE INDEX IF NOT EXISTS i2 ON class_decl (name)";
+    const char *CD_I2 = "CREATE INDEX IF NOT EXISTS class_decl_i2 ON class_decl (name)";
     db_->sql_execute(CD_I2);
 
     const char *CU = "CREATE TABLE IF NOT EXISTS class_decl_use (" \
@@ -194,9 +380,9 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(CU);
 
-    const char *CU_I1 = "CREATE INDEX IF NOT EXISTS i1 ON class_decl_use (class_id)";
+    const char *CU_I1 = "CREATE INDEX IF NOT EXISTS class_decl_use_i1 ON class_decl_use (class_id)";
     db_->sql_execute(CU_I1);
-    const char *CU_I2 = "CREATE INDEX IF NOT EXISTS i2 ON class_decl_use (class_decl_id)";
+    const char *CU_I2 = "CREATE INDEX IF NOT EXISTS class_decl_use_i2 ON class_decl_use (class_decl_id)";
     db_->sql_execute(CU_I2);
 
     // class model version: considering the class heirarchy
@@ -211,9 +397,9 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(CMD);
 
-    const char *CMD_I1 = "CREATE INDEX IF NOT EXISTS i1 ON class_model_decl (class_id)";
+    const char *CMD_I1 = "CREATE INDEX IF NOT EXISTS class_model_decl_i1 ON class_model_decl (class_id)";
     db_->sql_execute(CMD_I1);
-    const char *CMD_I2 = "CREATE INDEX IF NOT EXISTS i2 ON class_model_decl (class_decl_id)";
+    const char *CMD_I2 = "CREATE INDEX IF NOT EXISTS class_model_decl_i2 ON class_model_decl (class_decl_id)";
     db_->sql_execute(CMD_I2);
 
     // type:
@@ -248,13 +434,13 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(FN);
 
-    const char *FN_I1 = "CREATE INDEX IF NOT EXISTS i1 ON function (namespace_id)";
+    const char *FN_I1 = "CREATE INDEX IF NOT EXISTS function_i1 ON function (namespace_id)";
     db_->sql_execute(FN_I1);
-    const char *FN_I2 = "CREATE INDEX IF NOT EXISTS i2 ON function (class_id)";
+    const char *FN_I2 = "CREATE INDEX IF NOT EXISTS function_i2 ON function (class_id)";
     db_->sql_execute(FN_I2);
-    const char *FN_I3 = "CREATE INDEX IF NOT EXISTS i3 ON function (sourceModule_id)";
+    const char *FN_I3 = "CREATE INDEX IF NOT EXISTS function_i3 ON function (sourceModule_id)";
     db_->sql_execute(FN_I3);
-    const char *FN_I4 = "CREATE INDEX IF NOT EXISTS i4 ON function (name)";
+    const char *FN_I4 = "CREATE INDEX IF NOT EXISTS function_i4 ON function (name)";
     db_->sql_execute(FN_I4);
 
     // class model version: considering the class heirarchy
@@ -269,9 +455,9 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(CMF);
 
-    const char *CMF_I1 = "CREATE INDEX IF NOT EXISTS i1 ON class_model_function (class_id)";
+    const char *CMF_I1 = "CREATE INDEX IF NOT EXISTS class_model_function_i1 ON class_model_function (class_id)";
     db_->sql_execute(CMF_I1);
-    const char *CMF_I2 = "CREATE INDEX IF NOT EXISTS i1 ON class_model_function (class_function_id)";
+    const char *CMF_I2 = "CREATE INDEX IF NOT EXISTS class_model_function_i2 ON class_model_function (class_function_id)";
     db_->sql_execute(CMF_I2);
 
     // type:
@@ -306,16 +492,21 @@ void pModel::makeTables() {
                          // the first declaration)
                          "is_redecl INTEGER NOT NULL," \
                          "use_count INTEGER NOT NULL," \
+                         // set if this decl is one of several of the same
+                         // symbol, see getMultipleDecls
+                         "multi_decl INTEGER NOT NULL," \
                          "start_line INTEGER NOT NULL," \
                          "start_col INTEGER NOT NULL," \
                          "FOREIGN KEY(function_id) REFERENCES function(id) ON DELETE CASCADE"
                          ")";
     db_->sql_execute(FV);
 
-    const char *FV_I1 = "CREATE INDEX IF NOT EXISTS i1 on function_var (function_id,name,start_line)";
+    const char *FV_I1 = "CREATE INDEX IF NOT EXISTS function_var_i1 on function_var (function_id,name,start_line)";
     db_->sql_execute(FV_I1);
-    const char *FV_I2 = "CREATE INDEX IF NOT EXISTS i2 on function_var (is_redecl)";
+    const char *FV_I2 = "CREATE INDEX IF NOT EXISTS function_var_i2 on function_var (is_redecl)";
     db_->sql_execute(FV_I2);
+    const char *FV_I3 = "CREATE INDEX IF NOT EXISTS function_var_i3 on function_var (multi_decl)";
+    db_->sql_execute(FV_I3);
 
     const char *FVU = "CREATE TABLE IF NOT EXISTS function_var_usenodecl (" \
                          "id INTEGER PRIMARY KEY,"
@@ -327,7 +518,7 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(FVU);
 
-    const char *FVU_I1 = "CREATE INDEX IF NOT EXISTS i1 on function_var_usenodecl (function_id)";
+    const char *FVU_I1 = "CREATE INDEX IF NOT EXISTS function_var_usenodecl_i1 on function_var_usenodecl (function_id)";
     db_->sql_execute(FVU_I1);
 
     const char *FU = "CREATE TABLE IF NOT EXISTS function_use (" \
@@ -342,20 +533,140 @@ void pModel::makeTables() {
                          ")";
     db_->sql_execute(FU);
 
-    const char *FU_I1 = "CREATE INDEX IF NOT EXISTS i1 on function_use (function_id)";
+    const char *FU_I1 = "CREATE INDEX IF NOT EXISTS function_use_i1 on function_use (function_id)";
     db_->sql_execute(FU_I1);
 
+    // the symbols each module refers to, so that when a module changes we
+    // can find the ones depending on it. type is a DEP_* and name is from
+    // dependencyName()
+    const char *MD = "CREATE TABLE IF NOT EXISTS module_dep (" \
+                         "id INTEGER PRIMARY KEY," \
+                         "sourceModule_id INTEGER NOT NULL," \
+                         "type INTEGER NOT NULL," \
+                         "name TEXT NOT NULL," \
+                         "FOREIGN KEY(sourceModule_id) REFERENCES sourceModule(id) ON DELETE CASCADE" \
+                         ")";
+    db_->sql_execute(MD);
+
+    const char *MD_I1 = "CREATE INDEX IF NOT EXISTS module_dep_i1 on module_dep (type, name)";
+    db_->sql_execute(MD_I1);
+    const char *MD_I2 = "CREATE INDEX IF NOT EXISTS module_dep_i2 on module_dep (sourceModule_id)";
+    db_->sql_execute(MD_I2);
+
+    // the other side of module_dep: the classes, functions (not methods, they
+    // are reached through their class) and constants each module defines
+    const char *MS = "CREATE TABLE IF NOT EXISTS module_symbol (" \
+                         "id INTEGER PRIMARY KEY," \
+                         "sourceModule_id INTEGER NOT NULL," \
+                         "type INTEGER NOT NULL," \
+                         "name TEXT NOT NULL," \
+                         "FOREIGN KEY(sourceModule_id) REFERENCES sourceModule(id) ON DELETE CASCADE" \
+                         ")";
+    db_->sql_execute(MS);
+
+    const char *MS_I1 = "CREATE INDEX IF NOT EXISTS module_symbol_i1 on module_symbol (type, name)";
+    db_->sql_execute(MS_I1);
+    const char *MS_I2 = "CREATE INDEX IF NOT EXISTS module_symbol_i2 on module_symbol (sourceModule_id)";
+    db_->sql_execute(MS_I2);
+
+    // the diagnostics from the module passes, as they were when the module
+    // had diag_hash and the modules it depends on had diag_fingerprint.
+    // see getCachedDiagnostics
+    const char *MDG = "CREATE TABLE IF NOT EXISTS module_diag (" \
+                         "id INTEGER PRIMARY KEY," \
+                         "sourceModule_id INTEGER NOT NULL," \
+                         "start_line INTEGER NOT NULL," \
+                         "start_col INTEGER NOT NULL," \
+                         "end_line INTEGER NOT NULL," \
+                         "end_col INTEGER NOT NULL," \
+                         "msg TEXT NOT NULL," \
+                         "FOREIGN KEY(sourceModule_id) REFERENCES sourceModule(id) ON DELETE CASCADE" \
+                         ")";
+    db_->sql_execute(MDG);
+
+    const char *MDG_I1 = "CREATE INDEX IF NOT EXISTS module_diag_i1 on module_diag (sourceModule_id)";
+    db_->sql_execute(MDG_I1);
+
+    db_->sql_execute("INSERT OR REPLACE INTO corvus VALUES ('version', '" CORVUS_DBMODEL_VERSION "')");
+
     db_->commit();
 
 }
 
-bool pModel::sourceModuleDirty(pStringRef realPath, pStringRef hash) const {
+// the whole model is read into the index when it's opened, from then on
+// it's kept up to date by the define methods
+void pModel::loadIndex() {
+
+    db::pStmt& modules = db_->statement("indexModules",
+            "SELECT id, realpath FROM sourceModule");
+    while (modules.step())
+        index_->addModule(modules.getOID(0), modules.getText(1));
+    modules.reset();
+
+    db::pStmt& functions = db_->statement("indexFunctions",
+            "SELECT " FUNCTION_COLUMNS ", function.namespace_id, function.class_id, "
+            " function.sourceModule_id FROM function, sourceModule WHERE"
+            " sourceModule.id=sourceModule_id ORDER BY function.id");
+    model::mFunction f;
+    while (functions.step()) {
+        f.read(functions);
+        index_->addFunction(functions.getOID(10), functions.getOID(11), functions.getOID(12), f);
+    }
+    functions.reset();
+
+    db::pStmt& classes = db_->statement("indexClasses",
+            "SELECT " CLASS_COLUMNS ", class.sourceModule_id FROM class, sourceModule WHERE"
+            " sourceModule.id=sourceModule_id ORDER BY class.id");
+    model::mClass c;
+    while (classes.step()) {
+        c.read(classes);
+        index_->addClass(classes.getOID(14), c);
+    }
+    classes.reset();
+
+    db::pStmt& constants = db_->statement("indexConstants",
+            "SELECT " CONSTANT_COLUMNS ", constant.namespace_id, constant.sourceModule_id"
+            " FROM constant, sourceModule WHERE"
+            " sourceModule.id=sourceModule_id ORDER BY constant.id");
+    model::mConstant cn;
+    while (constants.step()) {
+        cn.read(constants);
+        index_->addConstant(constants.getOID(6), constants.getOID(7), cn);
+    }
+    constants.reset();
+
+    loadClassDeclIndex();
+
+}
+
+// the class decls are from the class model, which is rebuilt as a whole
+void pModel::loadClassDeclIndex() {
+
+    index_->clearClassDecls();
 
-    std::stringstream sql;
+    db::pStmt& decls = db_->statement("indexClassDecls",
+            "SELECT " CLASS_DECL_COLUMNS ", class_model_decl.class_id FROM"
+            " class_model_decl, class_decl, class, sourceModule WHERE sourceModule.id=sourceModule_id AND"
+            " class.id=class_decl.class_id AND class_decl.id=class_model_decl.class_decl_id"
+            " ORDER BY class_model_decl.id");
+    model::mClassDecl d;
+    while (decls.step()) {
+        d.read(decls);
+        index_->addClassDecl(decls.getOID(10), d);
+    }
+    decls.reset();
 
-    sql << "SELECT hash FROM sourceModule WHERE realPath='" << realPath.str() << "'";
+}
 
-    std::string existing_hash = db_->sql_select_single_string(sql.str());
+bool pModel::sourceModuleDirty(pStringRef realPath, pStringRef hash) const {
+
+    db::pStmt& select = db_->statement("sourceModuleHash",
+                                       "SELECT hash FROM sourceModule WHERE realpath=?");
+    select.bind(1, realPath);
+    std::string existing_hash;
+    if (select.step())
+        existing_hash = select.getText(0);
+    select.reset();
 
     if (existing_hash.size()) {
         // not in our local cache but it's in the db model
@@ -371,81 +682,392 @@ bool pModel::sourceModuleDirty(pStringRef realPath, pStringRef hash) const {
 
 pModel::oid pModel::getSourceModuleOID(pStringRef realPath, pStringRef hash, bool deleteFirst) {
 
+    pScopedLock lock(cacheLock_);
+
     if (modules_.find(realPath) != modules_.end()) {
         return modules_[realPath];
     }    
 
-    std::stringstream sql;
-
     if (!deleteFirst) {
-        sql << "SELECT oid FROM sourceModule WHERE realPath='" << realPath.str() << "'";
-
-        pModel::oid existing = db_->sql_select_single_id(sql.str());
+        db::pStmt& select = db_->statement("sourceModuleID",
+                                           "SELECT id FROM sourceModule WHERE realpath=?");
+        select.bind(1, realPath);
+        pModel::oid existing = select.step() ? select.getOID(0) : static_cast<pModel::oid>(pModel::NULLID);
+        select.reset();
         if (existing != pModel::NULLID) {
             modules_[realPath] = existing;
             return existing;
         }
+        if (readOnly_)
+            return pModel::NULLID;
     }
     else {
-        sql << "DELETE FROM sourceModule WHERE realPath='" << realPath.str() << "'";
-        db_->sql_execute(sql.str());
+        db::pStmt& select = db_->statement("sourceModuleID",
+                                           "SELECT id FROM sourceModule WHERE realpath=?");
+        select.bind(1, realPath);
+        if (select.step())
+            index_->removeModule(select.getOID(0));
+        select.reset();
+        db::pStmt& del = db_->statement("deleteSourceModule",
+                                        "DELETE FROM sourceModule WHERE realpath=?");
+        del.bind(1, realPath);
+        del.execute();
     }
-    sql.str("");
 
-    sql << "INSERT INTO sourceModule VALUES (NULL, '" << realPath.str() << "', '" << hash.str() << "')";
-    oid result = db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertSourceModule",
+                                       "INSERT INTO sourceModule (id, realpath, hash) VALUES (NULL, ?, ?)");
+    insert.bind(1, realPath);
+    insert.bind(2, hash);
+    oid result = insert.insert();
     modules_[realPath] = result;
+    index_->addModule(result, realPath);
+    return result;
+
+}
+
+void pModel::setSourceModuleCost(oid m_id, pUInt tokens, pUInt nodes) {
+
+    db::pStmt& update = db_->statement("sourceModuleCost",
+                                       "UPDATE sourceModule SET tokens=?, nodes=? WHERE id=?");
+    update.bind(1, tokens);
+    update.bind(2, nodes);
+    update.bind(3, m_id);
+    update.execute();
+
+}
+
+// a file modified within the same second as we look at it may change again
+// without its mtime changing, so we don't record one that recent. the
+// module will be hashed next time instead
+void pModel::setSourceModuleStat(oid m_id, pUInt size, pUInt mtime) {
+
+    if (mtime + 1 >= (pUInt)time(NULL))
+        mtime = 0;
+
+    db::pStmt& update = db_->statement("sourceModuleStat",
+                                       "UPDATE sourceModule SET size=?, mtime=? WHERE id=?");
+    update.bind(1, size);
+    update.bind(2, mtime);
+    update.bind(3, m_id);
+    update.execute();
+
+}
+
+void pModel::setSourceModuleHash(pStringRef realPath, pStringRef hash) {
+
+    db::pStmt& update = db_->statement("sourceModuleHashUpdate",
+            "UPDATE sourceModule SET hash=?1, mtime=CASE WHEN ?1 IS NULL THEN 0 ELSE mtime END "
+            "WHERE realpath=?2");
+    update.bindOrNull(1, hash);
+    update.bind(2, realPath);
+    update.execute();
+
+}
+
+std::string pModel::getMeta(pStringRef key) const {
+
+    db::pStmt& select = db_->statement("getMeta", "SELECT val FROM corvus WHERE key=?");
+    select.bind(1, key);
+    std::string result;
+    if (select.step())
+        result = select.getText(0);
+    select.reset();
+    return result;
+
+}
+
+void pModel::setMeta(pStringRef key, pStringRef val) {
+
+    db::pStmt& insert = db_->statement("setMeta", "INSERT OR REPLACE INTO corvus VALUES (?, ?)");
+    insert.bind(1, key);
+    insert.bind(2, val);
+    insert.execute();
+
+}
+
+// the changes are recorded by temp triggers, which only this connection
+// sees, as (table, rowid) in a temp table. cascaded deletes fire them too
+bool pModel::trackChanges(void) {
+
+    if (readOnly_ || fresh_)
+        return false;
+    if (tracking_)
+        return true;
+
+    RowList tables;
+    db_->list_query("SELECT name FROM sqlite_master WHERE type='table' AND name NOT LIKE 'sqlite_%'", tables);
+
+    db_->begin();
+    db_->sql_execute("CREATE TEMP TABLE model_change (" \
+                     "tbl TEXT NOT NULL," \
+                     "row INTEGER NOT NULL," \
+                     "PRIMARY KEY (tbl, row)" \
+                     ")");
+    for (RowList::iterator i = tables.begin(); i != tables.end(); ++i) {
+        const std::string t = i->get("name");
+        const std::string record = " BEGIN INSERT OR IGNORE INTO model_change VALUES ('" + t + "', ";
+        db_->sql_execute("CREATE TEMP TRIGGER model_change_" + t + "_i AFTER INSERT ON main." + t +
+                         record + "NEW.rowid); END");
+        db_->sql_execute("CREATE TEMP TRIGGER model_change_" + t + "_u AFTER UPDATE ON main." + t +
+                         record + "NEW.rowid); END");
+        db_->sql_execute("CREATE TEMP TRIGGER model_change_" + t + "_d AFTER DELETE ON main." + t +
+                         record + "OLD.rowid); END");
+    }
+    db_->commit();
+
+    tracking_ = true;
+    return true;
+
+}
+
+std::size_t pModel::changeCount(void) const {
+
+    if (!tracking_)
+        return 0;
+    return db_->sql_select_single_id("SELECT COUNT(*) FROM model_change");
+
+}
+
+// the file has the same schema and rowids as the model had when it was
+// loaded, so each changed row is deleted there and copied over again if
+// it's still here. cascades already happened here, so they're turned off.
+// errors aren't fatal, the caller can still save the whole model
+bool pModel::saveChanges(pStringRef path) {
+
+    if (!tracking_)
+        return false;
+    sqlite3 *db = db_->db();
+
+    char *attach = sqlite3_mprintf("ATTACH DATABASE %Q AS saved", path.str().c_str());
+    int rc = sqlite3_exec(db, attach, NULL, NULL, NULL);
+    sqlite3_free(attach);
+    if (rc != SQLITE_OK)
+        return false;
+
+    RowList tables;
+    db_->list_query("SELECT DISTINCT tbl FROM model_change", tables);
+
+    sqlite3_exec(db, "PRAGMA foreign_keys = OFF", NULL, NULL, NULL);
+    rc = sqlite3_exec(db, "BEGIN", NULL, NULL, NULL);
+    for (RowList::iterator i = tables.begin(); rc == SQLITE_OK && i != tables.end(); ++i) {
+        const std::string t = i->get("tbl");
+        const std::string rows = " WHERE rowid IN (SELECT row FROM model_change WHERE tbl='" + t + "')";
+        rc = sqlite3_exec(db, ("DELETE FROM saved." + t + rows).c_str(), NULL, NULL, NULL);
+        if (rc == SQLITE_OK)
+            rc = sqlite3_exec(db, ("INSERT OR REPLACE INTO saved." + t +
+                                   " SELECT * FROM main." + t + rows).c_str(), NULL, NULL, NULL);
+    }
+    if (rc == SQLITE_OK)
+        rc = sqlite3_exec(db, "COMMIT", NULL, NULL, NULL);
+    if (rc != SQLITE_OK)
+        sqlite3_exec(db, "ROLLBACK", NULL, NULL, NULL);
+    sqlite3_exec(db, "PRAGMA foreign_keys = ON", NULL, NULL, NULL);
+    sqlite3_exec(db, "DETACH DATABASE saved", NULL, NULL, NULL);
+
+    if (rc != SQLITE_OK)
+        return false;
+    db_->sql_execute("DELETE FROM model_change");
+    return true;
+
+}
+
+// the layer stays attached, so dropLayer can find its rows again. it's
+// stamped with a hash of its modules as they were built, which the model
+// keeps to know whether it was built on the same one
+bool pModel::attachLayer(pStringRef path) {
+
+    if (readOnly_ || layered())
+        return false;
+
+    char *attach = sqlite3_mprintf("ATTACH DATABASE %Q AS layer", path.str().c_str());
+    int rc = sqlite3_exec(db_->db(), attach, NULL, NULL, NULL);
+    sqlite3_free(attach);
+    if (rc != SQLITE_OK)
+        return false;
+
+    oid last = NULLID;
+    if (db_->sql_select_single_id("SELECT COUNT(*) FROM layer.sqlite_master WHERE type='table' AND name='corvus'") &&
+        db_->sql_select_single_string("SELECT val FROM layer.corvus WHERE key='version'") == CORVUS_DBMODEL_VERSION)
+        last = db_->sql_select_single_id("SELECT MAX(id) FROM layer.sourceModule");
+    if (last == NULLID) {
+        db_->sql_execute("DETACH DATABASE layer");
+        return false;
+    }
+
+    std::string all;
+    db::pStmt *modules = db_->prepare("SELECT realpath, hash FROM layer.sourceModule ORDER BY id");
+    while (modules->step()) {
+        all.append(modules->getText(0).str());
+        all.push_back('\t');
+        all.append(modules->getText(1).str());
+        all.push_back('\n');
+    }
+    delete modules;
+    char stamp[17];
+    snprintf(stamp, sizeof(stamp), "%016llx",
+             (unsigned long long)xxh64(all.data(), all.size(), 0));
+
+    RowList tables;
+    db_->list_query("SELECT name FROM layer.sqlite_master WHERE type='table'"
+                    " AND name NOT LIKE 'sqlite_%' AND name != 'corvus'", tables);
+
+    // the rows are copied as they are, there's nothing to cascade
+    db_->sql_execute("PRAGMA foreign_keys = OFF");
+    db_->begin();
+    if (getMeta("layer") != stamp) {
+        for (RowList::iterator i = tables.begin(); i != tables.end(); ++i)
+            db_->sql_execute("DELETE FROM main." + i->get("name"));
+        setMeta("layer", stamp);
+        fresh_ = true;
+        pScopedLock lock(cacheLock_);
+        modules_.clear();
+        namespaces_.clear();
+        namespaceNames_.clear();
+    }
+    // a model used in place keeps the layer's rows from the last run
+    std::stringstream present;
+    present << "SELECT COUNT(*) FROM main.sourceModule WHERE id=" << last;
+    if (!db_->sql_select_single_id(present.str())) {
+        for (RowList::iterator i = tables.begin(); i != tables.end(); ++i)
+            db_->sql_execute("INSERT INTO main." + i->get("name") + " SELECT * FROM layer." + i->get("name"));
+    }
+    db_->commit();
+    db_->sql_execute("PRAGMA foreign_keys = ON");
+
+    layerModules_ = last;
+    if (ownIndex_) {
+        delete index_;
+        index_ = new pSymbolIndex();
+        loadIndex();
+    }
+    return true;
+
+}
+
+void pModel::dropLayer(void) {
+
+    if (!layered())
+        return;
+
+    RowList tables;
+    db_->list_query("SELECT name FROM layer.sqlite_master WHERE type='table'"
+                    " AND name NOT LIKE 'sqlite_%' AND name != 'corvus'", tables);
+
+    db_->sql_execute("PRAGMA foreign_keys = OFF");
+    db_->begin();
+    for (RowList::iterator i = tables.begin(); i != tables.end(); ++i)
+        db_->sql_execute("DELETE FROM main." + i->get("name") +
+                         " WHERE rowid IN (SELECT rowid FROM layer." + i->get("name") + ")");
+    db_->commit();
+    db_->sql_execute("PRAGMA foreign_keys = ON");
+    // so the pages they took aren't saved along with the model
+    db_->sql_execute("VACUUM main");
+
+}
+
+void pModel::getSourceModules(SourceModuleMap& modules) const {
+
+    db::pStmt& query = db_->statement("sourceModules",
+            "SELECT realpath, hash, size, mtime, tokens+nodes, id FROM sourceModule");
+    while (query.step()) {
+        model::mSourceModule& m = modules[query.getText(0)];
+        m.hash = query.getText(1);
+        m.size = query.getOID(2);
+        m.mtime = query.getOID(3);
+        m.cost = query.getOID(4);
+        m.layer = (query.getOID(5) <= layerModules_);
+    }
+    query.reset();
+
+}
+
+void pModel::getModuleSymbols(pStringRef realPath, SymbolSet& symbols) const {
+
+    db::pStmt& query = db_->statement("moduleSymbols",
+            "SELECT type, name FROM module_symbol, sourceModule WHERE"
+            " sourceModule.id=sourceModule_id AND realpath=?");
+    query.bind(1, realPath);
+    while (query.step())
+        symbols.insert(std::make_pair(query.getInt(0), query.getText(1)));
+    query.reset();
+
+}
+
+std::string pModel::dependencyName(int type, pStringRef name) {
+
+    std::size_t sep = name.rfind('\\');
+    if (sep != pStringRef::npos)
+        name = name.substr(sep + 1);
+    if (type == DEP_CONSTANT)
+        return name.str();
+    return pSymbolIndex::lower(name);
+
+}
+
+pModel::oid pModel::lookupSourceModule(pStringRef realPath) const {
+
+    db::pStmt& select = db_->statement("sourceModuleID",
+                                       "SELECT id FROM sourceModule WHERE realpath=?");
+    select.bind(1, realPath);
+    oid result = select.step() ? select.getOID(0) : static_cast<oid>(pModel::NULLID);
+    select.reset();
     return result;
 
 }
 
 pModel::oid pModel::getNamespaceOID(pStringRef ns, bool create) const {
 
+    pScopedLock lock(cacheLock_);
+
     if (namespaces_.find(ns) != namespaces_.end()) {
         return namespaces_[ns];
     }
 
-    std::stringstream sql;
-
-    sql << "SELECT oid FROM namespace WHERE namespace='" << ns.str() << "'";
-
-    pModel::oid existing = db_->sql_select_single_id(sql.str());
+    db::pStmt& select = db_->statement("namespaceID",
+                                       "SELECT id FROM namespace WHERE namespace=?");
+    select.bind(1, ns);
+    pModel::oid existing = select.step() ? select.getOID(0) : static_cast<pModel::oid>(pModel::NULLID);
+    select.reset();
     if (existing != pModel::NULLID) {
         namespaces_[ns] = existing;
+        namespaceNames_[existing] = ns;
         return existing;
     }
 
-    if (!create)
+    if (!create || readOnly_)
         return pModel::NULLID;
 
-    sql.str("");
-
-    sql << "INSERT INTO namespace VALUES (NULL, '" << ns.str() << "')";
-    oid result = db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertNamespace",
+                                       "INSERT INTO namespace VALUES (NULL, ?)");
+    insert.bind(1, ns);
+    oid result = insert.insert();
     namespaces_[ns] = result;
+    namespaceNames_[result] = ns;
     return result;
 
 }
 
 std::string pModel::getNamespaceName(pModel::oid ns_id) const {
 
-    // linear search the cache first
-    for (IDMap::const_iterator i = namespaces_.begin();
-         i != namespaces_.end();
-         ++i) {
-        if (i->second == ns_id)
-            return i->first;
-    }
+    pScopedLock lock(cacheLock_);
 
-    // try sql if we haven't found it
-    std::stringstream sql;
+    std::map<oid, std::string>::const_iterator i = namespaceNames_.find(ns_id);
+    if (i != namespaceNames_.end())
+        return i->second;
 
-    sql << "SELECT namespace FROM namespace WHERE id=" << ns_id;
-    std::string result = db_->sql_select_single_string(sql.str().c_str());
+    // try sql if we haven't found it
+    db::pStmt& select = db_->statement("namespaceName",
+                                       "SELECT namespace FROM namespace WHERE id=?");
+    select.bind(1, ns_id);
+    std::string result;
+    if (select.step())
+        result = select.getText(0);
+    select.reset();
 
     if (!result.empty()) {
         // cache it while we here
         namespaces_[result] = ns_id;
+        namespaceNames_[ns_id] = result;
     }
 
     return result;
@@ -459,21 +1081,42 @@ pModel::oid pModel::defineClass(pModel::oid ns_id, pModel::oid m_id, pStringRef
 
     int flags = pModel::NO_FLAGS;
 
-    std::stringstream sql;
-    sql << "INSERT INTO class VALUES (NULL,"
-        << m_id << ','
-        << ns_id
-        << ",'" << name.str() << "',"
-        << type << ','
-        << flags << ','
-        << range.startLine  << ',' << range.startCol  << ',' << range.endLine  << ',' << range.endCol << ','
-        << extends_count << ',' << implements_count << ','
-        << db_->sql_string(extends, true) << ','
-        << db_->sql_string(implements, true) << ','
-        << db_->sql_string(extends, true) << ',' // unresolved until resolveClassRelations is called
-        << db_->sql_string(implements, true)     // unresolved until resolveClassRelations is called
-        << ")";
-    return db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertClass",
+            "INSERT INTO class VALUES (NULL,?,?,?,?,?,?,?,?,?,?,?,?,?,?,?)");
+    insert.bind(1, m_id);
+    insert.bind(2, ns_id);
+    insert.bind(3, name);
+    insert.bind(4, type);
+    insert.bind(5, flags);
+    insert.bind(6, range.startLine);
+    insert.bind(7, range.startCol);
+    insert.bind(8, range.endLine);
+    insert.bind(9, range.endCol);
+    insert.bind(10, extends_count);
+    insert.bind(11, implements_count);
+    insert.bindOrNull(12, extends);
+    insert.bindOrNull(13, implements);
+    insert.bindOrNull(14, extends);    // unresolved until resolveClassRelations is called
+    insert.bindOrNull(15, implements); // unresolved until resolveClassRelations is called
+    oid result = insert.insert();
+
+    model::mClass c;
+    c.id = result;
+    c.namespaceID = ns_id;
+    c.name = name;
+    c.type = type;
+    c.flags = flags;
+    c.extendsCount = extends_count;
+    c.implementsCount = implements_count;
+    c.extends = extends;
+    c.implements = implements;
+    c.unresolvedExtends = extends;
+    c.unresolvedImplements = implements;
+    c.range = pSourceRange(range.startLine, range.startCol);
+    c.realPath = index_->modulePath(m_id);
+    index_->addClass(m_id, c);
+
+    return result;
 
 }
 
@@ -481,164 +1124,281 @@ pModel::oid pModel::defineClass(pModel::oid ns_id, pModel::oid m_id, pStringRef
 pModel::oid pModel::defineFunction(oid ns_id, oid m_id, oid c_id, pStringRef name,
                     int type, int flags, int vis, int minA, int maxA, pSourceRange range) {
 
-    std::stringstream sql;
-    sql << "INSERT INTO function VALUES (NULL,"
-        << m_id << ','
-        << ns_id << ','
-        << db_->oidOrNull(c_id)
-        << ",'" << name.str() << "',"
-        << type << ','
-        << flags << ','
-        << vis << ','
-        << minA << ','
-        << maxA << ','
-        << range.startLine  << ',' << range.startCol  << ',' << range.endLine  << ',' << range.endCol
-        << ")";
-    return db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertFunction",
+            "INSERT INTO function VALUES (NULL,?,?,?,?,?,?,?,?,?,?,?,?,?)");
+    insert.bind(1, m_id);
+    insert.bind(2, ns_id);
+    insert.bindOrNull(3, c_id);
+    insert.bind(4, name);
+    insert.bind(5, type);
+    insert.bind(6, flags);
+    insert.bind(7, vis);
+    insert.bind(8, minA);
+    insert.bind(9, maxA);
+    insert.bind(10, range.startLine);
+    insert.bind(11, range.startCol);
+    insert.bind(12, range.endLine);
+    insert.bind(13, range.endCol);
+    oid result = insert.insert();
+
+    model::mFunction f;
+    f.id = result;
+    f.name = name;
+    f.type = type;
+    f.flags = flags;
+    f.visibility = vis;
+    f.minArity = minA;
+    f.maxArity = maxA;
+    f.range = pSourceRange(range.startLine, range.startCol);
+    f.realPath = index_->modulePath(m_id);
+    index_->addFunction(ns_id, c_id, m_id, f);
+
+    return result;
+
+}
+
+void pModel::flushBatch(void) {
+
+    classDeclBatch_->flush();
+    functionVarBatch_->flush();
+    varUseBatch_->flush();
+    constantBatch_->flush();
+    dependencyBatch_->flush();
+    symbolBatch_->flush();
+    batching_ = false;
 
 }
 
 void pModel::defineClassDecl(oid c_id, pStringRef name, int type, int flags, int vis, pStringRef defaultVal, pSourceRange range) {
 
-    std::stringstream sql;
-    sql << "INSERT INTO class_decl VALUES (NULL,"
-        << c_id
-        << ",'" << name.str() << "',"
-        << type << ','
-        << flags << ','
-        << vis << ','
-        << db_->sql_string(defaultVal) << ","
-        << range.startLine  << ',' << range.startCol
-        << ")";
+    if (batching_) {
+        classDeclBatch_->add(c_id);
+        classDeclBatch_->add(name);
+        classDeclBatch_->add(type);
+        classDeclBatch_->add(flags);
+        classDeclBatch_->add(vis);
+        classDeclBatch_->addOrNull(defaultVal);
+        classDeclBatch_->add(range.startLine);
+        classDeclBatch_->add(range.startCol);
+        return;
+    }
 
-    db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertClassDecl",
+            "INSERT INTO class_decl VALUES (NULL,?,?,?,?,?,?,?,?)");
+    insert.bind(1, c_id);
+    insert.bind(2, name);
+    insert.bind(3, type);
+    insert.bind(4, flags);
+    insert.bind(5, vis);
+    insert.bindOrNull(6, defaultVal);
+    insert.bind(7, range.startLine);
+    insert.bind(8, range.startCol);
+    insert.execute();
 
 }
 
 void pModel::defineClassRelation(oid lhs_c_id, int type, oid rhs_c_id) {
 
-    std::stringstream sql;
-    sql << "INSERT INTO class_relations VALUES (NULL,"
-        << lhs_c_id << ','
-        << type << ','
-        << rhs_c_id
-        << ")";
-
-    db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertClassRelation",
+            "INSERT INTO class_relations VALUES (NULL,?,?,?)");
+    insert.bind(1, lhs_c_id);
+    insert.bind(2, type);
+    insert.bind(3, rhs_c_id);
+    insert.execute();
 
 }
 
 
+bool pModel::hasClassRelation(oid lhs_c_id, int type, oid rhs_c_id) const {
+
+    db::pStmt& select = db_->statement("hasClassRelation",
+            "SELECT 1 FROM class_relations WHERE lhs_class_id=? AND type=? AND rhs_class_id=?");
+    select.bind(1, lhs_c_id);
+    select.bind(2, type);
+    select.bind(3, rhs_c_id);
+    bool result = select.step();
+    select.reset();
+    return result;
+
+}
+
 void pModel::defineFunctionVar(oid f_id, pStringRef name,
                     int type, int flags, int datatype, int blockDepth,
                     int branch,
                     pStringRef datatype_obj,
                     pStringRef defaultVal,
-                    pSourceRange range) {
+                    pSourceRange range,
+                    int useCount, bool isRedecl, bool multiDecl) {
+
+    if (batching_) {
+        functionVarBatch_->add(f_id);
+        functionVarBatch_->add(name);
+        functionVarBatch_->add(type);
+        functionVarBatch_->add(flags);
+        functionVarBatch_->add(datatype);
+        functionVarBatch_->addOrNull(datatype_obj);
+        functionVarBatch_->addOrNull(defaultVal);
+        functionVarBatch_->add(blockDepth);
+        functionVarBatch_->add(branch);
+        functionVarBatch_->add(isRedecl ? 1 : 0);
+        functionVarBatch_->add(useCount);
+        functionVarBatch_->add(multiDecl ? 1 : 0);
+        functionVarBatch_->add(range.startLine);
+        functionVarBatch_->add(range.startCol);
+        return;
+    }
+
+    db::pStmt& insert = db_->statement("insertFunctionVar",
+            "INSERT INTO function_var VALUES (NULL,?,?,?,?,?,?,?,?,?,?,?,?,?,?)");
+    insert.bind(1, f_id);
+    insert.bind(2, name);
+    insert.bind(3, type);
+    insert.bind(4, flags);
+    insert.bind(5, datatype);
+    insert.bindOrNull(6, datatype_obj);
+    insert.bindOrNull(7, defaultVal);
+    insert.bind(8, blockDepth);
+    insert.bind(9, branch);
+    insert.bind(10, isRedecl ? 1 : 0);
+    insert.bind(11, useCount);
+    insert.bind(12, multiDecl ? 1 : 0);
+    insert.bind(13, range.startLine);
+    insert.bind(14, range.startCol);
+    insert.execute();
 
-    std::stringstream sql;
+}
+
+void pModel::defineUndeclaredUse(oid f_id, pStringRef name, pSourceRange range) {
+
+    if (batching_) {
+        varUseBatch_->add(f_id);
+        varUseBatch_->addOrNull(name);
+        varUseBatch_->add(range.startLine);
+        varUseBatch_->add(range.startCol);
+        return;
+    }
 
-    sql << "INSERT INTO function_var VALUES (NULL,"
-        << f_id << ','
-        << "'" << name.str() << "'" << ','
-        << type << ','
-        << flags << ','
-        << datatype << ','
-        << db_->sql_string(datatype_obj) << ','
-        << db_->sql_string(defaultVal) << ','
-        << blockDepth << ','
-        << branch << ','
-        << "0," // is_redecl
-        << "0," // use_count
-        << range.startLine  << ',' << range.startCol
-        << ")";
-    db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertFunctionVarUseNoDecl",
+            "INSERT INTO function_var_usenodecl VALUES (NULL,?,?,?,?)");
+    insert.bind(1, f_id);
+    insert.bindOrNull(2, name);
+    insert.bind(3, range.startLine);
+    insert.bind(4, range.startCol);
+    insert.execute();
 
 }
 
-void pModel::defineFunctionVarUse(oid f_id, int blockDepth, int branch, pStringRef name, pSourceRange range) {
+void pModel::defineConstant(oid m_id, pStringRef name, int type, pStringRef val, pSourceRange range) {
 
-    std::stringstream sql;
+    // no namespace
+    defineConstant(m_id, pModel::NULLID, name, type, val, range);
 
-    // first we see if there is/are associated decl(s) defined before this use
-    sql << "UPDATE function_var SET use_count=use_count+1 WHERE name=" << "'" << name.str() << "'" <<
-           " AND function_id=" << f_id << " AND start_line <= " << range.startLine <<
-           " AND blockDepth <= " << blockDepth;
+}
 
-    db_->sql_execute(sql.str());
+void pModel::defineConstant(oid m_id, oid ns_id, pStringRef name, int type, pStringRef val, pSourceRange range) {
 
-    // if there were no updates, the symbol was not defined
-    if (db_->sql_changes() == 0) {
+    // batched constants have no id yet, which nothing looks up by anyway
+    model::mConstant c;
+    c.id = pModel::NULLID;
+    c.name = name;
+    c.type = type;
+    c.range = pSourceRange(range.startLine, range.startCol);
+    c.realPath = index_->modulePath(m_id);
+
+    if (batching_) {
+        constantBatch_->add(m_id);
+        constantBatch_->addOrNull(ns_id);
+        constantBatch_->add(type);
+        constantBatch_->add(name);
+        constantBatch_->add(val);
+        constantBatch_->add(range.startLine);
+        constantBatch_->add(range.startCol);
+        index_->addConstant(ns_id, m_id, c);
+        return;
+    }
+
+    db::pStmt& insert = db_->statement("insertConstant",
+            "INSERT INTO constant VALUES (NULL,?,?,?,?,?,?,?)");
+    insert.bind(1, m_id);
+    insert.bindOrNull(2, ns_id);
+    insert.bind(3, type);
+    insert.bind(4, name);
+    insert.bind(5, val);
+    insert.bind(6, range.startLine);
+    insert.bind(7, range.startCol);
+    c.id = insert.insert();
+    index_->addConstant(ns_id, m_id, c);
 
-        sql.str("");
-        sql << "INSERT INTO function_var_usenodecl VALUES (NULL,"
-            << f_id << ','
-            << db_->sql_string(name.str()) << ','
-            << range.startLine  << ',' << range.startCol
-            << ")";
-        db_->sql_insert(sql.str().c_str());
+}
 
+void pModel::defineSymbol(oid m_id, int type, pStringRef name) {
+
+    if (batching_) {
+        symbolBatch_->add(m_id);
+        symbolBatch_->add(type);
+        symbolBatch_->add(name);
+        return;
     }
 
+    db::pStmt& insert = db_->statement("insertSymbol",
+            "INSERT INTO module_symbol VALUES (NULL,?,?,?)");
+    insert.bind(1, m_id);
+    insert.bind(2, type);
+    insert.bind(3, name);
+    insert.execute();
+
 }
 
-void pModel::defineConstant(oid m_id, pStringRef name, int type, pStringRef val, pSourceRange range) {
+void pModel::defineDependency(oid m_id, int type, pStringRef name) {
 
-    std::stringstream sql;
+    if (batching_) {
+        dependencyBatch_->add(m_id);
+        dependencyBatch_->add(type);
+        dependencyBatch_->add(name);
+        return;
+    }
 
-    sql << "INSERT INTO constant VALUES (NULL,"
-        << m_id << ','
-        << "NULL" << ',' // namespace
-        << type << ','
-        << "'" << name.str() << "'" << ','
-        << db_->sql_string(val,false) << ','
-        << range.startLine  << ',' << range.startCol
-        << ")";
-    db_->sql_insert(sql.str().c_str());
+    db::pStmt& insert = db_->statement("insertDependency",
+            "INSERT INTO module_dep VALUES (NULL,?,?,?)");
+    insert.bind(1, m_id);
+    insert.bind(2, type);
+    insert.bind(3, name);
+    insert.execute();
 
 }
 
-void pModel::defineConstant(oid m_id, oid ns_id, pStringRef name, int type, pStringRef val, pSourceRange range) {
 
-    std::stringstream sql;
+namespace {
 
-    sql << "INSERT INTO constant VALUES (NULL,"
-        << m_id << ','
-        << ns_id << ','
-        << type << ','
-        << "'" << name.str() << "'" << ','
-        << db_->sql_string(val,false) << ','
-        << range.startLine  << ',' << range.startCol
-        << ")";
-    db_->sql_insert(sql.str().c_str());
+bool idOrder(const model::mFunction& a, const model::mFunction& b) {
+    return a.id < b.id;
+}
 
+bool classIDOrder(const model::mClass& a, const model::mClass& b) {
+    return a.id < b.id;
 }
 
+}
 
 pModel::FunctionList pModel::queryFunctions(oid ns_id, oid c_id, pStringRef name) const {
 
     FunctionList result;
-    std::stringstream query;
 
+    oid root_id = getRootNamespaceOID();
     if (ns_id == pModel::NULLID)
-        ns_id = getRootNamespaceOID();
-
-    query << "SELECT name, type, flags, visibility, minArity, maxArity, " \
-             " start_line, start_col, sourceModule.realPath FROM " \
-             " function, sourceModule WHERE sourceModule.id=sourceModule_id AND" \
-             " " \
-             " (namespace_id=" << ns_id << " OR namespace_id=" << getRootNamespaceOID() << ") AND class_id ";
-    if (c_id) {
-        query << " = " << c_id;
-    }
-    else {
-        query << " IS NULL ";
-    }
+        ns_id = root_id;
 
-    query << " AND name='" << name.str() << "'";
+    const FunctionList *found = index_->functions(ns_id, c_id, name);
+    if (found)
+        result = *found;
 
-    //db_->list_query<FunctionList>(query.str(), result);
-    db_->list_query(query.str(), result);
+    if (ns_id != root_id) {
+        found = index_->functions(root_id, c_id, name);
+        if (found) {
+            result.insert(result.end(), found->begin(), found->end());
+            std::sort(result.begin(), result.end(), idOrder);
+        }
+    }
 
     return result;
 
@@ -647,20 +1407,30 @@ pModel::FunctionList pModel::queryFunctions(oid ns_id, oid c_id, pStringRef name
 pModel::ClassList pModel::queryClasses(oid ns_id, pStringRef name, pModel::oid m_id) const {
 
     ClassList result;
-    std::stringstream query;
 
-    query << "SELECT class.id, name, type, flags, " \
-             " start_line, start_col, sourceModule.realPath FROM " \
-             " class, sourceModule WHERE sourceModule.id=sourceModule_id AND" \
-             " (namespace_id=" << ns_id << " OR namespace_id=1)" \
-             " AND name='" << name.str() << "'";
+    // classes are looked for in ns_id and the root namespace
+    const ClassList *found[2] = { NULL, NULL };
+    oid root_id = getRootNamespaceOID();
+    if (ns_id != pModel::NULLID)
+        found[0] = index_->classes(ns_id, name);
+    if (ns_id != root_id)
+        found[1] = index_->classes(root_id, name);
 
-    if (m_id != pModel::NULLID) {
-        query << " AND class.sourceModule_id=" << m_id;
+    const std::string *realPath = NULL;
+    if (m_id != pModel::NULLID)
+        realPath = &index_->modulePath(m_id);
+
+    for (int f = 0; f < 2; ++f) {
+        if (!found[f])
+            continue;
+        for (ClassList::const_iterator i = found[f]->begin(); i != found[f]->end(); ++i) {
+            if (!realPath || i->realPath == *realPath)
+                result.push_back(*i);
+        }
     }
 
-    //db_->list_query<ClassList>(query.str(), result);
-    db_->list_query(query.str(), result);
+    if (found[0] && found[1])
+        std::sort(result.begin(), result.end(), classIDOrder);
 
     return result;
 
@@ -669,18 +1439,12 @@ pModel::ClassList pModel::queryClasses(oid ns_id, pStringRef name, pModel::oid m
 pModel::ClassDeclList pModel::queryClassDecls(std::vector<oid> c_id_list, pStringRef name) const {
 
     ClassDeclList result;
-    std::stringstream query;
-
-    std::string c_id_list_str = join(c_id_list);
-    query << "SELECT class.id, class_decl.name, class.name AS className, class_decl.type, class_decl.flags, visibility, defaultVal, " \
-             " class_decl.start_line, class_decl.start_col, sourceModule.realPath FROM " \
-             " class_model_decl, class_decl, class, sourceModule WHERE sourceModule.id=sourceModule_id AND" \
-             " class.id=class_decl.class_id AND class_decl.id=class_model_decl.class_decl_id AND" \
-             " class_model_decl.class_id IN (" << c_id_list_str << ")" \
-             " AND class_decl.name='" << name.str() << "'";
 
-    //db_->list_query<ClassDeclList>(query.str(), result);
-    db_->list_query(query.str(), result);
+    for (std::size_t i = 0; i < c_id_list.size(); ++i) {
+        const ClassDeclList *found = index_->classDecls(c_id_list[i], name);
+        if (found)
+            result.insert(result.end(), found->begin(), found->end());
+    }
 
     return result;
 
@@ -688,20 +1452,8 @@ pModel::ClassDeclList pModel::queryClassDecls(std::vector<oid> c_id_list, pStrin
 
 pModel::ClassDeclList pModel::queryClassDecls(oid c_id, pStringRef name) const {
 
-    ClassDeclList result;
-    std::stringstream query;
-
-    query << "SELECT class.id, class_decl.name, class.name AS className, class_decl.type, class_decl.flags, visibility, defaultVal, " \
-             " class_decl.start_line, class_decl.start_col, sourceModule.realPath FROM " \
-             " class_model_decl, class_decl, class, sourceModule WHERE sourceModule.id=sourceModule_id AND" \
-             " class.id=class_decl.class_id AND class_decl.id=class_model_decl.class_decl_id AND" \
-             " class_model_decl.class_id=" << c_id <<
-             " AND class_decl.name='" << name.str() << "'";
-
-    //db_->list_query<ClassDeclList>(query.str(), result);
-    db_->list_query(query.str(), result);
-
-    return result;
+    const ClassDeclList *found = index_->classDecls(c_id, name);
+    return found ? *found : ClassDeclList();
 
 }
 
@@ -709,21 +1461,19 @@ pModel::ClassDeclList pModel::queryClassDecls(oid c_id, pStringRef name) const {
 pModel::ConstantList pModel::queryConstants(pStringRef name, oid ns_id) const {
 
     pModel::ConstantList result;
-    std::stringstream query;
 
     std::pair<oid, std::string> resolved = resolveFQN(ns_id, name);
     oid res_ns_id = ns_id;
     if (resolved.first != pModel::NULLID)
         res_ns_id = resolved.first;
 
-    query << "SELECT name, " \
-             " start_line, start_col, sourceModule.realPath FROM " \
-             " constant, sourceModule WHERE sourceModule.id=sourceModule_id AND" \
-             " name='" << resolved.second << "' AND (type=" << pModel::DEFINE <<
-             " OR (type=" << pModel::CONST << " AND namespace_id=" << res_ns_id << "))";
+    const ConstantList *found = index_->constants(pModel::NULLID, pModel::DEFINE, resolved.second);
+    if (found)
+        result = *found;
 
-    //db_->list_query<pModel::ConstantList>(query.str(), result);
-    db_->list_query(query.str(), result);
+    found = index_->constants(res_ns_id, pModel::CONST, resolved.second);
+    if (found)
+        result.insert(result.end(), found->begin(), found->end());
 
     return result;
 
@@ -793,7 +1543,7 @@ pModel::oid pModel::lookupClass(oid ns_id, pStringRef name, pModel::oid m_id) co
         return pModel::NULLID;
     }
     else if (cl.size() == 1) {
-        return cl[0].getID();
+        return cl[0].id;
     }
     else {
         return pModel::MULTIPLE_IDS;
@@ -810,7 +1560,7 @@ pModel::oid pModel::lookupFunction(oid ns_id, oid c_id, pStringRef name) const {
         return pModel::NULLID;
     }
     else if (cl.size() == 1) {
-        return cl[0].getID();
+        return cl[0].id;
     }
     else {
         return pModel::MULTIPLE_IDS;
@@ -826,14 +1576,16 @@ pModel::ClassList pModel::getUnresolvedClasses() const {
     // extends and implements as recorded by the class declaration against
     // the count of relations we have in the relations table. if there are fewer
     // in the relations table than in the class table, then we have unresolved
-    const char *query = "SELECT class.id, namespace_id, name, type, flags, extends, implements, extends_count, implements_count, " \
-             " unresolved_extends, unresolved_implements, " \
+    db::pStmt& query = db_->statement("unresolvedClasses",
+             "SELECT " CLASS_COLUMNS ", " \
              " (select count(*) from class_relations where lhs_class_id=class.id and type=0) as resolved_extends_count, " \
-             " (select count(*) from class_relations where lhs_class_id=class.id and type=1) as resolved_implements_count, " \
-             " start_line, start_col, sourceModule.realPath FROM " \
-             " class, sourceModule WHERE sourceModule.id=sourceModule_id AND" \
+             " (select count(*) from class_relations where lhs_class_id=class.id and type=1) as resolved_implements_count " \
+             " FROM class, sourceModule WHERE sourceModule.id=sourceModule_id AND" \
              " (extends_count > 0 or implements_count > 0) AND " \
-             " ((extends_count > resolved_extends_count) or (implements_count > resolved_implements_count))";
+             " ((extends_count > resolved_extends_count) or (implements_count > resolved_implements_count))" \
+             " AND sourceModule.id > ?");
+    // classes in the layer are left as they were built
+    query.bind(1, layerModules_);
 
     //db_->list_query<ClassList>(query.str(), result);
     db_->list_query(query, result);
@@ -845,91 +1597,125 @@ pModel::ClassList pModel::getUnresolvedClasses() const {
 pModel::MultipleDeclList pModel::getMultipleDecls(oid m_id) const {
 
     MultipleDeclList result;
-    db::pDB::RowList db_result;
-    std::stringstream query;
 
-    query << "SELECT A.*, realPath FROM function_var A, function_var B, "\
+    // which decls are multiples was worked out when the module was built,
+    // see pModelRecord::resolveMultipleDecls
+#define MULTIPLE_DECL_QUERY "SELECT A.id, A.name, A.start_line, A.start_col, realPath " \
+            "FROM function_var A, "\
             "function, sourceModule WHERE function.id=A.function_id AND "\
-            "sourceModule.id=function.sourceModule_id AND "\
-            "A.name=B.name and A.function_id=B.function_id AND "\
-            // only check for multidecls in the same block depth
-            "(A.blockDepth == B.blockDepth) AND "\
-            // only check for multidecls in the same branch
-            "(A.branch == B.branch) AND "\
-            // this says not to count a variable defined as null as a multiple
-            "(A.datatype != 1 AND B.datatype != 1) AND ";
+            "sourceModule.id=function.sourceModule_id AND "
+#define MULTIPLE_DECL_ORDER "A.multi_decl=1 GROUP BY A.function_id,A.name,A.start_line "\
+            "ORDER BY A.name,A.start_line"
 
-    if (m_id != pModel::NULLID)
-        query << "sourceModule.id=" << m_id << " AND ";
+    db::pStmt& query = (m_id != pModel::NULLID) ?
+        db_->statement("moduleMultipleDecls", MULTIPLE_DECL_QUERY "sourceModule.id=? AND " MULTIPLE_DECL_ORDER) :
+        db_->statement("multipleDecls", MULTIPLE_DECL_QUERY MULTIPLE_DECL_ORDER);
 
-    query << "(A.start_line != B.start_line) GROUP BY A.function_id,A.name,A.start_line "\
-            "ORDER BY A.name,A.start_line";
+#undef MULTIPLE_DECL_QUERY
+#undef MULTIPLE_DECL_ORDER
 
-    db_->list_query(query.str(), db_result);
-
-    if (db_result.size() == 0)
-        return result;
+    if (m_id != pModel::NULLID)
+        query.bind(1, m_id);
 
     // we put this in a convenient form for the caller
     // a vector of symbols and their duplicate locations, first def first
     model::mMultipleDecl entry;
-    for (int i = 0; i < db_result.size(); ++i) {
-        if (entry.symbol != db_result[i].get("name")) {
+    while (query.step()) {
+        pStringRef name = query.getText(1);
+        if (entry.symbol != name) {
             // finish up the last one
             if (!entry.symbol.empty())
                 result.push_back(entry);
             // new entry in result
-            entry.symbol = db_result[i].get("name");
-            entry.realPath = db_result[i].get("realpath");
+            entry.symbol = name;
+            entry.realPath = query.getText(4);
             entry.redecl_locs.clear();
         }
-        entry.redecl_locs.push_back(model::mMultipleDecl::locData(db_result[i].getAsOID("id"),
-                                       pSourceRange(db_result[i].getAsInt("start_line"),
-                                                    db_result[i].getAsInt("start_col"))));
+        entry.redecl_locs.push_back(model::mMultipleDecl::locData(query.getOID(0),
+                                       pSourceRange(query.getInt(2), query.getInt(3))));
     }
-    result.push_back(entry);
+    query.reset();
+
+    if (!entry.symbol.empty())
+        result.push_back(entry);
 
     return result;
 
 }
 
-void pModel::resolveMultipleDecls(oid m_id) {
+bool pModel::getCachedDiagnostics(pStringRef realPath, pStringRef hash, pStringRef fingerprint,
+                                  DiagnosticList& diags) const {
+
+    db::pStmt& key = db_->statement("diagCacheKey",
+            "SELECT id FROM sourceModule WHERE realpath=? AND diag_hash=? AND diag_fingerprint=?");
+    key.bind(1, realPath);
+    key.bind(2, hash);
+    key.bind(3, fingerprint);
+    oid m_id = key.step() ? key.getOID(0) : static_cast<oid>(pModel::NULLID);
+    key.reset();
+    if (m_id == pModel::NULLID)
+        return false;
+
+    db::pStmt& query = db_->statement("diagCache",
+            "SELECT start_line, start_col, end_line, end_col, msg FROM module_diag"
+            " WHERE sourceModule_id=? ORDER BY id");
+    query.bind(1, m_id);
+    db_->list_query(query, diags);
+    return true;
 
-    pModel::MultipleDeclList redecl = getMultipleDecls(m_id);
-    if (redecl.size() == 0)
-        return;
+}
 
-    std::stringstream query;
+void pModel::setCachedDiagnostics(pStringRef realPath, pStringRef hash, pStringRef fingerprint,
+                                  const DiagnosticList& diags) {
 
-    // update function_var to flag decls which were redeclared
-    // so they won't be checked for use
-    query << "UPDATE function_var SET is_redecl=1 WHERE id IN (";
+    oid m_id = lookupSourceModule(realPath);
+    if (m_id == pModel::NULLID)
+        return;
 
-    for (int i = 0; i < redecl.size(); ++i) {
-        // note the j = 1, meaning only flag the duplicates, not the initial
-        assert(redecl[i].redecl_locs.size() > 1 && "redecl had no redecls");
-        for (int j = 1; j < redecl[i].redecl_locs.size(); ++j) {
-            query << redecl[i].redecl_locs[j].first << ",";
-        }
+    db::pStmt& update = db_->statement("setDiagCacheKey",
+            "UPDATE sourceModule SET diag_hash=?, diag_fingerprint=? WHERE id=?");
+    update.bind(1, hash);
+    update.bind(2, fingerprint);
+    update.bind(3, m_id);
+    update.execute();
+
+    db::pStmt& del = db_->statement("clearDiagCache",
+            "DELETE FROM module_diag WHERE sourceModule_id=?");
+    del.bind(1, m_id);
+    del.execute();
+
+    db::pStmt& insert = db_->statement("insertDiagCache",
+            "INSERT INTO module_diag VALUES (NULL,?,?,?,?,?,?)");
+    for (std::size_t i = 0; i < diags.size(); ++i) {
+        insert.bind(1, m_id);
+        insert.bind(2, diags[i].range.startLine);
+        insert.bind(3, diags[i].range.startCol);
+        insert.bind(4, diags[i].range.endLine);
+        insert.bind(5, diags[i].range.endCol);
+        insert.bind(6, diags[i].msg);
+        insert.execute();
     }
-    query << "0)"; // cheat with the 0 to avoid substr
-    db_->sql_execute(query.str());
 
 }
 
 pModel::UndeclList pModel::getUndeclaredUses(oid m_id) const {
 
     UndeclList result;
-    std::stringstream query;
 
-    query << "SELECT function_var_usenodecl.*, realPath FROM function_var_usenodecl, "\
+#define UNDECL_QUERY "SELECT " VAR_USE_COLUMNS " FROM function_var_usenodecl, "\
             "function, sourceModule WHERE "\
-            "function.id=function_id AND function.sourceModule_id=sourceModule.id";
+            "function.id=function_id AND function.sourceModule_id=sourceModule.id"
+
+    db::pStmt& query = (m_id != pModel::NULLID) ?
+        db_->statement("moduleUndeclaredUses", UNDECL_QUERY " AND sourceModule.id=?") :
+        db_->statement("undeclaredUses", UNDECL_QUERY);
+
+#undef UNDECL_QUERY
 
     if (m_id != pModel::NULLID)
-        query << " AND sourceModule.id=" << m_id;
+        query.bind(1, m_id);
 
-    db_->list_query(query.str(), result);
+    db_->list_query(query, result);
 
     return result;
 
@@ -938,22 +1724,248 @@ pModel::UndeclList pModel::getUndeclaredUses(oid m_id) const {
 pModel::UnusedList pModel::getUnusedDecls(oid m_id) const {
 
     UnusedList result;
-    std::stringstream query;
 
-    query << "SELECT function_var.*, realPath FROM function_var, "\
+#define UNUSED_QUERY "SELECT " FUNCTION_VAR_COLUMNS " FROM function_var, "\
             "function, sourceModule WHERE function.id=function_var.function_id AND "\
             "sourceModule.id=function.sourceModule_id AND use_count=0 AND "\
-             "is_redecl=0 AND branch=0";
+             "is_redecl=0 AND branch=0"
+
+    db::pStmt& query = (m_id != pModel::NULLID) ?
+        db_->statement("moduleUnusedDecls", UNUSED_QUERY " AND sourceModule.id=?") :
+        db_->statement("unusedDecls", UNUSED_QUERY);
+
+#undef UNUSED_QUERY
 
     if (m_id != pModel::NULLID)
-        query << " AND sourceModule.id=" << m_id;
+        query.bind(1, m_id);
 
-    db_->list_query(query.str(), result);
+    db_->list_query(query, result);
 
     return result;
 
 }
 
+namespace {
+
+// reads the dependency graph for getDependencyFingerprints as it's walked,
+// each module's dependencies and each symbol's definers only once, so that
+// fingerprinting a few modules doesn't read the whole model
+class dependencyGraph {
+public:
+    typedef db::pDB::oid oid;
+    typedef std::pair<int, std::string> symbol;
+
+private:
+    const db::pDB *db_;
+    std::map<oid, std::vector<symbol> > deps_;
+    std::map<symbol, std::vector<oid> > definers_;
+    std::map<oid, std::string> modules_;
+
+public:
+    dependencyGraph(const db::pDB *db): db_(db) { }
+
+    const std::vector<symbol>& deps(oid m_id) {
+        std::map<oid, std::vector<symbol> >::iterator i = deps_.find(m_id);
+        if (i != deps_.end())
+            return i->second;
+        std::vector<symbol>& result = deps_[m_id];
+        db::pStmt& query = db_->statement("graphDeps",
+                "SELECT type, name FROM module_dep WHERE sourceModule_id=?");
+        query.bind(1, m_id);
+        while (query.step())
+            result.push_back(std::make_pair(query.getInt(0), query.getText(1).str()));
+        query.reset();
+        return result;
+    }
+
+    const std::vector<oid>& definers(const symbol& s) {
+        std::map<symbol, std::vector<oid> >::iterator i = definers_.find(s);
+        if (i != definers_.end())
+            return i->second;
+        std::vector<oid>& result = definers_[s];
+        db::pStmt& query = db_->statement("graphDefiners",
+                "SELECT sourceModule_id FROM module_symbol WHERE type=? AND name=?");
+        query.bind(1, s.first);
+        query.bind(2, s.second);
+        while (query.step())
+            result.push_back(query.getOID(0));
+        query.reset();
+        return result;
+    }
+
+    // realpath and hash
+    const std::string& module(oid m_id) {
+        std::map<oid, std::string>::iterator i = modules_.find(m_id);
+        if (i != modules_.end())
+            return i->second;
+        std::string& result = modules_[m_id];
+        db::pStmt& query = db_->statement("graphModule",
+                "SELECT realpath, hash FROM sourceModule WHERE id=?");
+        query.bind(1, m_id);
+        if (query.step())
+            result = query.getText(0).str() + "\t" + query.getText(1).str();
+        query.reset();
+        return result;
+    }
+
+};
+
+}
+
+// a module's diagnostics depend on its own source and on the symbols it
+// looked up. those are taken to be whatever the modules defining its
+// dependencies were when the fingerprint was made, identified by realpath
+// and hash, and through classes the modules those depend on in turn, the
+// same way invalidateDependents goes the other way. a symbol that wasn't
+// defined before and now is changes the fingerprint too, as do the builtins
+void pModel::getDependencyFingerprints(const std::vector<std::string>& realPaths,
+                                       std::vector<std::string>& fingerprints) const {
+
+    typedef dependencyGraph::symbol symbol;
+    dependencyGraph graph(db_);
+
+    fingerprints.assign(realPaths.size(), std::string());
+    for (std::size_t i = 0; i < realPaths.size(); ++i) {
+
+        oid self = lookupSourceModule(realPaths[i]);
+        if (self == pModel::NULLID)
+            continue;
+
+        std::set<std::string> lines;
+        std::set<oid> seen;
+        std::vector<oid> work(1, self);
+        seen.insert(self);
+
+        while (!work.empty()) {
+            oid m_id = work.back();
+            work.pop_back();
+            const std::vector<symbol>& list = graph.deps(m_id);
+            for (std::size_t j = 0; j < list.size(); ++j) {
+                if (m_id != self && list[j].first != DEP_CLASS)
+                    continue;
+                const std::vector<oid>& definers = graph.definers(list[j]);
+                for (std::size_t k = 0; k < definers.size(); ++k) {
+                    std::stringstream line;
+                    line << list[j].first << "\t" << list[j].second << "\t" << graph.module(definers[k]);
+                    lines.insert(line.str());
+                    if (list[j].first == DEP_CLASS && seen.insert(definers[k]).second)
+                        work.push_back(definers[k]);
+                }
+            }
+        }
+
+        std::string all(pBuiltins::stamp());
+        all.push_back('\n');
+        for (std::set<std::string>::iterator l = lines.begin(); l != lines.end(); ++l) {
+            all.append(*l);
+            all.push_back('\n');
+        }
+        char hex[17];
+        snprintf(hex, sizeof(hex), "%016llx",
+                 (unsigned long long)xxh64(all.data(), all.size(), 0));
+        fingerprints[i] = hex;
+
+    }
+
+}
+
+// a class model takes in everything the class inherits, so resetting it
+// means a change anywhere above it is picked up when it's rebuilt. a change
+// to a function or constant only matters to the modules using it directly
+void pModel::invalidateDependents(oid m_id, const SymbolSet& symbols) {
+
+    db::pStmt& dependents = db_->statement("moduleDependents",
+            "SELECT DISTINCT sourceModule_id FROM module_dep WHERE type=? AND name=?");
+    db::pStmt& classes = db_->statement("moduleClasses",
+            "SELECT name FROM class WHERE sourceModule_id=?");
+
+    std::set<oid> seen;
+    seen.insert(m_id);
+    std::vector<std::pair<int, std::string> > work(symbols.begin(), symbols.end());
+    std::vector<oid> found;
+
+    while (!work.empty()) {
+
+        std::pair<int, std::string> symbol = work.back();
+        work.pop_back();
+
+        found.clear();
+        dependents.bind(1, symbol.first);
+        dependents.bind(2, symbol.second);
+        while (dependents.step())
+            found.push_back(dependents.getOID(0));
+        dependents.reset();
+
+        for (std::size_t i = 0; i < found.size(); ++i) {
+            // the layer doesn't change under us
+            if (found[i] <= layerModules_ || !seen.insert(found[i]).second)
+                continue;
+            resetClassModels(found[i]);
+            invalidated_.insert(index_->modulePath(found[i]));
+            classes.bind(1, found[i]);
+            while (classes.step())
+                work.push_back(std::make_pair((int)DEP_CLASS,
+                                              dependencyName(DEP_CLASS, classes.getText(0))));
+            classes.reset();
+        }
+
+    }
+
+}
+
+// the module's classes go back to unresolved, as they were when defined, so
+// that resolveClassRelations and refreshClassModel build them again against
+// the model as it is now
+void pModel::resetClassModels(oid m_id) {
+
+    const char *reset[][2] = {
+        { "resetClassRelations",
+          "DELETE FROM class_relations WHERE lhs_class_id IN"
+          " (SELECT id FROM class WHERE sourceModule_id=?)" },
+        { "resetClassModelDecls",
+          "DELETE FROM class_model_decl WHERE class_id IN"
+          " (SELECT id FROM class WHERE sourceModule_id=?)" },
+        { "resetClassModelFunctions",
+          "DELETE FROM class_model_function WHERE class_id IN"
+          " (SELECT id FROM class WHERE sourceModule_id=?)" },
+        { "resetUnresolved",
+          "UPDATE class SET unresolved_extends=extends, unresolved_implements=implements"
+          " WHERE sourceModule_id=?" }
+    };
+    for (std::size_t i = 0; i < sizeof(reset) / sizeof(reset[0]); ++i) {
+        db::pStmt& stmt = db_->statement(reset[i][0], reset[i][1]);
+        stmt.bind(1, m_id);
+        stmt.execute();
+    }
+
+}
+
+// whether c_id is ancestor_id, or is below it through the class relations
+bool pModel::inheritsFrom(oid c_id, oid ancestor_id) const {
+
+    db::pStmt& parents = db_->statement("classParents",
+            "SELECT rhs_class_id FROM class_relations WHERE lhs_class_id=?");
+
+    std::set<oid> seen;
+    std::vector<oid> work(1, c_id);
+    while (!work.empty()) {
+        oid id = work.back();
+        work.pop_back();
+        if (id == ancestor_id)
+            return true;
+        if (!seen.insert(id).second)
+            continue;
+        parents.bind(1, id);
+        while (parents.step())
+            work.push_back(parents.getOID(0));
+        parents.reset();
+    }
+    return false;
+
+}
+
+// a parent that is, or is below, the class it's a parent of would make the
+// relations cyclic. it's left unresolved, and reported as such
 void pModel::resolveClassRelations() {
 
     ClassList unresolved = getUnresolvedClasses();
@@ -964,67 +1976,71 @@ void pModel::resolveClassRelations() {
 
     for (int i = 0; i < unresolved.size(); ++i) {
 
-        pModel::oid c_id = unresolved[i].getAsOID("id");
+        pModel::oid c_id = unresolved[i].id;
 
-        if (unresolved[i].getAsInt("extends_count") > unresolved[i].getAsInt("resolved_extends_count")) {
+        if (unresolved[i].extendsCount > unresolved[i].resolvedExtendsCount) {
             llvm::SmallVector<pStringRef, 32> e_list;
-            pStringRef orig(unresolved[i].get("extends"));
+            pStringRef orig(unresolved[i].extends);
             orig.split(e_list, ",", 32);
             for (int j = 0; j < e_list.size(); ++j) {
-                pModel::oid resolved_id = lookupClass(unresolved[i].getAsOID("namespace_id"), e_list[j]);
+                pModel::oid resolved_id = lookupClass(unresolved[i].namespaceID, e_list[j]);
                 if (resolved_id != pModel::NULLID) {
-                    defineClassRelation(c_id, pModel::EXTENDS, resolved_id);
-                    // XXX i think we want to clear the class_model_decl and class_model_function here
-                    //     for this class to be sure it's rebuilt properly
+                    if (hasClassRelation(c_id, pModel::EXTENDS, resolved_id))
+                        continue;
+                    if (inheritsFrom(resolved_id, c_id))
+                        unresolved_extends.push_back(e_list[j]);
+                    else
+                        defineClassRelation(c_id, pModel::EXTENDS, resolved_id);
                 }
-                else {
+                else if (!pBuiltins::lookupClass(e_list[j])) {
                     unresolved_extends.push_back(e_list[j]);
                 }
             }
         }
 
-        if (unresolved[i].getAsInt("implements_count") > unresolved[i].getAsInt("resolved_implements_count")) {
+        if (unresolved[i].implementsCount > unresolved[i].resolvedImplementsCount) {
             llvm::SmallVector<pStringRef, 32> i_list;
-            pStringRef orig(unresolved[i].get("implements"));
+            pStringRef orig(unresolved[i].implements);
             orig.split(i_list, ",", 32);
             for (int j = 0; j < i_list.size(); ++j) {
-                pModel::oid resolved_id = lookupClass(unresolved[i].getAsOID("namespace_id"), i_list[j]);
+                pModel::oid resolved_id = lookupClass(unresolved[i].namespaceID, i_list[j]);
                 if (resolved_id != pModel::NULLID) {
-                    // XXX i think we want to clear the class_model_decl and class_model_function here
-                    //     for this class to be sure it's rebuilt properly
-                    defineClassRelation(c_id, pModel::IMPLEMENTS, resolved_id);
+                    if (hasClassRelation(c_id, pModel::IMPLEMENTS, resolved_id))
+                        continue;
+                    if (inheritsFrom(resolved_id, c_id))
+                        unresolved_implements.push_back(i_list[j]);
+                    else
+                        defineClassRelation(c_id, pModel::IMPLEMENTS, resolved_id);
                 }
-                else {
+                else if (!pBuiltins::lookupClass(i_list[j])) {
                     unresolved_implements.push_back(i_list[j]);
                 }
             }
         }
 
         // we save the text version of unresolved classes for the benefit of
-        // diagnostics
-        if (unresolved_extends.size()) {
-            std::stringstream query;
-            query << "UPDATE class SET unresolved_extends='";
-            if (unresolved_extends.size() > 1) {
-                query << join(unresolved_extends);
-            }
-            else {
-                query << unresolved_extends[0];
-            }
-            query << "' WHERE id=" << c_id;
-            db_->sql_execute(query.str());
+        // diagnostics. it's only written if it changed, so that an unchanged
+        // model isn't saved again. builtins aren't in the model unless base/
+        // was included, so those are left unresolved but not reported
+        if (unresolved[i].extendsCount > unresolved[i].resolvedExtendsCount) {
+            std::string names = (unresolved_extends.size() > 1) ? join(unresolved_extends) :
+                                unresolved_extends.size() ? unresolved_extends[0] : "";
+            db::pStmt& update = db_->statement("setUnresolvedExtends",
+                    "UPDATE class SET unresolved_extends=? WHERE id=? AND unresolved_extends IS NOT ?");
+            update.bindOrNull(1, names);
+            update.bind(2, c_id);
+            update.bindOrNull(3, names);
+            update.execute();
         }
-        if (unresolved_implements.size()) {
-            std::stringstream query;
-            query << "UPDATE class SET unresolved_implements='";
-            if (unresolved_implements.size() > 1) {
-                query << join(unresolved_implements);
-            }
-            else {
-                query << unresolved_implements[0];
-            }
-            query << "' WHERE id=" << c_id;
-            db_->sql_execute(query.str());
+        if (unresolved[i].implementsCount > unresolved[i].resolvedImplementsCount) {
+            std::string names = (unresolved_implements.size() > 1) ? join(unresolved_implements) :
+                                unresolved_implements.size() ? unresolved_implements[0] : "";
+            db::pStmt& update = db_->statement("setUnresolvedImplements",
+                    "UPDATE class SET unresolved_implements=? WHERE id=? AND unresolved_implements IS NOT ?");
+            update.bindOrNull(1, names);
+            update.bind(2, c_id);
+            update.bindOrNull(3, names);
+            update.execute();
         }
 
         unresolved_extends.clear();
@@ -1040,6 +2056,7 @@ void pModel::refreshClassModel(pStringRef graphFileName) {
 
     pClassGraph cmb(db_);
     cmb.build();
+    loadClassDeclIndex();
 
     if (!graphFileName.empty()) {
         cmb.writeDot(graphFileName);
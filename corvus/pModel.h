@@ -13,27 +13,128 @@
 
 #include "corvus/pTypes.h"
 #include "pDB.h"
+#include "corvus/pThreadPool.h"
 
 //#include <sqlite3.h>
 #include <map>
+#include <set>
 #include <vector>
 
 #include <iostream>
 
 struct sqlite3;
 
+#define CORVUS_DBMODEL_VERSION "1.6"
+
 namespace corvus {
 
+class pModelWriter;
+class pSymbolIndex;
+
 namespace model {
 
 
-class mFunction: public db::dbRow { };
+// rows returned by model queries. read() takes the columns by position, in
+// the order the queries in pModel.cpp select them. range is the start only
+
+struct mFunction {
+    db::pDB::oid id;
+    std::string name;
+    int type;
+    int flags;
+    int visibility;
+    int minArity;
+    int maxArity;
+    pSourceRange range;
+    std::string realPath;
+    void read(const db::pStmt &row);
+};
+
+struct mClass {
+    db::pDB::oid id;
+    db::pDB::oid namespaceID;
+    std::string name;
+    int type;
+    int flags;
+    int extendsCount;
+    int implementsCount;
+    std::string extends;
+    std::string implements;
+    std::string unresolvedExtends;
+    std::string unresolvedImplements;
+    pSourceRange range;
+    std::string realPath;
+    // only filled in by getUnresolvedClasses
+    int resolvedExtendsCount;
+    int resolvedImplementsCount;
+    mClass(void): resolvedExtendsCount(0), resolvedImplementsCount(0) { }
+    void read(const db::pStmt &row);
+};
+
+struct mClassDecl {
+    db::pDB::oid classID;
+    std::string name;
+    std::string className;
+    int type;
+    int flags;
+    int visibility;
+    std::string defaultVal;
+    pSourceRange range;
+    std::string realPath;
+    void read(const db::pStmt &row);
+};
+
+struct mConstant {
+    db::pDB::oid id;
+    std::string name;
+    int type;
+    pSourceRange range;
+    std::string realPath;
+    void read(const db::pStmt &row);
+};
+
+struct mFunctionVar {
+    db::pDB::oid id;
+    db::pDB::oid functionID;
+    std::string name;
+    int type;
+    int flags;
+    int datatype;
+    int blockDepth;
+    int branch;
+    pSourceRange range;
+    std::string realPath;
+    void read(const db::pStmt &row);
+};
 
-class mClass: public db::dbRow { };
+// a use of a function var with no decl before it
+struct mVarUse {
+    db::pDB::oid id;
+    db::pDB::oid functionID;
+    std::string name;
+    pSourceRange range;
+    std::string realPath;
+    void read(const db::pStmt &row);
+};
 
-class mClassDecl: public db::dbRow { };
+// a source module as of the last time it was built
+struct mSourceModule {
+    std::string hash;
+    pUInt size;
+    // 0 if it wasn't safe to trust, see setSourceModuleStat
+    pUInt mtime;
+    // tokens + nodes
+    pUInt cost;
+    // from the model layer, see pModel::attachLayer
+    bool layer;
+};
 
-class mConstant: public db::dbRow { };
+// a diagnostic cached for a module, see getCachedDiagnostics
+struct mDiagnostic {
+    pSourceRange range;
+    std::string msg;
+    void read(const db::pStmt &row);
+};
 
 struct mMultipleDecl {
     typedef std::pair<db::pDB::oid, pSourceRange> locData;
@@ -49,19 +150,19 @@ public:
 
     typedef db::pDB::oid oid;
     typedef db::pDB::RowList RowList;
-    //typedef std::vector<model::mFunction> FunctionList;
-    //typedef std::vector<model::mClass> ClassList;
-    //typedef std::vector<model::mClassDecl> ClassDeclList;
-    //typedef std::vector<model::mConstant> ConstantList;
-    typedef db::pDB::RowList FunctionList;
-    typedef db::pDB::RowList ClassList;
-    typedef db::pDB::RowList ClassDeclList;
-    typedef db::pDB::RowList ConstantList;
-    typedef db::pDB::RowList UndeclList;
-    typedef db::pDB::RowList UnusedList;
+    typedef std::vector<model::mFunction> FunctionList;
+    typedef std::vector<model::mClass> ClassList;
+    typedef std::vector<model::mClassDecl> ClassDeclList;
+    typedef std::vector<model::mConstant> ConstantList;
+    typedef std::vector<model::mVarUse> UndeclList;
+    typedef std::vector<model::mFunctionVar> UnusedList;
     typedef std::vector<model::mMultipleDecl> MultipleDeclList;
+    typedef std::vector<model::mDiagnostic> DiagnosticList;
 
     typedef std::map<std::string, oid> IDMap;
+    typedef std::map<std::string, model::mSourceModule> SourceModuleMap;
+    // (dependency type, name), see defineDependency
+    typedef std::set<std::pair<int, std::string> > SymbolSet;
 
     // general
     enum {
@@ -107,31 +208,72 @@ public:
 
     // class relation types
     EXTENDS = 0,
-    IMPLEMENTS = 1
+    IMPLEMENTS = 1,
+
+    // dependency types
+    DEP_CLASS    = 0,
+    DEP_FUNCTION = 1,
+    DEP_CONSTANT = 2
 
     };
 
 private:
 
     db::pDB *db_;
-
+    pModelWriter *writer_;
+
+    // a read only model never creates tables, modules or namespaces
+    bool readOnly_;
+    // the db didn't have a model of this version when opened
+    bool fresh_;
+    // rows changed are recorded, see trackChanges
+    bool tracking_;
+    // modules with ids up to this are from the model layer, see
+    // attachLayer. NULLID if there isn't one
+    oid layerModules_;
+
+    // symbol lookups go here rather than to the db. readers share the
+    // index of the model they were opened from
+    pSymbolIndex *index_;
+    bool ownIndex_;
+
+    // guards the caches below, which are filled in by const methods and
+    // may be used from several threads
+    mutable pMutex cacheLock_;
     IDMap modules_;
     mutable IDMap namespaces_;
+    mutable std::map<oid, std::string> namespaceNames_;
+
+    // realpaths of modules invalidated by invalidateDependents
+    std::set<std::string> invalidated_;
 
+    // rows queued while batching, see beginBatch()
+    bool batching_;
+    db::pInsertBatch *classDeclBatch_;
+    db::pInsertBatch *functionVarBatch_;
+    db::pInsertBatch *varUseBatch_;
+    db::pInsertBatch *constantBatch_;
+    db::pInsertBatch *dependencyBatch_;
+    db::pInsertBatch *symbolBatch_;
+
+    void checkVersion();
     void makeTables();
+    void loadIndex();
+    void loadClassDeclIndex();
+    void resetClassModels(oid m_id);
+    bool inheritsFrom(oid c_id, oid ancestor_id) const;
 
 public:
 
-    pModel(sqlite3 *db, bool trace=false): db_(0) {
-        db_ = new db::pDB(db, trace);
-        makeTables();
-    }
-
-    ~pModel() {
-        delete db_;
-    }
+    // if shareIndex is given, this model uses its symbol index instead of
+    // loading its own. it must outlive this model
+    pModel(sqlite3 *db, bool trace=false, bool readOnly=false, const pModel *shareIndex=NULL);
+    ~pModel();
 
     void setTrace(bool trace) { if (db_) db_->setTrace(trace); }
+    bool trace(void) const { return db_ && db_->trace(); }
+    bool readOnly(void) const { return readOnly_; }
+    sqlite3* db(void) const { return db_ ? db_->db() : NULL; }
 
     void commit() {
         if (db_) db_->commit();
@@ -141,29 +283,100 @@ public:
         if (db_) db_->begin();
     }
 
+    // if set, ModelBuilder submits its records here instead of writing
+    // them to the model directly
+    void setWriter(pModelWriter *writer) { writer_ = writer; }
+    pModelWriter* writer() const { return writer_; }
+
+    // while batching, class decls, function vars, undeclared uses and
+    // constants aren't inserted as they're defined but queued, and
+    // flushBatch() inserts them many rows to a statement. the strings
+    // passed to define must stay alive until then
+    void beginBatch(void) { batching_ = true; }
+    void flushBatch(void);
+
     // DEFINE, MUTATE
     oid getSourceModuleOID(pStringRef realPath, pStringRef hash="", bool deleteFirst=false);
+    void setSourceModuleCost(oid m_id, pUInt tokens, pUInt nodes);
+    // the size and modification time of the file the module was built from
+    void setSourceModuleStat(oid m_id, pUInt size, pUInt mtime);
+    // an empty hash leaves the module dirty
+    void setSourceModuleHash(pStringRef realPath, pStringRef hash);
+
+    // values in the corvus table, empty if not set
+    std::string getMeta(pStringRef key) const;
+    void setMeta(pStringRef key, pStringRef val);
+
+    // from here on, the rows inserted, updated or deleted are recorded so
+    // that saveChanges can write only those back to the file the model was
+    // loaded from. false, and nothing is recorded, if the db didn't have a
+    // model of this version to begin with, since then it all has to be saved
+    bool trackChanges(void);
+    bool tracking(void) const { return tracking_; }
+    // rows changed since trackChanges or the last saveChanges
+    std::size_t changeCount(void) const;
+    // write the changed rows to the model db at path, in one transaction.
+    // false if that fails, in which case the file is left as it was
+    bool saveChanges(pStringRef path);
+
+    // a prebuilt model db, e.g. of the base stubs and vendor code, can be
+    // layered under this model rather than built into it. the layer's rows
+    // are copied in before any of the model's own are made, so their ids
+    // never overlap, and lookups find both. the layer is read only: its
+    // modules are never rebuilt or invalidated, and dropLayer takes its rows
+    // out again before the model is saved. the model is emptied if it was
+    // built on another layer, or none. call before anything else. false if
+    // the layer isn't a model db of this version
+    bool attachLayer(pStringRef path);
+    bool layered(void) const { return layerModules_ != NULLID; }
+    // the model is done with after this, see attachLayer
+    void dropLayer(void);
     oid defineClass(oid ns_id, oid m_id, pStringRef name, int type, int extends_count, int implements_count,
                     pStringRef extends, pStringRef implements, pSourceRange range);
     void defineClassDecl(oid c_id, pStringRef name, int type, int flags, int vis, pStringRef defaultVal, pSourceRange range);
     void defineClassRelation(oid lhs_c_id, int type, oid rhs_c_id);
+    bool hasClassRelation(oid lhs_c_id, int type, oid rhs_c_id) const;
     oid defineFunction(oid ns_id, oid m_id, oid c_id, pStringRef name,
                         int type, int flags, int vis, int minA, int maxA, pSourceRange range);
     void defineFunctionVar(oid f_id, pStringRef name,
                           int type, int flags, int datatype, int blockDepth, int branch, pStringRef datatype_obj,
                           pStringRef defaultVal,
-                          pSourceRange range);
-    void defineFunctionVarUse(oid f_id, int blockDepth, int branch, pStringRef name, pSourceRange range);
+                          pSourceRange range,
+                          int useCount=0, bool isRedecl=false, bool multiDecl=false);
+    // a use of a function var which had no decl before it
+    void defineUndeclaredUse(oid f_id, pStringRef name, pSourceRange range);
 
     void defineConstant(oid m_id, pStringRef name, int type, pStringRef val, pSourceRange range);
     void defineConstant(oid m_id, oid ns_id, pStringRef name, int type, pStringRef val, pSourceRange range);
 
+    // the module defines, or refers to, a class, function or constant.
+    // name must be from dependencyName()
+    void defineSymbol(oid m_id, int type, pStringRef name);
+    void defineDependency(oid m_id, int type, pStringRef name);
+    // invalidate the modules depending on symbols, and in turn those
+    // depending on their classes. m_id is the module that changed
+    void invalidateDependents(oid m_id, const SymbolSet& symbols);
+    const std::set<std::string>& invalidated(void) const { return invalidated_; }
+    void clearInvalidated(void) { invalidated_.clear(); }
+
     void resolveClassRelations();
-    void resolveMultipleDecls(oid m_id);
     void refreshClassModel(pStringRef graphFileName="");
 
     // QUERY
     bool sourceModuleDirty(pStringRef realPath, pStringRef hash) const;
+    // NULLID if it isn't in the model
+    oid lookupSourceModule(pStringRef realPath) const;
+    // every module in the model, by realpath
+    void getSourceModules(SourceModuleMap& modules) const;
+    // adds what the module at realPath defines, see defineSymbol
+    void getModuleSymbols(pStringRef realPath, SymbolSet& symbols) const;
+    // for each module in realPaths, a hash of what defines the symbols it
+    // depends on as the model is now. empty if the module isn't in the model
+    void getDependencyFingerprints(const std::vector<std::string>& realPaths,
+                                   std::vector<std::string>& fingerprints) const;
+    // dependencies are by the last part of the name only, which may match
+    // more symbols than meant. that just costs an extra recheck
+    static std::string dependencyName(int type, pStringRef name);
     oid getNamespaceOID(pStringRef ns, bool create=false) const;
     std::string getNamespaceName(oid ns_id) const;
     oid getRootNamespaceOID() const {
@@ -183,6 +396,14 @@ public:
 
     ClassList getUnresolvedClasses() const;
     MultipleDeclList getMultipleDecls(oid m_id = pModel::NULLID) const;
+
+    // DIAGNOSTICS CACHE
+    // the diagnostics saved for the module, if they were saved when it had
+    // hash and its dependencies had fingerprint
+    bool getCachedDiagnostics(pStringRef realPath, pStringRef hash, pStringRef fingerprint,
+                              DiagnosticList& diags) const;
+    void setCachedDiagnostics(pStringRef realPath, pStringRef hash, pStringRef fingerprint,
+                              const DiagnosticList& diags);
     UndeclList getUndeclaredUses(oid m_id = pModel::NULLID) const;
     UnusedList getUnusedDecls(oid m_id = pModel::NULLID) const;
 
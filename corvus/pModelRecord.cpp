@@ -0,0 +1,342 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#include "corvus/pModelRecord.h"
+
+#include <assert.h>
+#include <algorithm>
+
+namespace corvus {
+
+namespace {
+
+// the first multiple decl of a name on one line of a function
+struct multiDecl {
+    const std::string *name;
+    pUInt line;
+    std::size_t op;
+};
+
+// the order getMultipleDecls returns them in
+bool multiDeclOrder(const multiDecl& a, const multiDecl& b) {
+    int c = a.name->compare(*b.name);
+    if (c)
+        return c < 0;
+    if (a.line != b.line)
+        return a.line < b.line;
+    return a.op < b.op;
+}
+
+}
+
+pModelRecord::op& pModelRecord::addOp(opKind kind, pSourceRange range) {
+
+    ops_.push_back(op());
+    op& o = ops_.back();
+    o.kind = kind;
+    o.ns_id = pModel::NULLID;
+    o.c_id = pModel::NULLID;
+    o.f_id = pModel::NULLID;
+    for (int i = 0; i < 5; ++i)
+        o.arg[i] = 0;
+    o.range = range;
+    o.uses = 0;
+    o.redecl = false;
+    o.multiDecl = false;
+    return o;
+
+}
+
+pModelRecord::oid pModelRecord::getNamespaceOID(pStringRef ns) {
+
+    std::map<std::string, oid>::iterator i = namespaceIDs_.find(ns);
+    if (i != namespaceIDs_.end())
+        return i->second;
+
+    namespaces_.push_back(ns);
+    oid result = namespaces_.size();
+    namespaceIDs_[ns] = result;
+    return result;
+
+}
+
+pModelRecord::oid pModelRecord::defineClass(oid ns_id, oid m_id, pStringRef name, int type,
+                                            int extends_count, int implements_count,
+                                            pStringRef extends, pStringRef implements,
+                                            pSourceRange range) {
+
+    assert(m_id == MODULE_ID);
+    op& o = addOp(CLASS, range);
+    o.ns_id = ns_id;
+    o.name = name;
+    o.str[0] = extends;
+    o.str[1] = implements;
+    o.arg[0] = type;
+    o.arg[1] = extends_count;
+    o.arg[2] = implements_count;
+    return ops_.size();
+
+}
+
+void pModelRecord::defineClassDecl(oid c_id, pStringRef name, int type, int flags, int vis,
+                                   pStringRef defaultVal, pSourceRange range) {
+
+    op& o = addOp(CLASS_DECL, range);
+    o.c_id = c_id;
+    o.name = name;
+    o.str[0] = defaultVal;
+    o.arg[0] = type;
+    o.arg[1] = flags;
+    o.arg[2] = vis;
+
+}
+
+pModelRecord::oid pModelRecord::defineFunction(oid ns_id, oid m_id, oid c_id, pStringRef name,
+                                               int type, int flags, int vis, int minA, int maxA,
+                                               pSourceRange range) {
+
+    assert(m_id == MODULE_ID);
+    op& o = addOp(FUNCTION, range);
+    o.ns_id = ns_id;
+    o.c_id = c_id;
+    o.name = name;
+    o.arg[0] = type;
+    o.arg[1] = flags;
+    o.arg[2] = vis;
+    o.arg[3] = minA;
+    o.arg[4] = maxA;
+    return ops_.size();
+
+}
+
+void pModelRecord::defineFunctionVar(oid f_id, pStringRef name,
+                                     int type, int flags, int datatype, int blockDepth, int branch,
+                                     pStringRef datatype_obj,
+                                     pStringRef defaultVal,
+                                     pSourceRange range) {
+
+    op& o = addOp(FUNCTION_VAR, range);
+    o.f_id = f_id;
+    o.name = name;
+    o.str[0] = datatype_obj;
+    o.str[1] = defaultVal;
+    o.arg[0] = type;
+    o.arg[1] = flags;
+    o.arg[2] = datatype;
+    o.arg[3] = blockDepth;
+    o.arg[4] = branch;
+
+    scopes_[f_id][o.name].push_back(ops_.size() - 1);
+
+}
+
+void pModelRecord::defineFunctionVarUse(oid f_id, int blockDepth, int branch, pStringRef name,
+                                        pSourceRange range) {
+
+    bool declared = false;
+
+    std::map<oid, scope>::iterator s = scopes_.find(f_id);
+    if (s != scopes_.end()) {
+        scope::iterator decls = s->second.find(name);
+        if (decls != s->second.end()) {
+            for (std::size_t i = 0; i < decls->second.size(); ++i) {
+                op& d = ops_[decls->second[i]];
+                if (d.range.startLine <= range.startLine && d.arg[3] <= blockDepth) {
+                    d.uses++;
+                    declared = true;
+                }
+            }
+        }
+    }
+
+    if (!declared) {
+        op& o = addOp(UNDECLARED_USE, range);
+        o.f_id = f_id;
+        o.name = name;
+    }
+
+}
+
+void pModelRecord::defineConstant(oid m_id, pStringRef name, int type, pStringRef val,
+                                  pSourceRange range) {
+
+    assert(m_id == MODULE_ID);
+    op& o = addOp(DEFINE_CONSTANT, range);
+    o.name = name;
+    o.str[0] = val;
+    o.arg[0] = type;
+
+}
+
+void pModelRecord::defineConstant(oid m_id, oid ns_id, pStringRef name, int type, pStringRef val,
+                                  pSourceRange range) {
+
+    assert(m_id == MODULE_ID);
+    op& o = addOp(NS_CONSTANT, range);
+    o.ns_id = ns_id;
+    o.name = name;
+    o.str[0] = val;
+    o.arg[0] = type;
+
+}
+
+void pModelRecord::defineDependency(int type, pStringRef name) {
+
+    if (!name.empty())
+        dependencies_.insert(std::make_pair(type, pModel::dependencyName(type, name)));
+
+}
+
+void pModelRecord::resolveMultipleDecls(oid m_id) {
+
+    assert(m_id == MODULE_ID);
+
+    std::vector<multiDecl> found;
+
+    for (std::map<oid, scope>::iterator s = scopes_.begin(); s != scopes_.end(); ++s) {
+        for (scope::iterator decls = s->second.begin(); decls != s->second.end(); ++decls) {
+
+            // a decl is a multiple if another in the same block depth and
+            // branch is on a different line
+            std::map<std::pair<int, int>, std::vector<std::size_t> > groups;
+            for (std::size_t i = 0; i < decls->second.size(); ++i) {
+                const op& d = ops_[decls->second[i]];
+                if (d.arg[2] == pModel::TYPE_NULL)
+                    continue;
+                groups[std::make_pair(d.arg[3], d.arg[4])].push_back(decls->second[i]);
+            }
+
+            for (std::map<std::pair<int, int>, std::vector<std::size_t> >::iterator g = groups.begin();
+                 g != groups.end();
+                 ++g) {
+                pUInt line = ops_[g->second[0]].range.startLine;
+                std::size_t i = 1;
+                while (i < g->second.size() && ops_[g->second[i]].range.startLine == line)
+                    i++;
+                if (i == g->second.size())
+                    continue;
+                for (i = 0; i < g->second.size(); ++i)
+                    ops_[g->second[i]].multiDecl = true;
+            }
+
+            std::map<pUInt, std::size_t> lines;
+            for (std::size_t i = 0; i < decls->second.size(); ++i) {
+                const op& d = ops_[decls->second[i]];
+                if (d.multiDecl && lines.find(d.range.startLine) == lines.end())
+                    lines[d.range.startLine] = decls->second[i];
+            }
+            for (std::map<pUInt, std::size_t>::iterator l = lines.begin(); l != lines.end(); ++l) {
+                multiDecl m;
+                m.name = &decls->first;
+                m.line = l->first;
+                m.op = l->second;
+                found.push_back(m);
+            }
+
+        }
+    }
+
+    std::sort(found.begin(), found.end(), multiDeclOrder);
+    for (std::size_t i = 1; i < found.size(); ++i) {
+        if (*found[i].name == *found[i-1].name)
+            ops_[found[i].op].redecl = true;
+    }
+
+}
+
+bool pModelRecord::apply(pModel* model) const {
+
+    if (!model->sourceModuleDirty(realPath_, hash_))
+        return false;
+
+    // what the module defined before it's deleted. modules depending on
+    // that or on what it defines now have to be looked at again
+    pModel::SymbolSet symbols;
+    model->getModuleSymbols(realPath_, symbols);
+    pModel::SymbolSet defined;
+
+    oid m_id = model->getSourceModuleOID(realPath_, hash_, true /* delete first */);
+    model->setSourceModuleCost(m_id, tokens_, nodes_);
+    model->setSourceModuleStat(m_id, size_, mtime_);
+
+    std::vector<oid> ns_ids(namespaces_.size());
+    for (std::size_t i = 0; i < namespaces_.size(); ++i)
+        ns_ids[i] = model->getNamespaceOID(namespaces_[i], true);
+
+    // model oids of the classes and functions defined so far, by op index
+    std::vector<oid> ids(ops_.size(), pModel::NULLID);
+
+    // the strings the batch holds on to are in ops_, which outlives it
+    model->beginBatch();
+
+#define NS_ID(o)   ((o).ns_id ? ns_ids[(o).ns_id-1] : static_cast<oid>(pModel::NULLID))
+#define OP_ID(id)  ((id) ? ids[(id)-1] : static_cast<oid>(pModel::NULLID))
+
+    for (std::size_t i = 0; i < ops_.size(); ++i) {
+        const op& o = ops_[i];
+        switch (o.kind) {
+        case CLASS:
+            ids[i] = model->defineClass(NS_ID(o), m_id, o.name, o.arg[0], o.arg[1], o.arg[2],
+                                        o.str[0], o.str[1], o.range);
+            defined.insert(std::make_pair((int)pModel::DEP_CLASS,
+                                          pModel::dependencyName(pModel::DEP_CLASS, o.name)));
+            break;
+        case CLASS_DECL:
+            model->defineClassDecl(OP_ID(o.c_id), o.name, o.arg[0], o.arg[1], o.arg[2],
+                                   o.str[0], o.range);
+            break;
+        case FUNCTION:
+            ids[i] = model->defineFunction(NS_ID(o), m_id, OP_ID(o.c_id), o.name,
+                                           o.arg[0], o.arg[1], o.arg[2], o.arg[3], o.arg[4],
+                                           o.range);
+            // methods are reached through their class
+            if (!o.c_id && o.arg[0] != pModel::TOP_LEVEL)
+                defined.insert(std::make_pair((int)pModel::DEP_FUNCTION,
+                                              pModel::dependencyName(pModel::DEP_FUNCTION, o.name)));
+            break;
+        case FUNCTION_VAR:
+            model->defineFunctionVar(OP_ID(o.f_id), o.name, o.arg[0], o.arg[1], o.arg[2],
+                                     o.arg[3], o.arg[4], o.str[0], o.str[1], o.range,
+                                     o.uses, o.redecl, o.multiDecl);
+            break;
+        case UNDECLARED_USE:
+            model->defineUndeclaredUse(OP_ID(o.f_id), o.name, o.range);
+            break;
+        case DEFINE_CONSTANT:
+            model->defineConstant(m_id, o.name, o.arg[0], o.str[0], o.range);
+            defined.insert(std::make_pair((int)pModel::DEP_CONSTANT,
+                                          pModel::dependencyName(pModel::DEP_CONSTANT, o.name)));
+            break;
+        case NS_CONSTANT:
+            model->defineConstant(m_id, NS_ID(o), o.name, o.arg[0], o.str[0], o.range);
+            defined.insert(std::make_pair((int)pModel::DEP_CONSTANT,
+                                          pModel::dependencyName(pModel::DEP_CONSTANT, o.name)));
+            break;
+        }
+    }
+
+#undef NS_ID
+#undef OP_ID
+
+    for (pModel::SymbolSet::const_iterator d = defined.begin(); d != defined.end(); ++d)
+        model->defineSymbol(m_id, d->first, d->second);
+    for (pModel::SymbolSet::const_iterator d = dependencies_.begin(); d != dependencies_.end(); ++d)
+        model->defineDependency(m_id, d->first, d->second);
+
+    model->flushBatch();
+
+    symbols.insert(defined.begin(), defined.end());
+    model->invalidateDependents(m_id, symbols);
+
+    return true;
+
+}
+
+} // namespace
@@ -0,0 +1,144 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#ifndef COR_PMODELRECORD_H_
+#define COR_PMODELRECORD_H_
+
+#include "corvus/pTypes.h"
+#include "corvus/pModel.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace corvus {
+
+// the model definitions for a single source module. ModelBuilder fills this
+// in on the worker thread that parsed the module, without touching the
+// database, and the model writer later applies it to the model in the same
+// order the definitions were made.
+//
+// the define methods mirror those in pModel, but the oids they take and
+// return are local to the record. they are mapped to model oids by apply()
+//
+// function var uses and redeclarations are resolved here as they're
+// defined, against a table of the decls seen so far in each function, so
+// only the results (use counts, redecl flags and undeclared uses) go to
+// the model
+class pModelRecord {
+public:
+    typedef pModel::oid oid;
+
+private:
+
+    enum opKind {
+        CLASS,
+        CLASS_DECL,
+        FUNCTION,
+        FUNCTION_VAR,
+        UNDECLARED_USE,
+        DEFINE_CONSTANT,
+        NS_CONSTANT
+    };
+
+    // one define call. ns_id, c_id and f_id are local oids. which of
+    // the string and int arguments are used depends on kind, see apply()
+    struct op {
+        opKind kind;
+        oid ns_id;
+        oid c_id;
+        oid f_id;
+        std::string name;
+        std::string str[3];
+        int arg[5];
+        pSourceRange range;
+        // FUNCTION_VAR only
+        int uses;
+        bool redecl;
+        bool multiDecl;
+    };
+
+    // the FUNCTION_VAR ops of one function, by name, in the order defined
+    typedef std::map<std::string, std::vector<std::size_t> > scope;
+
+    std::string realPath_;
+    std::string hash_;
+    pUInt tokens_;
+    pUInt nodes_;
+    pUInt size_;
+    pUInt mtime_;
+
+    std::vector<std::string> namespaces_;
+    std::map<std::string, oid> namespaceIDs_;
+    std::vector<op> ops_;
+    std::map<oid, scope> scopes_;
+    pModel::SymbolSet dependencies_;
+
+    op& addOp(opKind kind, pSourceRange range);
+
+public:
+
+    // the local oid of the source module the record is for
+    enum { MODULE_ID = 1 };
+
+    pModelRecord(pStringRef realPath, pStringRef hash):
+        realPath_(realPath), hash_(hash), tokens_(0), nodes_(0), size_(0), mtime_(0) { }
+
+    const std::string& realPath(void) const { return realPath_; }
+    const std::string& hash(void) const { return hash_; }
+    std::size_t size(void) const { return ops_.size(); }
+
+    // stored with the module to estimate the work it takes next run
+    void setCost(pUInt tokens, pUInt nodes) { tokens_ = tokens; nodes_ = nodes; }
+    // of the file, so it can be skipped next run if it's unchanged
+    void setStat(pUInt size, pUInt mtime) { size_ = size; mtime_ = mtime; }
+
+    oid getNamespaceOID(pStringRef ns);
+    oid getRootNamespaceOID(void) { return getNamespaceOID("\\"); }
+
+    oid defineClass(oid ns_id, oid m_id, pStringRef name, int type, int extends_count, int implements_count,
+                    pStringRef extends, pStringRef implements, pSourceRange range);
+    void defineClassDecl(oid c_id, pStringRef name, int type, int flags, int vis, pStringRef defaultVal, pSourceRange range);
+    oid defineFunction(oid ns_id, oid m_id, oid c_id, pStringRef name,
+                        int type, int flags, int vis, int minA, int maxA, pSourceRange range);
+    void defineFunctionVar(oid f_id, pStringRef name,
+                          int type, int flags, int datatype, int blockDepth, int branch, pStringRef datatype_obj,
+                          pStringRef defaultVal,
+                          pSourceRange range);
+    // counts a use against every decl of name so far in the function at or
+    // above blockDepth, starting on or before the use's line. if there are
+    // none, it's recorded as an undeclared use
+    void defineFunctionVarUse(oid f_id, int blockDepth, int branch, pStringRef name, pSourceRange range);
+
+    void defineConstant(oid m_id, pStringRef name, int type, pStringRef val, pSourceRange range);
+    void defineConstant(oid m_id, oid ns_id, pStringRef name, int type, pStringRef val, pSourceRange range);
+
+    // the module refers to a class, function or constant by name. these are
+    // kept once each, and written with the module's definitions
+    void defineDependency(int type, pStringRef name);
+
+    // flags the decls which are one of several of a symbol in the same
+    // function, block depth and branch, ignoring those set to null. of
+    // these, all but the first of each name in the module are redecls,
+    // which aren't checked for use. call when the module is done
+    void resolveMultipleDecls(oid m_id);
+
+    // write the record to the model. if the module is already in the model
+    // with the same hash, nothing is written and false is returned.
+    // otherwise the modules depending on what it defined before or defines
+    // now are invalidated, see pModel::invalidateDependents.
+    // the caller handles transactions
+    bool apply(pModel* model) const;
+
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,218 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#include "corvus/pModelWriter.h"
+#include "corvus/pModelRecord.h"
+#include "corvus/pModel.h"
+#include "corvus/pTime.h"
+
+#include <iostream>
+#include <exception>
+
+namespace corvus {
+
+pModelWriter::pModelWriter(pModel *model, std::size_t capacity):
+    model_(model),
+    capacity_(capacity ? capacity : 1),
+    base_(0),
+    ready_(0),
+    finished_(false),
+    running_(false),
+    submitted_(0),
+    written_(0),
+    maxDepth_(0),
+    submitStall_(0),
+    writerIdle_(0),
+    writeTime_(0)
+{
+}
+
+pModelWriter::~pModelWriter(void) {
+    finish();
+}
+
+void pModelWriter::start(void) {
+
+    if (running_)
+        return;
+    finished_ = false;
+    running_ = (pthread_create(&thread_, NULL, writerMain, this) == 0);
+
+}
+
+void pModelWriter::write(pModelRecord *r) {
+
+    double start = now();
+    try {
+        model_->begin();
+        if (r->apply(model_))
+            written_++;
+        model_->commit();
+    }
+    catch (std::exception& e) {
+        std::cerr << e.what() << std::endl;
+    }
+    writeTime_ += now() - start;
+    delete r;
+
+}
+
+// lock_ must be held
+pModelRecord* pModelWriter::popFront(void) {
+
+    slot s = slots_.front();
+    slots_.pop_front();
+    // modules may be freed before they're written, and the address reused
+    // by a module expected later, so only drop the mapping if it's ours
+    std::map<const pSourceModule*, std::size_t>::iterator i = seq_.find(s.module);
+    if (i != seq_.end() && i->second == base_)
+        seq_.erase(i);
+    base_++;
+    if (s.done)
+        ready_--;
+    notFull_.broadcast();
+    return s.record;
+
+}
+
+void pModelWriter::expect(const std::vector<pSourceModule*>& modules) {
+
+    pScopedLock lock(lock_);
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        seq_[modules[i]] = base_ + slots_.size();
+        slots_.push_back(slot(modules[i]));
+    }
+
+}
+
+void pModelWriter::submit(const pSourceModule *m, pModelRecord *r) {
+
+    pScopedLock lock(lock_);
+    submitted_++;
+
+    std::map<const pSourceModule*, std::size_t>::iterator i = seq_.find(m);
+    if (i != seq_.end()) {
+        slot& s = slots_[i->second - base_];
+        delete s.record;
+        s.record = r;
+    }
+    else {
+        // not expected, it goes last and is ready as soon as it arrives
+        slots_.push_back(slot(NULL));
+        slots_.back().record = r;
+        slots_.back().started = true;
+        slots_.back().done = true;
+        ready_++;
+        if (frontDone())
+            frontDone_.signal();
+    }
+
+}
+
+void pModelWriter::started(const pSourceModule *m) {
+
+    pScopedLock lock(lock_);
+
+    std::map<const pSourceModule*, std::size_t>::iterator i = seq_.find(m);
+    if (i != seq_.end())
+        slots_[i->second - base_].started = true;
+
+}
+
+void pModelWriter::done(const pSourceModule *m) {
+
+    pScopedLock lock(lock_);
+
+    std::map<const pSourceModule*, std::size_t>::iterator i = seq_.find(m);
+    if (i == seq_.end())
+        return;
+
+    slot& s = slots_[i->second - base_];
+    s.started = true;
+    s.done = true;
+    ready_++;
+    if (ready_ > maxDepth_)
+        maxDepth_ = ready_;
+
+    if (!running_) {
+        // no writer thread, we write whatever is next in line ourselves
+        while (frontDone()) {
+            pModelRecord *r = popFront();
+            if (r)
+                write(r);
+        }
+        return;
+    }
+
+    if (frontDone())
+        frontDone_.signal();
+
+    // backpressure. whoever is working on the module at the front of the
+    // line isn't waiting here, and once it's done the writer takes it, so
+    // this can't deadlock
+    if (ready_ > capacity_ && frontStarted()) {
+        double start = now();
+        while (ready_ > capacity_ && frontStarted())
+            notFull_.wait(lock_);
+        submitStall_ += now() - start;
+    }
+
+}
+
+void *pModelWriter::writerMain(void *arg) {
+
+    pModelWriter *w = static_cast<pModelWriter*>(arg);
+
+    while (true) {
+        pModelRecord *r;
+        {
+            pScopedLock lock(w->lock_);
+            if (!w->frontDone() && !w->finished_) {
+                double start = now();
+                while (!w->frontDone() && !w->finished_)
+                    w->frontDone_.wait(w->lock_);
+                w->writerIdle_ += now() - start;
+            }
+            if (!w->frontDone())
+                break;
+            r = w->popFront();
+        }
+        if (r)
+            w->write(r);
+    }
+
+    return NULL;
+
+}
+
+void pModelWriter::finish(void) {
+
+    if (running_) {
+        {
+            pScopedLock lock(lock_);
+            finished_ = true;
+            frontDone_.signal();
+        }
+        pthread_join(thread_, NULL);
+        running_ = false;
+    }
+
+    // anything left was submitted by a module that never reported done,
+    // write it in order anyway
+    pScopedLock lock(lock_);
+    while (!slots_.empty()) {
+        pModelRecord *r = popFront();
+        if (r)
+            write(r);
+    }
+
+}
+
+} // namespace
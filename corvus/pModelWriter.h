@@ -0,0 +1,125 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#ifndef COR_PMODELWRITER_H_
+#define COR_PMODELWRITER_H_
+
+#include "corvus/pThreadPool.h"
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <cstddef>
+
+namespace corvus {
+
+class pModel;
+class pModelRecord;
+class pSourceModule;
+
+// sqlite only allows a single writer, so rather than have the parse workers
+// take turns with the model, they submit model records to a bounded queue
+// which is drained by a single writer thread. each record is applied in its
+// own transaction.
+//
+// records are written in the order the modules were given to expect(), not
+// the order they happen to finish in, so the model (and its oids) come out
+// the same regardless of the number of workers. when too many finished
+// modules are waiting on the writer, done() blocks, which keeps the number of
+// records held in memory (and the workers ahead of the writer) in check.
+// it only blocks while the module next in line is being worked on, since
+// otherwise nothing may be left to unblock it
+class pModelWriter {
+
+    struct slot {
+        const pSourceModule *module;
+        pModelRecord *record;
+        bool started;
+        bool done;
+        slot(const pSourceModule *m): module(m), record(0), started(false), done(false) { }
+    };
+
+    pModel *model_;
+    std::size_t capacity_;
+
+    // slots_ holds the modules from base_ onward, in write order
+    std::deque<slot> slots_;
+    std::size_t base_;
+    std::map<const pSourceModule*, std::size_t> seq_;
+    // slots which are done but not yet written
+    std::size_t ready_;
+
+    pMutex lock_;
+    pCondition frontDone_;
+    pCondition notFull_;
+    bool finished_;
+
+    pthread_t thread_;
+    bool running_;
+
+    // stats
+    std::size_t submitted_;
+    std::size_t written_;
+    std::size_t maxDepth_;
+    double submitStall_;
+    double writerIdle_;
+    double writeTime_;
+
+    pModelWriter(const pModelWriter&);
+    pModelWriter& operator=(const pModelWriter&);
+
+    static void *writerMain(void *arg);
+    void write(pModelRecord *r);
+    bool frontDone(void) const { return !slots_.empty() && slots_.front().done; }
+    bool frontStarted(void) const { return !slots_.empty() && slots_.front().started; }
+    pModelRecord* popFront(void);
+
+public:
+
+    pModelWriter(pModel *model, std::size_t capacity);
+    ~pModelWriter(void);
+
+    // start the writer thread. if it can't be started, records are written
+    // by the thread that calls done()
+    void start(void);
+
+    // the modules about to be run, in the order their records should be
+    // written. may be called more than once, later modules go after
+    void expect(const std::vector<pSourceModule*>& modules);
+
+    // takes ownership of the record for module m. may be called from any
+    // thread. a module which wasn't expected is written after all others
+    void submit(const pSourceModule *m, pModelRecord *r);
+
+    // m is about to be worked on
+    void started(const pSourceModule *m);
+
+    // m has finished its passes, whether or not it submitted a record
+    void done(const pSourceModule *m);
+
+    // wait for the queue to drain and stop the writer thread
+    void finish(void);
+
+    std::size_t capacity(void) const { return capacity_; }
+    std::size_t submitted(void) const { return submitted_; }
+    std::size_t written(void) const { return written_; }
+    std::size_t maxDepth(void) const { return maxDepth_; }
+    // seconds workers spent blocked on a full queue
+    double submitStall(void) const { return submitStall_; }
+    // seconds the writer spent waiting on the next module
+    double writerIdle(void) const { return writerIdle_; }
+    // seconds the writer spent writing
+    double writeTime(void) const { return writeTime_; }
+
+};
+
+} // namespace
+
+#endif
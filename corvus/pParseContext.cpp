@@ -15,6 +15,7 @@
 #include "corvus/pParseError.h"
 #include "corvus/pSourceLoc.h"
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -22,30 +23,28 @@ namespace corvus {
 
 namespace AST {
 
-pSourceRange pParseContext::getRange(pSourceRef* r) {
-    // find the closest newline to the left of r->begin, without underrunning
-    // the buffer
-    pSourceCharIterator bufBegin = owner_->source()->contents()->getBufferStart();
-    pSourceCharIterator i = r->begin();
-    while (i != bufBegin && *i != '\n')
-        i--;
-
-    pSourceRange rg;
-    rg.startCol = r->begin()-i;
-    rg.endCol = r->end()-i;
-    lineNumMapType::const_iterator il = tokenLineInfo_.find(r);
-    if (il != tokenLineInfo_.end()) {
-        rg.startLine = (*il).second;
-        rg.endLine = rg.startLine;
-    }
-    return rg;
+pSourceSpan pParseContext::getSpan(const pToken* t) const {
+    return t ? t->span() : lastToken_->span();
+}
+
+pSourceRef pParseContext::getText(const pToken* t) const {
+    return pSourceRef(owner_->source()->contents()->getBufferStart()+t->offset, t->length);
+}
+
+pSourceSpan pParseContext::currentLine(void) const {
+    // tokens are contiguous, so the current one starts where the last ended
+    return pSourceSpan::line(lastToken_->offset+lastToken_->length);
+}
+
+pSourceRange pParseContext::getRange(const pSourceSpan& span) const {
+    return owner_->source()->range(span);
 }
 
 void pParseContext::parseError(pStringRef msg, const pSourceRange& range) {
     throw pParseError(msg, pSourceLoc(owner_, range));
 }
 
-void pParseContext::parseError(pSourceRef* r, const pSourceRange& range) {
+void pParseContext::parseError(const pToken* t, const pSourceRange& range) {
 
 
     // show the line the error occured on
@@ -56,32 +55,37 @@ void pParseContext::parseError(pSourceRef* r, const pSourceRange& range) {
     std::stringstream errorMsg;
 
     assert(lastToken_);
+    pSourceRef last(getText(lastToken_));
 
     // this only happens when there's a parse error due to a non matching production where
     // lastToken_ that caused the no-match is the last token in the script
-    // in this case, r is null and is called from lemon. we call error again with lastToken
+    // in this case, t is null and is called from lemon. we call error again with lastToken
     // as the parseError
     bool endOfSource(false);
-    if (lastToken_->end() == owner_->source()->contents()->getBufferEnd())
+    if (last.end() == owner_->source()->contents()->getBufferEnd())
         endOfSource = true;
 
-    if (r) {
-        probsize = (*r).end()-(*r).begin();
-        problem.append((*r).begin(), (*r).end());
+    if (t) {
+        probsize = t->length;
+        problem = getText(t).str();
     }
     else {
         if (endOfSource) {
             probsize = 0;
-            problem.append(lastToken_->begin(), lastToken_->end());
+            problem.append(last.begin(), last.end());
         }
         else {
             probsize = 1;
-            problem.append(lastToken_->end(), lastToken_->end()+1);
+            problem.append(last.end(), last.end()+1);
         }
     }
 
-    pSourceCharIterator eLineStart(lastNewline_+1);
-    pSourceCharIterator eLineStop(lastToken_->end()+probsize);
+    // the start of the line the last token ends on
+    pSourceCharIterator bufBegin = owner_->source()->contents()->getBufferStart();
+    const std::vector<pUInt>& starts = owner_->source()->lineStarts();
+    pSourceCharIterator eLineStart(bufBegin +
+            *(std::upper_bound(starts.begin(), starts.end(), last.end()-bufBegin) - 1));
+    pSourceCharIterator eLineStop(last.end()+probsize);
 
     // try to take eLineStop to next new line
     if (eLineStop < owner_->source()->contents()->getBufferEnd()) {
@@ -108,7 +112,7 @@ void pParseContext::parseError(pSourceRef* r, const pSourceRange& range) {
                 errorLine[i] = ' ';
         }
         errorMsg << errorLine << std::endl;
-        errorMsg << std::string((lastToken_->end()+1)-(lastNewline_+1)-1,' ') << "^" << std::endl;
+        errorMsg << std::string((lastToken_->end()+1)-eLineStart-1,' ') << "^" << std::endl;
     }
 
     throw pParseError(errorMsg.str(), pSourceLoc(owner_, range));
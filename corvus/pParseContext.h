@@ -15,7 +15,6 @@
 
 #include <llvm/Support/Allocator.h>
 #include <llvm/Support/StringPool.h>
-#include <boost/unordered_map.hpp>
 
 
 namespace corvus {
@@ -25,12 +24,7 @@ class pSourceModule;
 namespace AST {
 class pParseContext {
 private:
-    typedef boost::unordered_map<const pSourceRef*, pUInt> lineNumMapType;
-
-    pUInt currentLineNum_;
-    pSourceCharIterator lastNewline_;
-    const pSourceRef* lastToken_;
-    lineNumMapType tokenLineInfo_;
+    const pToken* lastToken_;
 
     /// Maintains memory of IR during entire analysis and code gen phases
     llvm::BumpPtrAllocator allocator_;
@@ -41,21 +35,25 @@ private:
     // owning source module
     const pSourceModule* owner_;
 
+    // rough measure of the work the module takes, see pSourceManager
+    pUInt tokenCount_;
+    pUInt nodeCount_;
+
 public:
 
     pParseContext(const pSourceModule* o):
-        currentLineNum_(0),
-        lastNewline_(),
         lastToken_(NULL),
-        tokenLineInfo_(),
         allocator_(),
         idPool_(),
-        owner_(o)
+        owner_(o),
+        tokenCount_(0),
+        nodeCount_(0)
         { }
 
     // MEMORY POOL
     llvm::BumpPtrAllocator& allocator(void) { return allocator_; }
     void *allocate(size_t size, size_t align = 8) {
+        ++nodeCount_;
         return allocator_.Allocate(size, align);
     }
     void deallocate(void* Ptr) {
@@ -66,26 +64,25 @@ public:
     llvm::StringPool& idPool(void) { return idPool_; }
 
     // PARSING
-    pSourceRange currentLineNum() const { return pSourceRange(currentLineNum_); }
-    void incLineNum(void) { ++currentLineNum_; }
-    void incLineNum(pUInt i) { currentLineNum_ +=i; }
+    // the token's offsets in the source. with no token, as at the end of
+    // input, the last token's
+    pSourceSpan getSpan(const pToken* t) const;
+    pSourceRef getText(const pToken* t) const;
+    // the line of the token being parsed, which follows the last one
+    pSourceSpan currentLine(void) const;
+    pSourceRange getRange(const pSourceSpan& span) const;
 
-    pSourceRange getRange(pSourceRef* r);
+    void setLastToken(const pToken* t) { lastToken_ = t; }
+    const pToken* lastToken(void) const { return lastToken_; }
 
-    void setLastNewline(pSourceCharIterator i) { lastNewline_ = i; }
-    const pSourceCharIterator& lastNewline(void) const { return lastNewline_; }
+    void countToken(void) { ++tokenCount_; }
 
-    void setLastToken(const pSourceRef* i) { lastToken_ = i; }
-    const pSourceRef* lastToken(void) const { return lastToken_; }
-
-    void setTokenLine(const pSourceRef* t) {
-        tokenLineInfo_[t] = currentLineNum_;
-    }
+    // tokens lexed and AST allocations made during the parse
+    pUInt tokenCount(void) const { return tokenCount_; }
+    pUInt nodeCount(void) const { return nodeCount_; }
 
     void finishParse(void) {
-        currentLineNum_ = 0;
         lastToken_ = NULL;
-        tokenLineInfo_.clear();
     }
 
     const pSourceModule* getOwner(void) const {
@@ -93,7 +90,7 @@ public:
     }
 
     // PARSE ERROR HANDLER
-    void parseError(pSourceRef* r, const pSourceRange& range);
+    void parseError(const pToken* t, const pSourceRange& range);
     void parseError(pStringRef msg, const pSourceRange& range);
 
 };
@@ -17,9 +17,14 @@ namespace corvus {
 
 class pSourceModule;
 
+namespace lexer {
+class pTokenStream;
+}
+
 namespace parser {
 
-void parseSourceFile(pSourceModule* pMod, bool debug);
+// tokens is lexed into, and is only needed for the length of the parse
+void parseSourceFile(pSourceModule* pMod, lexer::pTokenStream& tokens, bool debug);
 
 } } // namespace
 
@@ -23,13 +23,17 @@ const char* pPass::nodeDescTable_[] = {
 
 pDiagnostic *pPass::addDiagnostic(AST::stmt* s, pStringRef msg) {
     // the module takes ownership of this
-    pSourceLoc loc(module_, s->range());
+    pSourceLoc loc(module_, range(s));
     pDiagnostic *d = new pDiagnostic(loc,
                                      msg);
     module_->addDiagnostic(d);
     return d;
 }
 
+pSourceRange pPass::range(const AST::stmt* s) const {
+    return module_->source()->range(s->span());
+}
+
 
 } } // namespace
 
@@ -13,6 +13,7 @@
 #define COR_PPASS_H_
 
 #include <string>
+#include <iostream>
 #include "corvus/pSourceModule.h"
 #include "corvus/pModel.h"
 
@@ -33,11 +34,12 @@ protected:
     bool aborted_;
     pSourceModule* module_;
     pModel* model_;
+    std::ostream* out_;
 
     static const char* nodeDescTable_[];
 public:
 
-    pPass(const char* n, const char* d): passName_(n), passDesc_(d), model_(0), aborted_(false) { }
+    pPass(const char* n, const char* d): passName_(n), passDesc_(d), model_(0), out_(&std::cout), aborted_(false) { }
 
     virtual ~pPass(void) { }
 
@@ -49,6 +51,10 @@ public:
 
     void setModel(pModel* m) { model_ = m; }
 
+    // where passes that produce output (e.g. PrintAST) should write it
+    void setOutputStream(std::ostream* o) { out_ = o; }
+    std::ostream& out(void) { return *out_; }
+
     void do_pre_run(pSourceModule *mod) { module_ = mod; pre_run(); module_ = NULL; }
     void do_run(pSourceModule *mod) { module_ = mod; run(); module_ = NULL; }
     void do_post_run(pSourceModule *mod) { module_ = mod; post_run(); module_ = NULL; }
@@ -59,6 +65,9 @@ public:
 
     pDiagnostic *addDiagnostic(AST::stmt*, pStringRef msg);
 
+    // the node's lines and columns in the module's source
+    pSourceRange range(const AST::stmt* s) const;
+
 };
 
 
@@ -12,8 +12,16 @@
 #include "corvus/pPass.h"
 #include "corvus/pSourceModule.h"
 
+#include <iostream>
+#include <assert.h>
+
 namespace corvus {
 
+pPassManager::pPassManager(pModel *m): passQueue_(),
+    factoryList_(),
+    model_(m),
+    logStream_(&std::cerr) { }
+
 pPassManager::~pPassManager(void) {
 
     // free passes
@@ -31,7 +39,7 @@ void pPassManager::run(pSourceModule* mod, int verbosity) {
          i != passQueue_.end();
          ++i) {
         if (verbosity > 1) {
-            std::cerr << "running pass [" << (*i)->name().str() << "] on " << mod->fileName() << std::endl;
+            *logStream_ << "running pass [" << (*i)->name().str() << "] on " << mod->fileName() << std::endl;
         }
         (*i)->do_pre_run(mod);
         if ((*i)->aborted())
@@ -43,9 +51,33 @@ void pPassManager::run(pSourceModule* mod, int verbosity) {
     }
 }
 
-void pPassManager::addPass(AST::pPass* p) {
+void pPassManager::addPass(AST::pPass* p, passFactory f) {
     p->setModel(model_);
     passQueue_.push_back(p);
+    factoryList_.push_back(f);
+}
+
+pPassManager* pPassManager::clone(pModel *m) const {
+
+    pPassManager* result = new pPassManager(m);
+    for (factoryListType::const_iterator i = factoryList_.begin();
+         i != factoryList_.end();
+         ++i) {
+        assert(*i && "pass can't be cloned");
+        result->addPass((*i)(), *i);
+    }
+    return result;
+
+}
+
+void pPassManager::setOutputStream(std::ostream *o) {
+
+    for (queueType::iterator i = passQueue_.begin();
+         i != passQueue_.end();
+         ++i) {
+        (*i)->setOutputStream(o);
+    }
+
 }
 
 
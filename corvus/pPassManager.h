@@ -12,6 +12,7 @@
 #define COR_PPASSMANAGER_H_
 
 #include <vector>
+#include <ostream>
 
 namespace corvus {
 
@@ -25,29 +26,51 @@ class pPass;
 class pPassManager {
 public:
     typedef std::vector<AST::pPass*> queueType;
+    typedef AST::pPass* (*passFactory)(void);
+    typedef std::vector<passFactory> factoryListType;
 
 private:
 
     queueType passQueue_;
+    // parallel to passQueue_, so we can make fresh copies of the passes
+    // for other threads. NULL if a pass was added by pointer.
+    factoryListType factoryList_;
     pModel *model_;
+    std::ostream *logStream_;
 
     // no copy constructor
     pPassManager(const pPassManager&);
 
+    template <typename PassType>
+    static AST::pPass* createPass(void) {
+        return new PassType();
+    }
+
+    void addPass(AST::pPass* p, passFactory f);
+
 public:
 
-    pPassManager(pModel *m): model_(m), passQueue_() { }
+    pPassManager(pModel *m);
     ~pPassManager(void);
 
-    /// add a pass. takes ownership.
-    void addPass(AST::pPass* p);
+    /// add a pass. takes ownership. passes added this way can't be cloned.
+    void addPass(AST::pPass* p) { addPass(p, NULL); }
 
     template <typename PassType>
     void addPass(void) {
-        PassType* P = new PassType();
-        addPass(P);
+        addPass(createPass<PassType>(), &createPass<PassType>);
     }
 
+    bool empty(void) const { return passQueue_.empty(); }
+
+    /// a new pass manager with fresh instances of the same passes, for use
+    /// on another thread. caller owns.
+    pPassManager* clone(pModel *m) const;
+
+    /// output from the passes themselves, and from the manager (verbose)
+    void setOutputStream(std::ostream *o);
+    void setLogStream(std::ostream *o) { logStream_ = o; }
+
     void run(pSourceModule *mod, int verbosity);
 
 };
@@ -14,19 +14,175 @@
 
 #include <llvm/Support/system_error.h>
 
+#include "xxhash.h"
+
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define COR_SIMD_NEWLINES
+#endif
+
 
 namespace corvus { 
 
+namespace {
+
+void scalarNewlines(const char *base, const char *begin, const char *end,
+                    std::vector<pUInt>& result) {
+
+    for (const char *i = begin; (i = (const char*)memchr(i, '\n', end - i)); ++i)
+        result.push_back(i - base + 1);
+
+}
+
+#ifdef COR_SIMD_NEWLINES
+
+// compare a block at a time, then go through the bits of the mask that are
+// set. the tail is left to the scalar version
+
+__attribute__((target("sse2")))
+void sse2Newlines(const char *base, const char *begin, const char *end,
+                  std::vector<pUInt>& result) {
+
+    const __m128i nl = _mm_set1_epi8('\n');
+    const char *i = begin;
+    for (; end - i >= 16; i += 16) {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*)i), nl));
+        for (; mask; mask &= mask - 1)
+            result.push_back(i - base + __builtin_ctz(mask) + 1);
+    }
+    scalarNewlines(base, i, end, result);
+
+}
+
+__attribute__((target("avx2")))
+void avx2Newlines(const char *base, const char *begin, const char *end,
+                  std::vector<pUInt>& result) {
+
+    const __m256i nl = _mm256_set1_epi8('\n');
+    const char *i = begin;
+    for (; end - i >= 32; i += 32) {
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i*)i), nl));
+        for (; mask; mask &= mask - 1)
+            result.push_back(i - base + __builtin_ctz(mask) + 1);
+    }
+    scalarNewlines(base, i, end, result);
+
+}
+
+#endif
+
+}
+
 pSourceFile::pSourceFile(pStringRef file):
-    file_(file)
+    file_(file),
+    mtime_(0)
 {
 
+    struct stat st;
+    if (stat(file_.c_str(), &st) == 0)
+        mtime_ = st.st_mtime;
+
     if (llvm::MemoryBuffer::getFile(file, contents_)) {
         throw pParseError("couldn't open file [" + file_ + "]", pSourceLoc(file, 0, 0));
     }
     
 }
 
+std::string pSourceFile::hash(void) const {
+
+    unsigned long long h = xxh64(contents_->getBufferStart(), contents_->getBufferSize(), 0);
+    char result[17];
+    snprintf(result, sizeof(result), "%016llx", h);
+    return result;
+
+}
+
+bool pSourceFile::hasScan(newlineScan scan) {
+
+    switch (scan) {
+#ifdef COR_SIMD_NEWLINES
+        case SCAN_SSE2:
+            return __builtin_cpu_supports("sse2");
+        case SCAN_AVX2:
+            return __builtin_cpu_supports("avx2");
+#else
+        case SCAN_SSE2:
+        case SCAN_AVX2:
+            return false;
+#endif
+        default:
+            return true;
+    }
+
+}
+
+// a scan other than the best has to be one the cpu has, see hasScan
+void pSourceFile::findNewlines(const char *base, const char *begin, const char *end,
+                               std::vector<pUInt>& result, newlineScan scan) {
+
+    if (scan == SCAN_BEST)
+        scan = hasScan(SCAN_AVX2) ? SCAN_AVX2 : hasScan(SCAN_SSE2) ? SCAN_SSE2 : SCAN_SCALAR;
+
+#ifdef COR_SIMD_NEWLINES
+    if (scan == SCAN_AVX2)
+        avx2Newlines(base, begin, end, result);
+    else if (scan == SCAN_SSE2)
+        sse2Newlines(base, begin, end, result);
+    else
+#endif
+        scalarNewlines(base, begin, end, result);
+
+}
+
+namespace {
+
+// the line offset is on, and its column counted from the newline before it
+void position(const std::vector<pUInt>& starts, pUInt offset, pUInt& line, pUInt& col) {
+
+    std::size_t i = std::upper_bound(starts.begin(), starts.end(), offset) - starts.begin() - 1;
+    line = i + 1;
+    col = i ? offset - starts[i] + 1 : offset;
+
+}
+
+}
+
+pSourceRange pSourceFile::range(const pSourceSpan& span) const {
+
+    pSourceRange result;
+    if (span.begin == pSourceSpan::NONE)
+        return result;
+
+    const std::vector<pUInt>& starts = lineStarts();
+    pUInt col;
+    position(starts, span.begin & ~pSourceSpan::LINE_ONLY, result.startLine, col);
+    if (!(span.begin & pSourceSpan::LINE_ONLY))
+        result.startCol = col;
+    if (span.end != pSourceSpan::NONE)
+        position(starts, span.end, result.endLine, result.endCol);
+    return result;
+
+}
+
+const std::vector<pUInt>& pSourceFile::lineStarts(void) const {
+
+    if (lineStarts_.empty()) {
+        const char *begin = contents_->getBufferStart();
+        const char *end = contents_->getBufferEnd();
+        // a guess, to save most of the growing
+        lineStarts_.reserve((end - begin) / 32 + 1);
+        lineStarts_.push_back(0);
+        findNewlines(begin, begin, end, lineStarts_);
+    }
+    return lineStarts_;
+
+}
+
 
 } // namespace
 
@@ -14,6 +14,7 @@
 #include "corvus/pTypes.h"
 
 #include <string>
+#include <vector>
 #include <llvm/ADT/OwningPtr.h>
 #include <llvm/Support/MemoryBuffer.h>
 
@@ -24,6 +25,10 @@ class pSourceFile {
 private:
     std::string file_;
     llvm::OwningPtr<llvm::MemoryBuffer> contents_;
+    // as of just before the contents were read
+    pUInt mtime_;
+    // see lineStarts
+    mutable std::vector<pUInt> lineStarts_;
 
 public:
 
@@ -33,6 +38,30 @@ public:
         return file_;
     }
     const llvm::MemoryBuffer* contents(void) const { return contents_.get(); }
+    pUInt size(void) const { return contents_->getBufferSize(); }
+    pUInt mtime(void) const { return mtime_; }
+
+    // a hash of the contents, to tell whether they've changed. not for
+    // anything else, it isn't cryptographic
+    std::string hash(void) const;
+    // which hash function hash() uses, so hashes from another can be told apart
+    static const char* hashName(void) { return "xxh64"; }
+
+    // the offset each line starts at, the first being 0. it's built the
+    // first time it's asked for, by the thread that has the module
+    const std::vector<pUInt>& lineStarts(void) const;
+    // the line and column of each end of span, 1 based. columns on the first
+    // line are from 0, as they've always been
+    pSourceRange range(const pSourceSpan& span) const;
+
+    // ways of finding newlines. the best is the fastest the cpu has, the
+    // others are there so they can be tested against each other
+    enum newlineScan { SCAN_BEST, SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 };
+    // whether this cpu (and build) has it
+    static bool hasScan(newlineScan scan);
+    // appends the offset after each newline in [begin, end), relative to base
+    static void findNewlines(const char *base, const char *begin, const char *end,
+                             std::vector<pUInt>& result, newlineScan scan = SCAN_BEST);
 
 };
 
@@ -14,9 +14,12 @@
 #include "corvus/pSourceModule.h"
 #include "corvus/pPassManager.h"
 #include "corvus/pModel.h"
+#include "corvus/pModelWriter.h"
 #include "corvus/pFullModelChecker.h"
 #include "corvus/pParseError.h"
+#include "corvus/pSourceFile.h"
 #include "corvus/pDiagnostic.h"
+#include "corvus/pTime.h"
 
 #include "corvus/passes/PrintAST.h"
 #include "corvus/passes/DumpStats.h"
@@ -31,12 +34,23 @@
 #include <llvm/ADT/SmallVector.h>
 
 #include <sqlite3.h>
+#include <sys/stat.h>
 
+#include <iostream>
+#include <sstream>
+#include <algorithm>
 #include <stdlib.h>
 #include <assert.h>
 
 namespace corvus { 
 
+// number of include files parsed at a time
+static const std::size_t INCLUDE_BATCH_SIZE = 256;
+// model records allowed to wait for the model writer, per worker thread
+static const std::size_t MODEL_QUEUE_PER_THREAD = 4;
+// room to grow, on top of its size, in the mapping of a model used in place
+static const unsigned long long MODEL_MMAP_HEADROOM = 64 * 1024 * 1024;
+
 /*
  * http://www.sqlite.org/backup.html
  *
@@ -107,19 +121,17 @@ int loadOrSaveDb(sqlite3 *pInMemory, const char *zFilename, int isSave){
 
 pSourceManager::~pSourceManager() {
 
-    if (db_) {
-        if (!dbName_.empty()) {
-            log("flushing in memory db to: " + dbName_, 2);
-            int rc = loadOrSaveDb(db_, dbName_.c_str(), 1);
-            if (rc != SQLITE_OK) {
-                std::cerr << "failing saving in memory db!" << std::endl;
-            }
-        }
-        sqlite3_close(db_);
-    }
+    if (model_ && !dbName_.empty() && !modelOnDisk_)
+        saveModel();
 
-    if (model_)
+    // the model's statements have to be finalized before the db can close
+    if (model_) {
         delete model_;
+        model_ = NULL;
+    }
+
+    if (db_)
+        sqlite3_close(db_);
 
     for (ModuleListType::iterator i = moduleList_.begin();
          i != moduleList_.end();
@@ -133,6 +145,7 @@ void pSourceManager::configure(const pConfig& config) {
     std::vector<std::string> inputFiles;
 
     verbosity_ = config.verbosity;
+    jobs_ = config.jobs;
     debugParse_ = config.debugParse;
     debugModel_ = config.debugModel;
     debugDiags_ = config.debugDiags;
@@ -147,6 +160,27 @@ void pSourceManager::configure(const pConfig& config) {
         log("[config] setting db name: " + config.dbName);
         setModelDBName(config.dbName);
     }
+    if (config.dbOnDisk)
+        setModelOnDisk(true);
+    if (!config.modelLayer.empty()) {
+        log("[config] setting model layer: " + config.modelLayer);
+        setModelLayer(config.modelLayer);
+    }
+
+    // the model already has every other module, as of the last full run, so
+    // we skip the include dirs and input files and build and check just the
+    // diagnostic files against it. without a model to go on, we can't
+    if (config.diagFilesOnly && !config.diagFiles.empty()) {
+        struct stat st;
+        if (!dbName_.empty() && stat(dbName_.c_str(), &st) == 0) {
+            log("[config] only checking diagnostic files against the model");
+            diagFilesOnly_ = true;
+            for (unsigned i = 0; i != config.diagFiles.size(); ++i)
+                addSourceFile(config.diagFiles[i]);
+            return;
+        }
+        log("[config] no model db to check diagnostic files against, checking everything");
+    }
     if (!config.includePaths.empty()) {
         for (unsigned i = 0; i != config.includePaths.size(); ++i) {
             log("[config] adding include path: " + config.includePaths[i]);
@@ -238,38 +272,296 @@ void pSourceManager::addSourceDir(pStringRef name, pStringRef exts) {
 
 }
 
-void pSourceManager::runPasses(pPassManager *pm) {
+namespace {
 
-    for (ModuleListType::iterator i = moduleList_.begin();
-         i != moduleList_.end();
-         i++) {
+// output produced while working on a module. it's buffered so that it can
+// be written in module order regardless of which thread produced it
+struct moduleOutput {
+    std::stringstream out; // std::cout, e.g. PrintAST
+    std::stringstream log; // the source manager log stream
+    std::stringstream err; // std::cerr
+};
+
+// works out which modules the model already has as they are now. if the
+// file's size and mtime are those the module was built from we take it as
+// unchanged, otherwise it's hashed and unchanged if the hash is the same.
+// the hashing is done here, in parallel, rather than by ModelBuilder
+class dirtyJob: public pThreadPool::job {
+
+    const std::vector<pSourceModule*>& modules_;
+    const pModel::SourceModuleMap& known_;
+
+public:
+    enum { DIRTY, CLEAN, RESTAT /* clean but its stat changed */ };
+    std::vector<char> state;
+
+    dirtyJob(const std::vector<pSourceModule*>& modules,
+             const pModel::SourceModuleMap& known):
+        modules_(modules),
+        known_(known),
+        state(modules.size(), DIRTY) { }
+
+    void run(unsigned worker, std::size_t i) {
+
+        pSourceModule *m = modules_[i];
+        const pSourceFile *f = m->source();
+        pModel::SourceModuleMap::const_iterator k = known_.find(m->fileName());
+
+        // the layer is taken as it was built
+        if (k != known_.end() && k->second.layer) {
+            state[i] = CLEAN;
+            return;
+        }
+
+        if (k != known_.end() && k->second.mtime &&
+            f->mtime() == k->second.mtime && f->size() == k->second.size) {
+            state[i] = CLEAN;
+            return;
+        }
+
+        const std::string& hash = m->hash();
+        if (k != known_.end() && hash == k->second.hash)
+            state[i] = RESTAT;
+
+    }
+
+};
+
+// parse and run module local passes (i.e. those which don't touch the model)
+class moduleJob: public pThreadPool::job {
+
+    const std::vector<pSourceModule*>& modules_;
+    const std::vector<pPassManager*>& pms_;
+    // one per worker, reused for each module it parses
+    std::vector<lexer::pTokenStream> tokens_;
+    bool debugParse_;
+    bool include_;
+    int verbosity_;
+    std::ostream *logStream_;
+    pModelWriter *writer_;
+
+    moduleOutput *output_;
+    std::vector<char> done_;
+    std::size_t nextFlush_;
+    pMutex flushLock_;
+
+    void flush(std::size_t i) {
+        moduleOutput& o = output_[i];
+        if (logStream_)
+            *logStream_ << o.log.str();
+        std::cout << o.out.str();
+        std::cerr << o.err.str();
+        o.out.str("");
+        o.log.str("");
+        o.err.str("");
+    }
+
+    // write out everything that is finished, in order
+    void finished(std::size_t i) {
+        {
+            pScopedLock lock(flushLock_);
+            done_[i] = 1;
+            while (nextFlush_ < modules_.size() && done_[nextFlush_]) {
+                flush(nextFlush_);
+                nextFlush_++;
+            }
+        }
+        // this may block until the model writer catches up
+        if (writer_)
+            writer_->done(modules_[i]);
+    }
+
+public:
+    moduleJob(const std::vector<pSourceModule*>& modules,
+              const std::vector<pPassManager*>& pms,
+              bool debugParse,
+              bool include,
+              int verbosity,
+              std::ostream *logStream,
+              pModelWriter *writer):
+        modules_(modules),
+        pms_(pms),
+        tokens_(pms.size()),
+        debugParse_(debugParse),
+        include_(include),
+        verbosity_(verbosity),
+        logStream_(logStream),
+        writer_(writer),
+        output_(new moduleOutput[modules.size()]),
+        done_(modules.size(), 0),
+        nextFlush_(0) { }
+
+    ~moduleJob(void) { delete [] output_; }
+
+    void run(unsigned worker, std::size_t i) {
+
+        pSourceModule *m = modules_[i];
+        moduleOutput& o = output_[i];
+
+        if (writer_)
+            writer_->started(m);
 
         try {
-            if (verbosity_ > 1 && i->second->getAST()) {
-                log("parsing: " + i->second->fileName());
+            if (include_ && verbosity_ >= 1) {
+                o.log << "parsing include file: " << m->fileName() << std::endl;
+            }
+            else if (verbosity_ > 1 && m->getAST()) {
+                o.log << "parsing: " << m->fileName() << std::endl;
             }
             // this is idempotent
-            i->second->parse(debugParse_);
+            m->parse(tokens_[worker], debugParse_);
         }
         catch (pParseError& p) {
             // diag the parse error
-            i->second->addDiagnostic(new pDiagnostic(p.loc(), p.what()));
-            continue;
+            m->addDiagnostic(new pDiagnostic(p.loc(), p.what()));
+            finished(i);
+            return;
         }
         catch (std::exception& e) {
-            log("[error]: " + pStringRef(e.what()));
-            continue;
+            if (verbosity_ >= 1)
+                o.log << "[error]: " << e.what() << std::endl;
+            finished(i);
+            return;
         }
 
-        try {
-            // run selected passes
-            pm->run(i->second, verbosity_);
+        pPassManager *pm = pms_[worker];
+        if (!pm->empty()) {
+            pm->setOutputStream(&o.out);
+            pm->setLogStream(&o.err);
+            try {
+                // run selected passes
+                pm->run(m, verbosity_);
+            }
+            catch (std::exception& e) {
+                o.err << e.what() << std::endl;
+            }
         }
-        catch (std::exception& e) {
-            std::cerr << e.what() << std::endl;
+
+        finished(i);
+
+    }
+
+};
+
+}
+
+// pm is run on every module (after parsing it) in parallel on the worker
+// threads. passes which read the model need RUN_MODEL_READERS, which gives
+// each worker its own read only connection to it
+void pSourceManager::runPasses(pPassManager *pm, int flags) {
+
+    ModuleVectorType modules;
+    modules.reserve(moduleList_.size());
+    for (ModuleListType::iterator i = moduleList_.begin();
+         i != moduleList_.end();
+         i++) {
+        modules.push_back(i->second);
+    }
+
+    runPasses(modules, pm, flags);
+
+}
+
+void pSourceManager::runPasses(const ModuleVectorType& modules,
+                               pPassManager *pm,
+                               int flags) {
+
+    // unchanged modules are never parsed
+    if (flags & RUN_SKIP_CLEAN) {
+        ModuleVectorType dirty;
+        findDirty(modules, dirty);
+        if (!dirty.empty())
+            runPasses(dirty, pm, flags & ~RUN_SKIP_CLEAN);
+        return;
+    }
+
+    unsigned threads = workerThreads();
+
+    // worker 0 uses model_, the rest get a reader each
+    std::vector<pModel*> readers;
+    if ((flags & RUN_MODEL_READERS) && model_) {
+        for (unsigned w = 1; w < threads; ++w) {
+            pModel *r = openModelReader();
+            if (!r)
+                break;
+            readers.push_back(r);
         }
+        threads = readers.size() + 1;
+    }
+
+    pThreadPool pool(threads);
+    if (pool.size() > 1)
+        log("running passes with " + llvm::Twine(pool.size()) + " threads", 2);
+
+    // each worker needs its own pass instances
+    std::vector<pPassManager*> pms(pool.size());
+    pms[0] = pm;
+    for (unsigned w = 1; w < pool.size(); ++w)
+        pms[w] = pm->clone(readers.empty() ? model_ : readers[w-1]);
+
+    std::vector<std::size_t> costs;
+    estimateCosts(modules, costs);
+
+    // if ModelBuilder is running, its records are written in the order the
+    // modules are scheduled, which doesn't depend on the number of threads
+    pModelWriter *writer = model_ ? model_->writer() : NULL;
+    if (writer) {
+        std::vector<std::size_t> order;
+        pThreadPool::schedule(costs, order);
+        ModuleVectorType scheduled(modules.size());
+        for (std::size_t i = 0; i < order.size(); ++i)
+            scheduled[i] = modules[order[i]];
+        writer->expect(scheduled);
+    }
+
+    {
+        moduleJob job(modules, pms, debugParse_, (flags & RUN_INCLUDE),
+                      verbosity_, logStream_, writer);
+        pool.run(job, costs);
+    }
+
+    for (unsigned w = 1; w < pool.size(); ++w)
+        delete pms[w];
+    pm->setOutputStream(&std::cout);
+    pm->setLogStream(&std::cerr);
 
-    } // input file loop
+    for (std::size_t i = 0; i < readers.size(); ++i)
+        closeModelReader(readers[i]);
+
+}
+
+// the modules the model doesn't have as they are now, in the order given
+void pSourceManager::findDirty(const ModuleVectorType& modules,
+                               ModuleVectorType& dirty) {
+
+    std::vector<std::size_t> sizes(modules.size());
+    for (std::size_t i = 0; i < modules.size(); ++i)
+        sizes[i] = modules[i]->source()->size();
+
+    dirtyJob job(modules, knownModules_);
+    pThreadPool pool(workerThreads());
+    pool.run(job, sizes);
+
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        switch (job.state[i]) {
+        case dirtyJob::DIRTY:
+            dirty.push_back(modules[i]);
+            break;
+        case dirtyJob::RESTAT: {
+            moduleStat s;
+            s.realPath = modules[i]->fileName();
+            s.size = modules[i]->source()->size();
+            s.mtime = modules[i]->source()->mtime();
+            restat_.push_back(s);
+            }
+            // fall through
+        case dirtyJob::CLEAN:
+            if (job.state[i] == dirtyJob::CLEAN)
+                modules[i]->setHash(knownModules_[modules[i]->fileName()].hash);
+            skipped_++;
+            break;
+        }
+    }
 
 }
 
@@ -301,18 +593,108 @@ void pSourceManager::printToks() {
 
 void pSourceManager::runDiagnostics() {
 
-    pPassManager passManager(model_);
+    ModuleVectorType modules, check;
+    modules.reserve(moduleList_.size());
+    for (ModuleListType::iterator i = moduleList_.begin();
+         i != moduleList_.end();
+         i++) {
+        modules.push_back(i->second);
+    }
+
+    // modules whose diagnostics are cached for them and their dependencies
+    // as they are now aren't parsed or checked at all
+    std::vector<std::string> fingerprints;
+    replayDiagnostics(modules, check, fingerprints);
 
     // standard diag passes
+    pPassManager passManager(model_);
     passManager.addPass<AST::Pass::Trivial>();
-    // individual source module model checks
+
+    // individual source module model checks. the model is complete at this
+    // point, so these only read from it
     passManager.addPass<AST::Pass::ModelChecker>();
 
-    runPasses(&passManager);
+    if (!check.empty())
+        runPasses(check, &passManager, RUN_MODEL_READERS);
+
+    cacheDiagnostics(check, fingerprints);
 
     // now run full model checks
     pFullModelChecker fmc(this, model_);
-    fmc.run();
+    bool limited = false;
+    if (diagFilesOnly_) {
+        for (std::size_t i = 0; i < modules.size(); ++i) {
+            pModel::oid m_id = model_->lookupSourceModule(modules[i]->fileName());
+            if (m_id != pModel::NULLID) {
+                fmc.limitTo(m_id);
+                limited = true;
+            }
+        }
+    }
+    // if none of the diagnostic files made it into the model, there is
+    // nothing the full checks could report on
+    if (!diagFilesOnly_ || limited)
+        fmc.run();
+
+}
+
+// modules that are replayed have their cached diagnostics added. the rest
+// go in check, with their dependency fingerprints in the same order
+void pSourceManager::replayDiagnostics(const ModuleVectorType& modules,
+                                       ModuleVectorType& check,
+                                       std::vector<std::string>& fingerprints) {
+
+    std::vector<std::string> realPaths(modules.size());
+    for (std::size_t i = 0; i < modules.size(); ++i)
+        realPaths[i] = modules[i]->fileName();
+
+    std::vector<std::string> all;
+    model_->getDependencyFingerprints(realPaths, all);
+
+    const std::set<std::string>& invalidated = model_->invalidated();
+    pModel::DiagnosticList diags;
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        pSourceModule *m = modules[i];
+        diags.clear();
+        if (all[i].empty() ||
+            invalidated.find(realPaths[i]) != invalidated.end() ||
+            !model_->getCachedDiagnostics(realPaths[i], m->hash(), all[i], diags)) {
+            check.push_back(m);
+            fingerprints.push_back(all[i]);
+            continue;
+        }
+        for (std::size_t j = 0; j < diags.size(); ++j)
+            m->addDiagnostic(new pDiagnostic(pSourceLoc(m, diags[j].range), diags[j].msg));
+    }
+
+    std::stringstream stats;
+    stats << "[diag] " << (modules.size() - check.size()) << " of " << modules.size()
+          << " modules replayed from cache";
+    log(stats.str());
+
+}
+
+// the diagnostics the module passes found in the modules checked, for
+// replayDiagnostics next time
+void pSourceManager::cacheDiagnostics(const ModuleVectorType& modules,
+                                      const std::vector<std::string>& fingerprints) {
+
+    pModel::DiagnosticList diags;
+    model_->begin();
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        // not in the model, or it didn't parse
+        if (fingerprints[i].empty() || !modules[i]->getAST())
+            continue;
+        pSourceModule::DiagListType& list = modules[i]->getDiagnostics();
+        diags.resize(list.size());
+        for (std::size_t j = 0; j < list.size(); ++j) {
+            diags[j].range = list[j]->location().range();
+            diags[j].msg = list[j]->msg();
+        }
+        model_->setCachedDiagnostics(modules[i]->fileName(), modules[i]->hash(),
+                                     fingerprints[i], diags);
+    }
+    model_->commit();
 
 }
 
@@ -322,7 +704,7 @@ void pSourceManager::addIncludeDir(pStringRef name, pStringRef exts) {
         openModel();
     }
 
-    std::vector<pSourceModule*> includeList;
+    std::vector<std::string> includeList;
     llvm::SmallVector<pStringRef, 8> extList;
     exts.split(extList, ",", 8);
 
@@ -340,47 +722,124 @@ void pSourceManager::addIncludeDir(pStringRef name, pStringRef exts) {
         }
 
         if (found)
-            includeList.push_back(new pSourceModule(this, dir->path()));
+            includeList.push_back(dir->path());
     }
 
     pPassManager passManager(model_);
     passManager.addPass<AST::Pass::TypeAnalysis>();
     passManager.addPass<AST::Pass::ModelBuilder>();
-    for (std::vector<pSourceModule*>::iterator i = includeList.begin();
-         i != includeList.end();
-         i++) {
-
-        try {
-            // this is idempotent
-            log("parsing include file: " + (*i)->fileName());
-            (*i)->parse(debugParse_);
-        }
-        catch (pParseError& p) {
-            // diag the parse error
-            (*i)->addDiagnostic(new pDiagnostic(p.loc(), p.what()));
-            continue;
-        }
-        catch (std::exception& e) {
-            log("[error]: " + pStringRef(e.what()));
-            continue;
+    pModelWriter writer(model_, modelQueueSize());
+    startModelWriter(&writer);
+
+    // include dirs can be large (think vendor trees), so instead of holding
+    // the whole set in memory we parse a batch across the workers and free
+    // it before the next. the model records are written on the model
+    // writer thread in the meantime
+    ModuleVectorType batch;
+    for (std::size_t start = 0;
+         start < includeList.size();
+         start += INCLUDE_BATCH_SIZE) {
+
+        std::size_t end = std::min(start + INCLUDE_BATCH_SIZE,
+                                   includeList.size());
+        batch.clear();
+        for (std::size_t i = start; i < end; ++i)
+            batch.push_back(new pSourceModule(this, includeList[i]));
+
+        runPasses(batch, &passManager, RUN_INCLUDE | RUN_SKIP_CLEAN);
+
+        for (ModuleVectorType::iterator i = batch.begin();
+             i != batch.end();
+             i++) {
+            delete (*i);
         }
 
-        try {
-            // run selected passes
-            passManager.run(*i, verbosity_);
+    }
+
+    finishModelWriter(&writer, "include");
+
+}
+
+// the expected work for each module, so the biggest can be started first.
+// the model had the token and node counts from the last time a module was
+// parsed when we opened it. for modules it didn't know, we go by file size,
+// scaled by how file size relates to those counts in the modules it did
+void pSourceManager::estimateCosts(const ModuleVectorType& modules,
+                                   std::vector<std::size_t>& costs) {
+
+    const pModel::SourceModuleMap& known = knownModules_;
+
+    costs.assign(modules.size(), 0);
+    std::vector<char> estimated(modules.size(), 0);
+    double knownCost = 0, knownSize = 0;
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        std::size_t size = modules[i]->source()->contents()->getBufferSize();
+        pModel::SourceModuleMap::const_iterator c = known.find(modules[i]->fileName());
+        if (c != known.end() && c->second.cost > 0) {
+            costs[i] = c->second.cost;
+            knownCost += c->second.cost;
+            knownSize += size;
         }
-        catch (std::exception& e) {
-            std::cerr << e.what() << std::endl;
+        else {
+            costs[i] = size;
+            estimated[i] = 1;
         }
+    }
 
+    double scale = (knownSize > 0) ? (knownCost / knownSize) : 1.0;
+    for (std::size_t i = 0; i < modules.size(); ++i) {
+        if (estimated[i])
+            costs[i] = (std::size_t)(costs[i] * scale);
     }
 
-    for (std::vector<pSourceModule*>::iterator i = includeList.begin();
-         i != includeList.end();
-         i++) {
-        delete (*i);
+}
+
+unsigned pSourceManager::workerThreads(void) const {
+    // the parser trace and context stats go straight to stderr, so when
+    // debugging the parse we stay on one thread
+    if (debugParse_)
+        return 1;
+    return (jobs_ > 0) ? jobs_ : pThreadPool::hardwareThreads();
+}
+
+std::size_t pSourceManager::modelQueueSize(void) const {
+    return workerThreads() * MODEL_QUEUE_PER_THREAD;
+}
+
+void pSourceManager::startModelWriter(pModelWriter *writer) {
+    model_->setWriter(writer);
+    writer->start();
+}
+
+void pSourceManager::finishModelWriter(pModelWriter *writer, const char *stage) {
+
+    writer->finish();
+    model_->setWriter(NULL);
+
+    if (!restat_.empty()) {
+        model_->begin();
+        for (std::size_t i = 0; i < restat_.size(); ++i) {
+            pModel::oid m_id = model_->getSourceModuleOID(restat_[i].realPath);
+            model_->setSourceModuleStat(m_id, restat_[i].size, restat_[i].mtime);
+        }
+        model_->commit();
+        restat_.clear();
     }
 
+    std::stringstream stats;
+    stats.setf(std::ios::fixed);
+    stats.precision(3);
+    stats << "[model] " << stage << ": "
+          << writer->submitted() << " modules queued, "
+          << writer->written() << " written, "
+          << skipped_ << " unchanged, "
+          << "max queue depth " << writer->maxDepth() << "/" << writer->capacity() << ", "
+          << "workers stalled " << writer->submitStall() << "s, "
+          << "writer idle " << writer->writerIdle() << "s, "
+          << "writing " << writer->writeTime() << "s";
+    log(stats.str());
+    skipped_ = 0;
+
 }
 
 void pSourceManager::refreshModel(pStringRef graphFileName) {
@@ -389,49 +848,259 @@ void pSourceManager::refreshModel(pStringRef graphFileName) {
         openModel();
     }
     model_->setTrace(debugModel_);
-    model_->begin();
     pPassManager passManager(model_);
     passManager.addPass<AST::Pass::TypeAnalysis>();
     passManager.addPass<AST::Pass::ModelBuilder>();
-    runPasses(&passManager);
-    model_->commit();
+    pModelWriter writer(model_, modelQueueSize());
+    startModelWriter(&writer);
+    runPasses(&passManager, RUN_SKIP_CLEAN);
+    finishModelWriter(&writer, "source");
+    if (!model_->invalidated().empty()) {
+        std::stringstream msg;
+        msg << "[model] " << model_->invalidated().size()
+            << " modules invalidated by changes to what they depend on";
+        log(msg.str());
+    }
     model_->resolveClassRelations();
     model_->refreshClassModel(graphFileName);
     model_->setTrace(debugDiags_);
 
 }
 
+// write the in memory model back to dbName_. if the model tracked its
+// changes, only the rows changed are written, and nothing at all if there
+// weren't any. otherwise, or if that fails, the whole db is copied over,
+// less the rows of the model layer
+void pSourceManager::saveModel() {
+
+    double start = now();
+    std::stringstream msg;
+
+    if (model_->tracking()) {
+        std::size_t changed = model_->changeCount();
+        if (!changed) {
+            log("[model] unchanged, not saving to: " + dbName_);
+            return;
+        }
+        if (model_->saveChanges(dbName_)) {
+            msg << "[model] saved " << changed << " changed rows to: " << dbName_
+                << " in " << (now() - start) << "s";
+            log(msg.str());
+            return;
+        }
+        log("[model] unable to save changes, saving the whole model");
+    }
+
+    model_->dropLayer();
+    int rc = loadOrSaveDb(db_, dbName_.c_str(), 1);
+    if (rc != SQLITE_OK) {
+        std::cerr << "failing saving in memory db!" << std::endl;
+        return;
+    }
+    msg << "[model] saved model to: " << dbName_ << " in " << (now() - start) << "s";
+    log(msg.str());
+
+}
+
 void pSourceManager::openModel() {
 
     assert(!model_);
     assert(!db_);
 
-    // we always use in memory db here, loading and saving at the start/end
-    int rc = sqlite3_open("", &db_);
-    if (rc) {
-        std::cerr << "unable to open in memory model db: " <<
-                     sqlite3_errmsg(db_);
-        exit(1);
+    int rc;
+    if (modelOnDisk_ && !dbName_.empty()) {
+        // the model file is used in place, in WAL mode so that readers and
+        // the writer don't block each other. it's mapped rather than read,
+        // so only the pages we touch are read, and only those we change are
+        // written
+        log("using model db in place at: " + dbName_);
+        modelURI_ = dbName_;
+        rc = sqlite3_open_v2(modelURI_.c_str(),
+                             &db_,
+                             SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE,
+                             NULL);
+        if (rc) {
+            std::cerr << "unable to open model db: " << dbName_ << ": " <<
+                         sqlite3_errmsg(db_) << std::endl;
+            exit(1);
+        }
+        struct stat st;
+        mmapSize_ = (stat(dbName_.c_str(), &st) == 0) ? st.st_size : 0;
+        mmapSize_ += MODEL_MMAP_HEADROOM;
+        sqlite3_exec(db_, "PRAGMA journal_mode = WAL", NULL, NULL, NULL);
+        sqlite3_exec(db_, "PRAGMA synchronous = NORMAL", NULL, NULL, NULL);
+        setMmapSize(db_);
     }
+    else {
+        // otherwise we use an in memory db, loading and saving at the
+        // start/end. it's named and in shared cache mode so that worker
+        // threads can open their own (read only) connections to it, see
+        // openModelReader
+        std::stringstream uri;
+        uri << "file:corvus-model-" << this << "?mode=memory&cache=shared";
+        modelURI_ = uri.str();
+        rc = sqlite3_open_v2(modelURI_.c_str(),
+                             &db_,
+                             SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_URI,
+                             NULL);
+        if (rc) {
+            std::cerr << "unable to open in memory model db: " <<
+                         sqlite3_errmsg(db_);
+            exit(1);
+        }
 
-    // try to load an existing db, if we are using one
-    if (!dbName_.empty()) {
-        log("using model db at: " + dbName_);
-        // we ignore a failure here if it doesn't exist yet
-        loadOrSaveDb(db_, dbName_.c_str(), 0);
+        // try to load an existing db, if we are using one
+        if (!dbName_.empty()) {
+            log("using model db at: " + dbName_);
+            // we ignore a failure here if it doesn't exist yet
+            loadOrSaveDb(db_, dbName_.c_str(), 0);
+        }
     }
 
     model_ = new pModel(db_, debugModel_);
+    if (!layerName_.empty()) {
+        // attaching would create it
+        struct stat st;
+        if (stat(layerName_.c_str(), &st) == 0 && model_->attachLayer(layerName_))
+            log("[model] using model layer: " + layerName_);
+        else
+            log("[model] unable to use model layer: " + layerName_);
+    }
+    // so that only what changed has to be saved, see saveModel
+    if (!modelOnDisk_ && !dbName_.empty())
+        model_->trackChanges();
+    model_->getSourceModules(knownModules_);
+    if (model_->getMeta("hash") != pSourceFile::hashName())
+        rehashModel();
+
+}
+
+namespace {
+
+// the new hash of each module whose file is the same size and mtime as when
+// it was built, empty for the rest
+class rehashJob: public pThreadPool::job {
+
+    const std::vector<const std::string*>& paths_;
+    const std::vector<const model::mSourceModule*>& modules_;
+
+public:
+    std::vector<std::string> hashes;
+
+    rehashJob(const std::vector<const std::string*>& paths,
+              const std::vector<const model::mSourceModule*>& modules):
+        paths_(paths),
+        modules_(modules),
+        hashes(paths.size()) { }
+
+    void run(unsigned worker, std::size_t i) {
+
+        struct stat st;
+        if (!modules_[i]->mtime ||
+            stat(paths_[i]->c_str(), &st) != 0 ||
+            (pUInt)st.st_size != modules_[i]->size ||
+            (pUInt)st.st_mtime != modules_[i]->mtime)
+            return;
+
+        try {
+            pSourceFile f(*paths_[i]);
+            hashes[i] = f.hash();
+        }
+        catch (std::exception& e) {
+            // it'll be rebuilt if it comes back
+        }
+
+    }
+
+};
+
+}
+
+// the model's module hashes were made by a different hash function, so they
+// won't match any we make now. rather than rebuild everything, we rehash the
+// modules whose files haven't been touched since they were built. the rest
+// are left without a hash, which makes them dirty
+void pSourceManager::rehashModel() {
+
+    std::vector<const std::string*> paths;
+    std::vector<const model::mSourceModule*> modules;
+    for (pModel::SourceModuleMap::const_iterator i = knownModules_.begin();
+         i != knownModules_.end();
+         ++i) {
+        if (i->second.layer)
+            continue;
+        paths.push_back(&i->first);
+        modules.push_back(&i->second);
+    }
+
+    rehashJob job(paths, modules);
+    if (!paths.empty()) {
+        log("rehashing " + llvm::Twine(paths.size()) + " modules in the model");
+        pThreadPool pool(workerThreads());
+        pool.run(job, paths.size());
+    }
+
+    model_->begin();
+    for (std::size_t i = 0; i < paths.size(); ++i) {
+        model_->setSourceModuleHash(*paths[i], job.hashes[i]);
+        knownModules_[*paths[i]].hash = job.hashes[i];
+        if (job.hashes[i].empty())
+            knownModules_[*paths[i]].mtime = 0;
+    }
+    model_->setMeta("hash", pSourceFile::hashName());
+    model_->commit();
+
+}
+
+pModel* pSourceManager::openModelReader() {
+
+    sqlite3 *db;
+    int rc = sqlite3_open_v2(modelURI_.c_str(),
+                             &db,
+                             SQLITE_OPEN_READONLY | SQLITE_OPEN_URI,
+                             NULL);
+    if (rc) {
+        log("unable to open model reader: " + pStringRef(sqlite3_errmsg(db)));
+        sqlite3_close(db);
+        return NULL;
+    }
+
+    // nothing writes while readers are open, so skip the table locks
+    sqlite3_exec(db, "PRAGMA read_uncommitted = 1", NULL, NULL, NULL);
+    if (modelOnDisk_)
+        setMmapSize(db);
+
+    return new pModel(db, model_->trace(), true /* read only */, model_);
+
+}
+
+// the whole model file, and some room for it to grow, is mapped
+void pSourceManager::setMmapSize(sqlite3 *db) {
+
+    std::stringstream pragma;
+    pragma << "PRAGMA mmap_size = " << mmapSize_;
+    sqlite3_exec(db, pragma.str().c_str(), NULL, NULL, NULL);
+
+}
+
+void pSourceManager::closeModelReader(pModel *reader) {
+
+    sqlite3 *db = reader->db();
+    delete reader;
+    sqlite3_close(db);
 
 }
 
 pSourceManager::DiagModuleListType pSourceManager::getDiagModules() {
 
+    // walk the module list rather than the tracker, so that the order is by
+    // file name and not by whichever module happened to be diagnosed first
     pSourceManager::DiagModuleListType result;
-    for (DiagTrackerType::iterator i = diagModuleTracker_.begin();
-         i != diagModuleTracker_.end();
+    for (ModuleListType::iterator i = moduleList_.begin();
+         i != moduleList_.end();
          ++i) {
-        result.push_back(i->first);
+        if (diagModuleTracker_.find(i->second) != diagModuleTracker_.end())
+            result.push_back(i->second);
     }
     return result;
 
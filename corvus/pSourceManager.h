@@ -14,6 +14,8 @@
 #include "corvus/pTypes.h"
 #include "corvus/pSourceModule.h"
 #include "corvus/pConfig.h"
+#include "corvus/pThreadPool.h"
+#include "corvus/pModel.h"
 
 #include <ostream>
 #include <map>
@@ -24,7 +26,7 @@ class sqlite3;
 namespace corvus {
 
 class pPassManager;
-class pModel;
+class pModelWriter;
 
 class pSourceManager {
 public:
@@ -33,17 +35,42 @@ public:
 private:
     typedef std::map<std::string, pSourceModule*> ModuleListType;
     typedef std::map<pSourceModule*, bool> DiagTrackerType;
+    typedef std::vector<pSourceModule*> ModuleVectorType;
 
     bool debugParse_, debugModel_, debugDiags_;
+    // only the diagnostic files were added, see configure
+    bool diagFilesOnly_;
     int verbosity_;    
+    // number of worker threads to parse and run passes with. 0 is one per cpu
+    int jobs_;
     ModuleListType moduleList_;
 
     // the source modules from moduleList_ which have diagnostics waiting
     // note that moduleList_ is the owner of these pointers, not diagModuleList_
     DiagTrackerType diagModuleTracker_;
+    pMutex diagLock_;
 
     sqlite3 *db_;
     pModel *model_;
+    std::string modelURI_;
+    // use the model db file in place, rather than load it into memory
+    bool modelOnDisk_;
+    unsigned long long mmapSize_;
+    // a prebuilt model db layered under the model, see pModel::attachLayer
+    std::string layerName_;
+    // the modules in the model as it was loaded, see estimateCosts and
+    // moduleJob. their costs and stats are from the last time they were built
+    pModel::SourceModuleMap knownModules_;
+    // modules left out of the model build in progress because they hadn't
+    // changed. of those, the ones whose file was touched without changing
+    // have their stat updated when the build is finished
+    struct moduleStat {
+        std::string realPath;
+        pUInt size;
+        pUInt mtime;
+    };
+    std::size_t skipped_;
+    std::vector<moduleStat> restat_;
     std::string dbName_;
     std::ostream *logStream_;
 
@@ -53,23 +80,61 @@ private:
         }
     }
 
-    void runPasses(pPassManager *pm);
+    enum {
+        RUN_INCLUDE       = 0x1, // modules are from an include dir
+        RUN_MODEL_READERS = 0x2, // passes read from the model
+        RUN_SKIP_CLEAN    = 0x4  // skip modules the model has as they are
+    };
+
+    void runPasses(pPassManager *pm, int flags = 0);
+    void runPasses(const ModuleVectorType& modules,
+                   pPassManager *pm,
+                   int flags);
+    unsigned workerThreads(void) const;
+    void findDirty(const ModuleVectorType& modules,
+                   ModuleVectorType& dirty);
+    void estimateCosts(const ModuleVectorType& modules,
+                       std::vector<std::size_t>& costs);
+
+    void replayDiagnostics(const ModuleVectorType& modules,
+                           ModuleVectorType& check,
+                           std::vector<std::string>& fingerprints);
+    void cacheDiagnostics(const ModuleVectorType& modules,
+                          const std::vector<std::string>& fingerprints);
+
     void openModel();
+    void saveModel();
+    void rehashModel();
+    pModel* openModelReader();
+    void setMmapSize(sqlite3 *db);
+    void closeModelReader(pModel *reader);
+
+    std::size_t modelQueueSize(void) const;
+    void startModelWriter(pModelWriter *writer);
+    void finishModelWriter(pModelWriter *writer, const char *stage);
 
 public:
 
     pSourceManager(std::ostream *logStream = 0): debugParse_(false),
         debugModel_(false),
         debugDiags_(false),
+        diagFilesOnly_(false),
         verbosity_(0),
+        jobs_(1),
         db_(NULL),
         model_(NULL),
+        modelOnDisk_(false),
+        mmapSize_(0),
+        skipped_(0),
         logStream_(logStream),
         dbName_() { }
     ~pSourceManager();
 
     void setLogStream(std::ostream *logStream) { logStream_ = logStream; }
     void setModelDBName(pStringRef db)  { dbName_ = db; }
+    void setModelOnDisk(bool onDisk) { modelOnDisk_ = onDisk; }
+    void setModelLayer(pStringRef layer) { layerName_ = layer; }
+    void setJobs(int jobs) { jobs_ = jobs; }
 
     void configure(const pConfig& config);
 
@@ -88,7 +153,9 @@ public:
     pSourceModule* getSourceModuleByRealpath(pStringRef name);
 
     // caller will not own these and should not free them
+    // may be called from worker threads
     void trackDiagModule(pSourceModule *m) {
+        pScopedLock lock(diagLock_);
         diagModuleTracker_[m] = true;
     }
 
@@ -30,10 +30,10 @@ pSourceModule::pSourceModule(pSourceManager *mgr, pStringRef file):
 
 }
 
-void pSourceModule::parse(bool debug=false) {
+void pSourceModule::parse(lexer::pTokenStream& tokens, bool debug=false) {
 
     if (!ast_)
-        parser::parseSourceFile(this,debug);
+        parser::parseSourceFile(this,tokens,debug);
 
 }
 
@@ -53,6 +53,16 @@ const std::string &pSourceModule::fileName() const {
     return source_->fileName();
 }
 
+const std::string &pSourceModule::hash(void) {
+
+    if (!hash_.empty())
+        return hash_;
+
+    hash_ = source_->hash();
+    return hash_;
+
+}
+
 void pSourceModule::setAST(const AST::statementList* list) {
     if (ast_)
         ast_->destroy(context_);
@@ -23,6 +23,10 @@ class pSourceModule;
 class pDiagnostic;
 class pSourceManager;
 
+namespace lexer {
+    class pTokenStream;
+}
+
 namespace AST {
     class stmt;
     class pBaseVisitor;
@@ -39,16 +43,23 @@ private:
     bool parsed_;
     std::vector<pDiagnostic *> diagList_;
     pSourceManager *sourceMgr_;
+    std::string hash_;
 
 public:
     pSourceModule(pSourceManager *mgr, pStringRef file);
     ~pSourceModule();
 
-    void parse(bool debug);
+    // tokens is lexed into, see parser::parseSourceFile
+    void parse(lexer::pTokenStream& tokens, bool debug);
 
     // INSPECTION
     const pSourceFile* source() const { return source_; }
     const std::string& fileName() const;
+    // hash of the source contents, computed on first use
+    const std::string& hash(void);
+    // when the hash is already known, e.g. the model has it and the file's
+    // stat shows it unchanged since
+    void setHash(pStringRef hash) { hash_ = hash; }
 
     const AST::pParseContext& context(void) const { return context_; }
     AST::pParseContext& context(void) { return context_; }
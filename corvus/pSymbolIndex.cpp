@@ -0,0 +1,152 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#include "corvus/pSymbolIndex.h"
+
+#include <ctype.h>
+
+namespace corvus {
+
+std::string pSymbolIndex::lower(pStringRef name) {
+
+    std::string result(name.data(), name.size());
+    for (std::size_t i = 0; i < result.size(); ++i)
+        result[i] = tolower((unsigned char)result[i]);
+    return result;
+
+}
+
+// drop the rows under keys which came from the module at realPath. the ids
+// of the rows dropped are added to removed, if given
+template <typename MAP>
+void pSymbolIndex::remove(MAP& map, const std::vector<key>& keys, const std::string& realPath,
+                          std::vector<oid> *removed) {
+
+    for (std::size_t i = 0; i < keys.size(); ++i) {
+        typename MAP::iterator bucket = map.find(keys[i]);
+        if (bucket == map.end())
+            continue;
+        typename MAP::mapped_type& rows = bucket->second;
+        std::size_t kept = 0;
+        for (std::size_t j = 0; j < rows.size(); ++j) {
+            if (rows[j].realPath == realPath) {
+                if (removed)
+                    removed->push_back(rows[j].id);
+                continue;
+            }
+            if (kept != j)
+                rows[kept] = rows[j];
+            kept++;
+        }
+        rows.resize(kept);
+        if (rows.empty())
+            map.erase(bucket);
+    }
+
+}
+
+void pSymbolIndex::addModule(oid m_id, pStringRef realPath) {
+
+    module& m = modules_[m_id];
+    m.realPath = realPath.str();
+    m.functions.clear();
+    m.classes.clear();
+    m.constants.clear();
+
+}
+
+void pSymbolIndex::removeModule(oid m_id) {
+
+    moduleMap::iterator m = modules_.find(m_id);
+    if (m == modules_.end())
+        return;
+
+    std::vector<oid> classIDs;
+    remove(functions_, m->second.functions, m->second.realPath);
+    remove(classes_, m->second.classes, m->second.realPath, &classIDs);
+    remove(constants_, m->second.constants, m->second.realPath);
+    for (std::size_t i = 0; i < classIDs.size(); ++i)
+        classDecls_.erase(classIDs[i]);
+
+    modules_.erase(m);
+
+}
+
+const std::string& pSymbolIndex::modulePath(oid m_id) const {
+
+    static const std::string none;
+    moduleMap::const_iterator m = modules_.find(m_id);
+    return (m == modules_.end()) ? none : m->second.realPath;
+
+}
+
+void pSymbolIndex::addFunction(oid ns_id, oid c_id, oid m_id, const model::mFunction& f) {
+
+    key k(c_id, ns_id, lower(f.name));
+    functions_[k].push_back(f);
+    modules_[m_id].functions.push_back(k);
+
+}
+
+void pSymbolIndex::addClass(oid m_id, const model::mClass& c) {
+
+    key k(pModel::NULLID, c.namespaceID, lower(c.name));
+    classes_[k].push_back(c);
+    modules_[m_id].classes.push_back(k);
+
+}
+
+void pSymbolIndex::addConstant(oid ns_id, oid m_id, const model::mConstant& c) {
+
+    // defines are global, only consts belong to a namespace
+    key k(c.type, (c.type == pModel::CONST) ? ns_id : static_cast<oid>(pModel::NULLID), c.name);
+    constants_[k].push_back(c);
+    modules_[m_id].constants.push_back(k);
+
+}
+
+void pSymbolIndex::addClassDecl(oid c_id, const model::mClassDecl& d) {
+
+    classDecls_[c_id][d.name].push_back(d);
+
+}
+
+const pModel::FunctionList* pSymbolIndex::functions(oid ns_id, oid c_id, pStringRef name) const {
+
+    functionMap::const_iterator i = functions_.find(key(c_id, ns_id, lower(name)));
+    return (i == functions_.end()) ? NULL : &i->second;
+
+}
+
+const pModel::ClassList* pSymbolIndex::classes(oid ns_id, pStringRef name) const {
+
+    classMap::const_iterator i = classes_.find(key(pModel::NULLID, ns_id, lower(name)));
+    return (i == classes_.end()) ? NULL : &i->second;
+
+}
+
+const pModel::ConstantList* pSymbolIndex::constants(oid ns_id, int type, pStringRef name) const {
+
+    constantMap::const_iterator i = constants_.find(key(type, ns_id, name));
+    return (i == constants_.end()) ? NULL : &i->second;
+
+}
+
+const pModel::ClassDeclList* pSymbolIndex::classDecls(oid c_id, pStringRef name) const {
+
+    classDeclMap::const_iterator c = classDecls_.find(c_id);
+    if (c == classDecls_.end())
+        return NULL;
+    declMap::const_iterator i = c->second.find(name.str());
+    return (i == c->second.end()) ? NULL : &i->second;
+
+}
+
+} // namespace
@@ -0,0 +1,115 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#ifndef COR_PSYMBOLINDEX_H_
+#define COR_PSYMBOLINDEX_H_
+
+#include "corvus/pTypes.h"
+#include "corvus/pModel.h"
+
+#include <boost/unordered_map.hpp>
+#include <boost/functional/hash.hpp>
+#include <string>
+#include <vector>
+
+namespace corvus {
+
+// the functions, classes, constants and class decls in the model, hashed by
+// namespace and name so the checkers don't go to sqlite for every symbol
+// they look up. pModel loads it from the db once and keeps it in step as
+// it defines symbols and deletes modules; the db is only there to persist
+// the model between runs.
+//
+// function and class names are case insensitive, as they are in php.
+// constants and class decls are not. the unresolved relations of a class
+// are only kept up to date in the db, see getUnresolvedClasses.
+//
+// once the model is built, the index is only read, so readers may share it
+// between threads without locking
+class pSymbolIndex {
+public:
+    typedef pModel::oid oid;
+
+private:
+
+    // scope is the class of a method, or the type of a constant
+    struct key {
+        oid scope;
+        oid ns;
+        std::string name;
+        key(oid s, oid n, pStringRef nm): scope(s), ns(n), name(nm.str()) { }
+        bool operator==(const key& other) const {
+            return scope == other.scope && ns == other.ns && name == other.name;
+        }
+        friend std::size_t hash_value(const key& k) {
+            std::size_t seed = boost::hash_value(k.name);
+            boost::hash_combine(seed, k.scope);
+            boost::hash_combine(seed, k.ns);
+            return seed;
+        }
+    };
+
+    typedef boost::unordered_map<key, pModel::FunctionList> functionMap;
+    typedef boost::unordered_map<key, pModel::ClassList> classMap;
+    typedef boost::unordered_map<key, pModel::ConstantList> constantMap;
+    typedef boost::unordered_map<std::string, pModel::ClassDeclList> declMap;
+    typedef boost::unordered_map<oid, declMap> classDeclMap;
+
+    // what each module defined, so it can be taken out again
+    struct module {
+        std::string realPath;
+        std::vector<key> functions;
+        std::vector<key> classes;
+        std::vector<key> constants;
+    };
+    typedef boost::unordered_map<oid, module> moduleMap;
+
+    functionMap functions_;
+    classMap classes_;
+    constantMap constants_;
+    classDeclMap classDecls_;
+    moduleMap modules_;
+
+    template <typename MAP>
+    void remove(MAP& map, const std::vector<key>& keys, const std::string& realPath,
+                std::vector<oid> *removed = NULL);
+
+public:
+
+    // how function and class names are keyed
+    static std::string lower(pStringRef name);
+
+    void addModule(oid m_id, pStringRef realPath);
+    // takes out everything the module defined, including the decls of its
+    // classes. decls inherited from them stay until the class model is
+    // rebuilt
+    void removeModule(oid m_id);
+    // empty if unknown
+    const std::string& modulePath(oid m_id) const;
+
+    void addFunction(oid ns_id, oid c_id, oid m_id, const model::mFunction& f);
+    void addClass(oid m_id, const model::mClass& c);
+    void addConstant(oid ns_id, oid m_id, const model::mConstant& c);
+
+    // class decls come from the class model, which is rebuilt as a whole
+    void clearClassDecls(void) { classDecls_.clear(); }
+    void addClassDecl(oid c_id, const model::mClassDecl& d);
+
+    // NULL if there are none
+    const pModel::FunctionList* functions(oid ns_id, oid c_id, pStringRef name) const;
+    const pModel::ClassList* classes(oid ns_id, pStringRef name) const;
+    const pModel::ConstantList* constants(oid ns_id, int type, pStringRef name) const;
+    const pModel::ClassDeclList* classDecls(oid c_id, pStringRef name) const;
+
+};
+
+} // namespace
+
+#endif
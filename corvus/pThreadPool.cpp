@@ -0,0 +1,227 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#include "corvus/pThreadPool.h"
+
+#include <unistd.h>
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace corvus {
+
+namespace {
+
+// the indexes assigned to one worker, most expensive first
+struct workQueue {
+    pMutex lock;
+    std::deque<std::size_t> items;
+    // total cost of items
+    std::size_t load;
+    workQueue(void): load(0) { }
+};
+
+// shared between the workers of a single run()
+struct runState {
+    pThreadPool::job* job;
+    const std::vector<std::size_t>* costs;
+    workQueue* queues;
+    unsigned numQueues;
+    pMutex lock;
+    std::string error;
+    bool failed;
+};
+
+struct workerArg {
+    runState* state;
+    unsigned worker;
+};
+
+bool popFront(runState* s, unsigned q, std::size_t& index) {
+
+    workQueue& wq = s->queues[q];
+    pScopedLock l(wq.lock);
+    if (wq.items.empty())
+        return false;
+    index = wq.items.front();
+    wq.items.pop_front();
+    wq.load -= (*s->costs)[index];
+    return true;
+
+}
+
+// take the most expensive index from the busiest other worker
+bool steal(runState* s, unsigned self, std::size_t& index) {
+
+    while (true) {
+        unsigned victim = self;
+        std::size_t most = 0;
+        for (unsigned q = 0; q < s->numQueues; ++q) {
+            if (q == self)
+                continue;
+            pScopedLock l(s->queues[q].lock);
+            if (!s->queues[q].items.empty() &&
+                (victim == self || s->queues[q].load > most)) {
+                victim = q;
+                most = s->queues[q].load;
+            }
+        }
+        if (victim == self)
+            return false;
+        // it may have been emptied since we looked, in which case try again
+        if (popFront(s, victim, index))
+            return true;
+    }
+
+}
+
+void *workerMain(void *arg) {
+
+    workerArg* w = static_cast<workerArg*>(arg);
+    runState* s = w->state;
+
+    while (true) {
+        {
+            pScopedLock l(s->lock);
+            if (s->failed)
+                break;
+        }
+        std::size_t index;
+        if (!popFront(s, w->worker, index) && !steal(s, w->worker, index))
+            break;
+        try {
+            s->job->run(w->worker, index);
+        }
+        catch (std::exception& e) {
+            // exceptions can't cross the thread boundary, so we save the
+            // first one and rethrow it from run()
+            pScopedLock l(s->lock);
+            if (!s->failed) {
+                s->failed = true;
+                s->error = e.what();
+            }
+        }
+    }
+
+    return NULL;
+
+}
+
+bool costOrder(const std::pair<std::size_t, std::size_t>& a,
+               const std::pair<std::size_t, std::size_t>& b) {
+    // highest cost first, ties in index order
+    if (a.first != b.first)
+        return a.first > b.first;
+    return a.second < b.second;
+}
+
+}
+
+pThreadPool::pThreadPool(unsigned threads): threads_(threads) {
+
+    if (threads_ == 0)
+        threads_ = hardwareThreads();
+
+}
+
+unsigned pThreadPool::hardwareThreads(void) {
+
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (unsigned)n : 1;
+
+}
+
+void pThreadPool::schedule(const std::vector<std::size_t>& costs,
+                           std::vector<std::size_t>& order) {
+
+    std::vector<std::pair<std::size_t, std::size_t> > sorted(costs.size());
+    for (std::size_t i = 0; i < costs.size(); ++i)
+        sorted[i] = std::make_pair(costs[i], i);
+    std::sort(sorted.begin(), sorted.end(), costOrder);
+
+    order.resize(costs.size());
+    for (std::size_t i = 0; i < sorted.size(); ++i)
+        order[i] = sorted[i].second;
+
+}
+
+void pThreadPool::run(job& j, std::size_t count) {
+
+    run(j, std::vector<std::size_t>(count, 1));
+
+}
+
+void pThreadPool::run(job& j, const std::vector<std::size_t>& costs) {
+
+    std::vector<std::size_t> order;
+    schedule(costs, order);
+
+    if (threads_ <= 1 || order.size() <= 1) {
+        for (std::size_t i = 0; i < order.size(); ++i)
+            j.run(0, order[i]);
+        return;
+    }
+
+    unsigned numThreads = (order.size() < threads_) ? (unsigned)order.size() : threads_;
+
+    // deal out the work, each index going to the least loaded worker
+    workQueue* queues = new workQueue[numThreads];
+    for (std::size_t i = 0; i < order.size(); ++i) {
+        unsigned least = 0;
+        for (unsigned q = 1; q < numThreads; ++q) {
+            if (queues[q].load < queues[least].load)
+                least = q;
+        }
+        queues[least].items.push_back(order[i]);
+        queues[least].load += costs[order[i]];
+    }
+
+    runState state;
+    state.job = &j;
+    state.costs = &costs;
+    state.queues = queues;
+    state.numQueues = numThreads;
+    state.failed = false;
+
+    std::vector<pthread_t> threads(numThreads);
+    std::vector<workerArg> args(numThreads);
+
+    unsigned started = 0;
+    for (unsigned i = 0; i < numThreads; ++i) {
+        args[i].state = &state;
+        args[i].worker = i;
+        if (pthread_create(&threads[i], NULL, workerMain, &args[i]) != 0)
+            break;
+        started++;
+    }
+
+    if (started == 0) {
+        // couldn't start any threads, do the work here instead
+        delete [] queues;
+        for (std::size_t i = 0; i < order.size(); ++i)
+            j.run(0, order[i]);
+        return;
+    }
+
+    // if only some threads started, the rest of the queues are stolen from
+    for (unsigned i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+
+    delete [] queues;
+
+    if (state.failed)
+        throw std::runtime_error(state.error);
+
+}
+
+} // namespace
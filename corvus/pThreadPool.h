@@ -0,0 +1,124 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#ifndef COR_PTHREADPOOL_H_
+#define COR_PTHREADPOOL_H_
+
+#include <pthread.h>
+#include <cstddef>
+#include <vector>
+
+namespace corvus {
+
+// thin wrappers around pthreads. we already link against it, and this
+// keeps us from adding another boost library dependency
+class pMutex {
+
+    pthread_mutex_t mutex_;
+
+    // no copy
+    pMutex(const pMutex&);
+    pMutex& operator=(const pMutex&);
+
+public:
+    pMutex(void) { pthread_mutex_init(&mutex_, NULL); }
+    ~pMutex(void) { pthread_mutex_destroy(&mutex_); }
+
+    void lock(void) { pthread_mutex_lock(&mutex_); }
+    void unlock(void) { pthread_mutex_unlock(&mutex_); }
+
+    pthread_mutex_t* native(void) { return &mutex_; }
+
+};
+
+class pScopedLock {
+
+    pMutex& mutex_;
+
+    pScopedLock(const pScopedLock&);
+    pScopedLock& operator=(const pScopedLock&);
+
+public:
+    pScopedLock(pMutex& m): mutex_(m) { mutex_.lock(); }
+    ~pScopedLock(void) { mutex_.unlock(); }
+
+};
+
+class pCondition {
+
+    pthread_cond_t cond_;
+
+    pCondition(const pCondition&);
+    pCondition& operator=(const pCondition&);
+
+public:
+    pCondition(void) { pthread_cond_init(&cond_, NULL); }
+    ~pCondition(void) { pthread_cond_destroy(&cond_); }
+
+    // m must be locked by the caller
+    void wait(pMutex& m) { pthread_cond_wait(&cond_, m.native()); }
+    void signal(void) { pthread_cond_signal(&cond_); }
+    void broadcast(void) { pthread_cond_broadcast(&cond_); }
+
+};
+
+// runs a job over a range of indexes on a set of worker threads. threads
+// are started for each run() and joined before it returns, so callers may
+// assume all work is complete (and visible) afterwards.
+//
+// indexes are handed out most expensive first: each worker gets its own
+// queue, filled by assigning each index to the least loaded worker, and a
+// worker which runs out steals the most expensive index left on the busiest
+// other worker. this keeps one big index from being started last
+class pThreadPool {
+public:
+
+    class job {
+    public:
+        virtual ~job(void) { }
+        // worker is in [0, size()) and is stable for the thread running it,
+        // so it may be used to index per-thread state
+        virtual void run(unsigned worker, std::size_t index) = 0;
+    };
+
+private:
+
+    unsigned threads_;
+
+    pThreadPool(const pThreadPool&);
+    pThreadPool& operator=(const pThreadPool&);
+
+public:
+
+    // threads == 0 means one per available cpu
+    pThreadPool(unsigned threads);
+
+    unsigned size(void) const { return threads_; }
+
+    // run j for each index in [0, count). with a single thread this runs
+    // on the calling thread, in order.
+    void run(job& j, std::size_t count);
+
+    // run j for each index in [0, costs.size()), where costs are the
+    // relative expected cost of each index. with a single thread this runs
+    // on the calling thread, most expensive first
+    void run(job& j, const std::vector<std::size_t>& costs);
+
+    // the order indexes with the given costs are started in, on one thread
+    static void schedule(const std::vector<std::size_t>& costs,
+                         std::vector<std::size_t>& order);
+
+    static unsigned hardwareThreads(void);
+
+};
+
+} // namespace
+
+#endif
@@ -0,0 +1,28 @@
+/* ***** BEGIN LICENSE BLOCK *****
+;;
+;; Copyright (c) 2013 Shannon Weyrick <weyrick@mozek.us>
+;;
+;; This Source Code Form is subject to the terms of the Mozilla Public
+;; License, v. 2.0. If a copy of the MPL was not distributed with this
+;; file, You can obtain one at http://mozilla.org/MPL/2.0/.
+   ***** END LICENSE BLOCK *****
+*/
+
+#ifndef COR_PTIME_H_
+#define COR_PTIME_H_
+
+#include <sys/time.h>
+#include <cstddef>
+
+namespace corvus {
+
+// wall clock seconds, to the microsecond, for timing things
+inline double now(void) {
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + (tv.tv_usec / 1000000.0);
+}
+
+} // namespace
+
+#endif /* COR_PTIME_H_ */
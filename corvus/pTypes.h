@@ -69,6 +69,48 @@ struct pSourceRange {
     }
 };
 
+// where a node is in its source, as byte offsets into the file. lines and
+// columns are only worked out when they're wanted, from the file's line
+// starts, see pSourceFile::range. a span may know just the line it's on,
+// without a column, and may have no end
+struct pSourceSpan {
+
+    static const boost::uint32_t NONE = 0xffffffff;
+    // set in begin
+    static const boost::uint32_t LINE_ONLY = 0x80000000;
+
+    pSourceSpan(void): begin(NONE), end(NONE) { }
+
+    pSourceSpan(boost::uint32_t b, boost::uint32_t e): begin(b), end(e) { }
+
+    static pSourceSpan line(boost::uint32_t offset) {
+        return pSourceSpan(offset | LINE_ONLY, NONE);
+    }
+
+    boost::uint32_t begin;
+    boost::uint32_t end;
+
+};
+
+// a lexed token, as it's kept in a lexer::pTokenStream. the parser is
+// handed pointers to these
+struct pToken {
+
+    // ids beyond the grammar's, for where the lexer had to stop
+    static const boost::uint32_t UNMATCHED = 0xffffffff;
+    static const boost::uint32_t DANGLING_HEREDOC = 0xfffffffe;
+
+    pToken(boost::uint32_t o, boost::uint32_t l, boost::uint32_t i):
+        offset(o), length(l), id(i) { }
+
+    pSourceSpan span(void) const { return pSourceSpan(offset, offset+length); }
+
+    boost::uint32_t offset;
+    boost::uint32_t length;
+    boost::uint32_t id;
+
+};
+
 } /* namespace corvus */
 
 
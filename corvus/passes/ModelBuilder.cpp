@@ -8,10 +8,9 @@
    ***** END LICENSE BLOCK *****
 */
 
-#include "md5.h"
-
 #include "corvus/passes/ModelBuilder.h"
 
+#include "corvus/pModelWriter.h"
 #include "corvus/pSourceModule.h"
 #include "corvus/pSourceFile.h"
 #include <stdio.h>
@@ -20,63 +19,59 @@
 namespace corvus { namespace AST { namespace Pass {
 
 
+ModelBuilder::~ModelBuilder(void) {
+    delete record_;
+}
+
 void ModelBuilder::pre_run(void) {
 
-    pNSVisitor::pre_run();
-
-    // generate the source hash
-    md5_byte_t digest[16];
-    md5_state_t state;
-    md5_init(&state);
-    md5_append(&state,
-               reinterpret_cast<const md5_byte_t *>(module_->source()->contents()->getBufferStart()),
-               module_->source()->contents()->getBufferSize());
-    md5_finish(&state, digest);
-    char hash[32];
-    for (int di = 0; di < 16; ++di)
-        sprintf(hash + di * 2, "%02x", digest[di]);
-
-    // is the source module dirty? i.e. does it exist in the model already and
-    // has it changed since we last built it?
-    if (!model_->sourceModuleDirty(module_->fileName(), hash)) {
-        // don't run the pass
-        abortPass();
-        return;
-    }
+    // note we don't call pNSVisitor::pre_run, it would look up the root
+    // namespace in the model. everything here goes through record_ so that
+    // we never touch the model from a worker thread
+
+    // modules which haven't changed since the model was last built are
+    // normally skipped before they're parsed (see pSourceManager), but
+    // whether the module is dirty (i.e. does it exist in the model already,
+    // and has it changed since we last built it?) is finally decided when
+    // the record is applied
+
+    // if the module is dirty, applying the record replaces the classes it
+    // defined. classes elsewhere which had resolved against them are reset
+    // to unresolved, see pModel::invalidateDependents
 
-    // XXX if we get here, we may be deleting a source module if it exists.
-    // if that source module defined classes, they will be cascade deleted
-    // throughout the existing model db (including all properties, relations,
-    // etc). HOWEVER, if the module had defined a class which it
-    // now now longer defines (or has added/removed properties or fields),
-    // and a different class from another module had
-    // depended on it and resolved it previously (into its own "extends" field in the class
-    // table), that data is now stale.
-    // so essentially we need a to scan the "extends" and "implements" fields in model db
-    // in the class table here for any classes that were defined in this module we
-    // are about to delete, and reset that dependant class row to "unresolved"
-    // (by setting unresolved_extends = extends and unresolved_implementes = implements)
-    // so that the class model will rebuild based on the new data we're about to make
-    // XXX the way to remove this requirement is to move "unresolved_extends/implements" into
-    //     its own normalized table with cascade delete
-    // XXX
-
-    m_id_ = model_->getSourceModuleOID(module_->fileName(),
-                                       hash,
-                                       true /* delete first */
-                                       );
+    delete record_;
+    record_ = new pModelRecord(module_->fileName(), module_->hash());
+    record_->setCost(module_->context().tokenCount(),
+                     module_->context().nodeCount());
+    record_->setStat(module_->source()->size(),
+                     module_->source()->mtime());
+
+    m_id_ = pModelRecord::MODULE_ID;
+    ns_id_ = record_->getRootNamespaceOID();
+    ns_use_list_.clear();
 
 }
 
 void ModelBuilder::post_run(void) {
 
-    model_->resolveMultipleDecls(m_id_);
+    record_->resolveMultipleDecls(m_id_);
+
+    // hand off to the model writer if there is one, otherwise write
+    // it ourselves
+    if (model_->writer()) {
+        model_->writer()->submit(module_, record_);
+    }
+    else {
+        record_->apply(model_);
+        delete record_;
+    }
+    record_ = NULL;
 
 }
 
 void ModelBuilder::visit_pre_namespaceDecl(namespaceDecl* n) {
 
-    ns_id_ = model_->getNamespaceOID(n->name(), true);
+    ns_id_ = record_->getNamespaceOID(n->name());
 
 }
 
@@ -84,7 +79,7 @@ void ModelBuilder::visit_post_namespaceDecl(namespaceDecl* n) {
 
     // we only lose the namespace if this one had a body, i.e. block
     if (n->body()) {
-        ns_id_ = model_->getRootNamespaceOID();
+        ns_id_ = record_->getRootNamespaceOID();
         ns_use_list_.clear();
     }
 
@@ -127,6 +122,7 @@ void ModelBuilder::visit_pre_classDecl(classDecl* n) {
              ++i) {
             // interfaces have multiple inheritance
             extends << RESOLVE_FQN(*i) << ",";
+            record_->defineDependency(pModel::DEP_CLASS, RESOLVE_FQN(*i));
         }
     }
     if (n->implementsCount()) {
@@ -134,13 +130,14 @@ void ModelBuilder::visit_pre_classDecl(classDecl* n) {
              i != n->implements_end();
              ++i) {
             implements << RESOLVE_FQN(*i) << ",";
+            record_->defineDependency(pModel::DEP_CLASS, RESOLVE_FQN(*i));
         }
     }
 
     std::string extendsS(extends.str());
     std::string implementsS(implements.str());
 
-    c_id_ = model_->defineClass(ns_id_,
+    c_id_ = record_->defineClass(ns_id_,
                                 m_id_,
                                 n->name(),
                                 (n->classType() == classDecl::IFACE) ?
@@ -149,7 +146,7 @@ void ModelBuilder::visit_pre_classDecl(classDecl* n) {
                                 n->implementsCount(),
                                 extendsS.substr(0,extendsS.size()-1),
                                 implementsS.substr(0,implementsS.size()-1),
-                                n->range());
+                                range(n));
 
 }
 
@@ -176,13 +173,13 @@ void ModelBuilder::visit_post_propertyDecl(propertyDecl *n) {
         else {
             def = llvm::dyn_cast<literalExpr>(value)->getStringVal();
         }
-        model_->defineClassDecl(c_id_,
+        record_->defineClassDecl(c_id_,
                                 n->name(),
                                 pModel::CONST,
                                 pModel::NO_FLAGS,
                                 pModel::PUBLIC, // implicit
                                 def,
-                                n->range());
+                                range(n));
     }
 
 }
@@ -203,7 +200,7 @@ void ModelBuilder::visit_pre_signature(signature* n) {
             break;
         minArity++;
     }
-    f_id_list_.push_back(model_->defineFunction(ns_id_,
+    f_id_list_.push_back(record_->defineFunction(ns_id_,
                           m_id_,
                           c_id_,
                           n->name(),
@@ -212,13 +209,13 @@ void ModelBuilder::visit_pre_signature(signature* n) {
                           pModel::PUBLIC,
                           minArity,
                           n->numParams(),
-                          n->range()
+                          range(n)
                           ));
 
     for (int i = n->numParams()-1; i >= 0; i--) {
         formalParam *p = n->getParam(i);
         // XXX get types based on hints and defaults
-        model_->defineFunctionVar(f_id_list_.back(),
+        record_->defineFunctionVar(f_id_list_.back(),
                                  p->name(),
                                  pModel::PARAM,
                                  pModel::NO_FLAGS,
@@ -227,7 +224,7 @@ void ModelBuilder::visit_pre_signature(signature* n) {
                                  0, // branch
                                  "", // XXX datatype obj
                                  "", // XXX default
-                                 p->range()
+                                 range(p)
                     );
     }
 
@@ -306,7 +303,7 @@ void ModelBuilder::visit_pre_var(var* n) {
     // if it's an lval which isn't an array, or a global, it's a declaration
     // but not if we're inside a branch
     if ((n->isLval() && n->numIndices() == 0) || global_) {
-        model_->defineFunctionVar(f_id_list_.back(),
+        record_->defineFunctionVar(f_id_list_.back(),
                                  n->name(),
                                  pModel::FREE_VAR,
                                  pModel::NO_FLAGS,
@@ -315,7 +312,7 @@ void ModelBuilder::visit_pre_var(var* n) {
                                  branch_,
                                  "", // XXX if object, the class name we think it is
                                  "", // default (only func params)
-                                 n->range()
+                                 range(n)
                     );
     }
     else {
@@ -328,11 +325,11 @@ void ModelBuilder::visit_pre_var(var* n) {
         if (c_id_ != pModel::NULLID && n->name() == "this")
             return;
 
-        model_->defineFunctionVarUse(f_id_list_.back(),
+        record_->defineFunctionVarUse(f_id_list_.back(),
                                      blockDepth_,
                                      branch_,
                                      n->name(),
-                                     n->range());
+                                     range(n));
     }
 
 }
@@ -361,12 +358,12 @@ void ModelBuilder::visit_pre_constDecl(constDecl* n) {
             strval = llvm::dyn_cast<literalExpr>(value)->getStringVal();
         }
 
-        model_->defineConstant(m_id_,
+        record_->defineConstant(m_id_,
                                ns_id_,
                                llvm::dyn_cast<literalID>(name)->name(),
                                pModel::CONST,
                                strval,
-                               n->range());
+                               range(n));
 
     }
 
@@ -378,8 +375,15 @@ void ModelBuilder::visit_pre_functionInvoke(functionInvoke *n) {
     if (!n->hasLiteralName())
         return;
 
+    if (n->constructor()) {
+        record_->defineDependency(pModel::DEP_CLASS, RESOLVE_FQN(n->literalName().str()));
+        return;
+    }
+
     if (n->target()) {
-        // method invoke
+        // method invoke. static calls depend on the class
+        if (n->hasLiteralTarget())
+            defineClassDependency(llvm::dyn_cast<literalID>(n->target())->name());
     }
     else {
         // function invoke
@@ -399,14 +403,37 @@ void ModelBuilder::visit_pre_functionInvoke(functionInvoke *n) {
             if (llvm::isa<literalExpr>(value)) {
                 strval = llvm::dyn_cast<literalExpr>(value)->getStringVal();
             }
-            model_->defineConstant(m_id_,
+            record_->defineConstant(m_id_,
                                    llvm::dyn_cast<literalExpr>(name)->getStringVal(),
                                    pModel::DEFINE,
                                    strval,
-                                   n->range());
+                                   range(n));
             return;
         }
+
+        record_->defineDependency(pModel::DEP_FUNCTION, RESOLVE_FQN(n->literalName().str()));
+    }
+
+}
+
+void ModelBuilder::visit_pre_literalConstant(literalConstant *n) {
+
+    if (!n->target()) {
+        record_->defineDependency(pModel::DEP_CONSTANT, RESOLVE_FQN(n->name().str()));
     }
+    else if (llvm::isa<literalID>(n->target())) {
+        // class constant
+        defineClassDependency(llvm::dyn_cast<literalID>(n->target())->name());
+    }
+
+}
+
+// self, parent and static are covered by the class's own dependencies
+void ModelBuilder::defineClassDependency(pStringRef name) {
+
+    if (name == "self" || name == "parent" || name == "static")
+        return;
+    record_->defineDependency(pModel::DEP_CLASS, RESOLVE_FQN(name.str()));
 
 }
 
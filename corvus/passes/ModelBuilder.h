@@ -14,6 +14,7 @@
 #include "corvus/pAST.h"
 #include "corvus/pNSVisitor.h"
 #include "corvus/pModel.h"
+#include "corvus/pModelRecord.h"
 
 #include <vector>
 
@@ -28,6 +29,10 @@ class ModelBuilder: public pNSVisitor {
 
 private:
 
+    // the definitions are recorded here rather than written to the model,
+    // so that the pass can run on the parse workers. oids are local to it
+    pModelRecord *record_;
+
     pModel::oid c_id_;
     pModel::oid m_id_;
     std::vector<pModel::oid> f_id_list_;
@@ -39,15 +44,19 @@ private:
     // branch of current if block e.g. true, false
     int branch_;
 
+    void defineClassDependency(pStringRef name);
+
 public:
     ModelBuilder():
             pNSVisitor("ModelBuilder","Build the code model"),
+            record_(NULL),
             c_id_(pModel::NULLID),
             m_id_(pModel::NULLID),
             global_(false),
             blockDepth_(0),
             branch_(0)
             { }
+    ~ModelBuilder(void);
 
     void pre_run(void);
     void post_run(void);
@@ -76,6 +85,7 @@ public:
     void visit_pre_var(var *n);
 
     void visit_pre_functionInvoke(functionInvoke *n);
+    void visit_pre_literalConstant(literalConstant *n);
 
     /*
     void visit_pre_block(block* n);
@@ -9,6 +9,8 @@
 */
 
 #include "corvus/passes/ModelChecker.h"
+#include "corvus/pBuiltins.h"
+#include <llvm/ADT/SmallVector.h>
 #include <sstream>
 namespace corvus { namespace AST { namespace Pass {
 
@@ -27,8 +29,9 @@ void ModelChecker::post_run(void) {
 void ModelChecker::visit_pre_classDecl(classDecl* n) {
 
     c_id_ = model_->lookupClass(ns_id_, n->name(), m_id_);
+    c_name_ = n->name().str();
     if (c_id_ == pModel::NULLID)
-        std::cout << "no class found: " << n->name().str() << " ns_id: " << ns_id_ << " for line " << n->range().startLine << " in " << module_->fileName() << "\n";
+        std::cout << "no class found: " << n->name().str() << " ns_id: " << ns_id_ << " for line " << range(n).startLine << " in " << module_->fileName() << "\n";
     assert(c_id_ != pModel::NULLID && "class wasn't in the model");
 
 }
@@ -36,6 +39,7 @@ void ModelChecker::visit_pre_classDecl(classDecl* n) {
 void ModelChecker::visit_post_classDecl(classDecl* n) {
 
     c_id_ = pModel::NULLID;
+    c_name_.clear();
 
 }
 
@@ -64,14 +68,30 @@ void ModelChecker::visit_pre_functionInvoke(functionInvoke* n) {
         }
     }
 
+    std::string name = RESOLVE_FQN(n->literalName().str());
+
+    // builtins come from the table rather than the model. a call from inside
+    // a namespace may be to a function of the namespace instead, so in that
+    // case the model is asked first
+    const builtins::bFunction *bf = pBuiltins::lookupFunction(name);
+    bool global = (ns_id_ == model_->getRootNamespaceOID() || name[0] == '\\');
+    if (bf && global) {
+        checkArity(n, bf->minArity, bf->maxArity);
+        return;
+    }
+
     // find the function in the model
-    std::pair<pModel::oid, std::string> resolved = model_->resolveFQN(ns_id_, RESOLVE_FQN(n->literalName().str()));
+    std::pair<pModel::oid, std::string> resolved = model_->resolveFQN(ns_id_, name);
     pModel::FunctionList list = model_->queryFunctions(resolved.first, c_id, resolved.second);
 
     // if it doesn't exist, diag it
     std::stringstream diag;
 
     if (list.size() == 0) {
+        if (bf) {
+            checkArity(n, bf->minArity, bf->maxArity);
+            return;
+        }
         diag << "function '" << n->literalName().str() << "' not defined";
         addDiagnostic(n, diag.str());
         return;
@@ -84,33 +104,79 @@ void ModelChecker::visit_pre_functionInvoke(functionInvoke* n) {
         if (max > 3)
             max = 3;
         for (int i = 0; i < max; i++) {
-            diag << list[i].get("realpath") << ":" << list[i].get("start_line") << std::endl;
+            diag << list[i].realPath << ":" << list[i].range.startLine << std::endl;
         }
         return;
     }
 
     // one hit, check arity
+    checkArity(n, list[0].minArity, list[0].maxArity);
+
+}
+
+void ModelChecker::checkArity(functionInvoke* n, int minArity, int maxArity) {
+
+    std::stringstream diag;
     pUInt arity = n->numArgs();
-    if (arity < list[0].getAsInt("minArity") || arity > list[0].getAsInt("maxArity")) {
-        if (list[0].getAsInt("minArity") == list[0].getAsInt("maxArity")) {
+    if (arity < minArity || arity > maxArity) {
+        if (minArity == maxArity) {
             diag << "wrong number of arguments: function '" << n->literalName().str()
-                 << "' requires " << list[0].get("minArity") << " arguments (" << arity << " specified)";
+                 << "' requires " << minArity << " arguments (" << arity << " specified)";
         }
         else {
             diag << "wrong number of arguments: function '" << n->literalName().str()
-                 << "' takes between " << list[0].get("minArity") << " and "
-                 << list[0].get("maxArity") << " arguments (" << arity << " specified)";
+                 << "' takes between " << minArity << " and "
+                 << maxArity << " arguments (" << arity << " specified)";
         }
         addDiagnostic(n, diag.str());
     }
 
 }
 
+// whether a builtin class that class c_id extends or implements, at any depth,
+// has the constant. the flattened class model only has the constants of
+// builtins when base/ was built into the model
+bool ModelChecker::builtinClassConstant(pModel::oid ns_id, pStringRef className, pModel::oid c_id,
+                                        pStringRef name, int depth) {
+
+    // relations may be cyclic
+    if (depth > 32)
+        return false;
+
+    pModel::ClassList classes = model_->queryClasses(ns_id, className);
+    for (int i = 0; i < classes.size(); ++i) {
+        if (classes[i].id != c_id)
+            continue;
+        llvm::SmallVector<pStringRef, 8> parents;
+        std::string all = classes[i].extends + "," + classes[i].implements;
+        pStringRef(all).split(parents, ",");
+        for (int j = 0; j < parents.size(); ++j) {
+            if (parents[j].empty())
+                continue;
+            const builtins::bClass *bc = pBuiltins::lookupClass(parents[j]);
+            if (bc) {
+                if (pBuiltins::hasClassConstant(bc, name))
+                    return true;
+                continue;
+            }
+            pModel::oid p_id = model_->lookupClass(classes[i].namespaceID, parents[j]);
+            if (p_id != pModel::NULLID && p_id != pModel::MULTIPLE_IDS &&
+                builtinClassConstant(classes[i].namespaceID, parents[j], p_id, name, depth + 1))
+                return true;
+        }
+    }
+    return false;
+
+}
+
 void ModelChecker::visit_pre_literalConstant(literalConstant* n) {
 
     // make sure this was define()'d
     if (!n->target()) {
-        pModel::ConstantList cn = model_->queryConstants(RESOLVE_FQN(n->name().str()), ns_id_);
+        std::string name = RESOLVE_FQN(n->name().str());
+        if (pBuiltins::lookupConstant(name))
+            return;
+        pModel::ConstantList cn = model_->queryConstants(name, ns_id_);
         if (cn.size() == 0) {
             std::stringstream diag;
             diag << "undefined constant: " << n->name().str();
@@ -128,12 +194,25 @@ void ModelChecker::visit_pre_literalConstant(literalConstant* n) {
         literalID* classID = llvm::dyn_cast<literalID>(target);
 
         pModel::oid class_id;
+        std::string className;
         if (classID->name() == "self") {
             class_id = c_id_;
+            className = c_name_;
         }
         else {
-            class_id = model_->lookupClass(ns_id_, RESOLVE_FQN(classID->name().str()));
+            className = RESOLVE_FQN(classID->name().str());
+            class_id = model_->lookupClass(ns_id_, className);
             if (class_id == pModel::NULLID) {
+                // not in the model, but it may be a builtin
+                const builtins::bClass *bc = pBuiltins::lookupClass(className);
+                if (bc) {
+                    if (!pBuiltins::hasClassConstant(bc, n->name())) {
+                        std::stringstream diag;
+                        diag << "undefined class constant: " << classID->name().str() << "::" << n->name().str();
+                        addDiagnostic(target, diag.str());
+                    }
+                    return;
+                }
                 std::stringstream diag;
                 diag << "class constant from undefined class: " << classID->name().str();
                 addDiagnostic(target, diag.str());
@@ -148,7 +227,7 @@ void ModelChecker::visit_pre_literalConstant(literalConstant* n) {
         }
 
         pModel::ClassDeclList cdl = model_->queryClassDecls(class_id, n->name());
-        if (cdl.size() == 0) {
+        if (cdl.size() == 0 && !builtinClassConstant(ns_id_, className, class_id, n->name())) {
             std::stringstream diag;
             diag << "undefined class constant: " << classID->name().str() << "::" << n->name().str();
             addDiagnostic(target, diag.str());
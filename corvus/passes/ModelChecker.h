@@ -20,6 +20,11 @@ class ModelChecker: public pNSVisitor {
 
     pModel::oid m_id_;
     pModel::oid c_id_;
+    std::string c_name_;
+
+    void checkArity(functionInvoke* n, int minArity, int maxArity);
+    bool builtinClassConstant(pModel::oid ns_id, pStringRef className, pModel::oid c_id,
+                              pStringRef name, int depth = 0);
 
 public:
     ModelChecker():
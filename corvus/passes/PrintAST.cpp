@@ -31,7 +31,7 @@ void PrintAST::post_run(void) {
     TiXmlPrinter printer;
     printer.SetIndent( "    " );
     doc_->Accept( &printer );
-    std::cout << printer.CStr();
+    out() << printer.CStr();
     delete doc_;
 }
 
@@ -39,12 +39,13 @@ void PrintAST::visit_pre_stmt(stmt* n) {
     TiXmlElement* node = new TiXmlElement(nodeDescTable_[n->kind()]);
     currentElement_->LinkEndChild(node);
     currentElement_ = node;
-    if (n->startLineNum() != n->endLineNum()) {
-        currentElement_->SetAttribute("start_line", n->startLineNum());
-        currentElement_->SetAttribute("end_line", n->endLineNum());
+    pSourceRange r = range(n);
+    if (r.startLine != r.endLine) {
+        currentElement_->SetAttribute("start_line", r.startLine);
+        currentElement_->SetAttribute("end_line", r.endLine);
     }
-    else if (n->startLineNum() != 0) {
-        currentElement_->SetAttribute("line", n->startLineNum());
+    else if (r.startLine != 0) {
+        currentElement_->SetAttribute("line", r.startLine);
     }
 }
 
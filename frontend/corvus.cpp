@@ -12,6 +12,7 @@
 #include <iostream>
 #include <string>
 #include <getopt.h>
+#include <stdlib.h>
 #include <algorithm>
 
 #include "corvus/pSourceManager.h"
@@ -19,6 +20,7 @@
 #include "corvus/pDiagnostic.h"
 #include "corvus/pModel.h"
 #include <llvm/Support/FileSystem.h>
+#include <boost/unordered_set.hpp>
 
 using namespace llvm;
 using namespace corvus;
@@ -30,12 +32,16 @@ struct option longopts[] = {
     {"debug-parse", 0, 0, 0},
     {"debug-model", 0, 0, 0},
     {"debug-diags", 0, 0, 0},
+    {"diag-files-only", 0, 0, 0},
+    {"db-on-disk", 0, 0, 0},
+    {"model-layer", 1, 0, 'l'},
     {"include", 1, 0, 'i'},
     {"exts", 1, 0, 'e'},
     {"db", 1, 0, 'd'},
     {"help", 0, 0, 'h'},
     {"verbose", 0, 0, 'v'},
     {"config", 1, 0, 'c'},
+    {"jobs", 1, 0, 'j'},
     {0, 0, 0, 0}
 };
 
@@ -57,6 +63,7 @@ void corvusVersion(void) {
                  " --debug-model            - Debug the model builder\n" \
                  " --debug-diags            - Debug the diagnostics\n" \
                  " --debug-parse            - Debug output from parser\n" \
+                 " --diag-files-only        - With diagnostic files, parse and check only those, against the existing model db\n" \
                  " --class-graph            - Generate a DOT graph of the class heirarchy\n" \
                  " -c,--config=<file>       - Load corvus config file\n" \
                  " -h,--help                - Display available options\n" \
@@ -65,6 +72,9 @@ void corvusVersion(void) {
                  " -e,--exts=<list>         - Source file extensions to parse when reading a directory (command separated, default: php)\n" \
                  " -i,--include=<directory> - Add a directory to build model from, but not generate diagnostics for\n" \
                  " -d,--db=<file>           - Name of model database. If not specified, no model data is stored.\n" \
+                 " --db-on-disk             - Use the model database file in place rather than loading it into memory\n" \
+                 " --model-layer=<file>     - Prebuilt model database (e.g. of vendor code) to layer under the model, read only\n" \
+                 " -j,--jobs=<n>            - Number of threads to parse and analyze with (0 for one per cpu, default: 1)\n" \
                  " -v                       - Increase verbosity, may specify more than once\n" \
                  " --version                - Display the version of this program\n" << std::endl;
 }
@@ -92,8 +102,9 @@ void renderDiagnostic(pStringRef cwd, const pDiagnostic *d) {
     // arrow to problem column
     std::cout << std::string(s->startCol()-1, ' ') << "^" << std::endl;
     */
-    // strip leading cwd
-    pStringRef fname = d->location().path();
+    // strip leading cwd. path() returns a temporary
+    std::string path(d->location().path());
+    pStringRef fname(path);
     if (fname.startswith(cwd)) {
         std::cout << fname.substr(cwd.size()+1).str() << ":";
     }
@@ -103,15 +114,14 @@ void renderDiagnostic(pStringRef cwd, const pDiagnostic *d) {
     std::cout << d->location().range().startLine << ":" << d->location().range().startCol << ": " << d->msg().str() << std::endl;
 }
 
-bool willRenderFor(pStringRef cwd, const pConfig &config, pStringRef fname) {
+typedef boost::unordered_set<std::string> DiagFileSet;
 
-    if (config.diagFiles.empty())
+bool willRenderFor(pStringRef cwd, const DiagFileSet &diagFiles, pStringRef fname) {
+
+    if (diagFiles.empty())
         return true;
 
-    pConfig::StringListType::const_iterator i = find(config.diagFiles.begin(),
-                                                     config.diagFiles.end(),
-                                                     fname.str());
-    if (i != config.diagFiles.end())
+    if (diagFiles.find(fname.str()) != diagFiles.end())
         // found it, render
         return true;
 
@@ -120,10 +130,7 @@ bool willRenderFor(pStringRef cwd, const pConfig &config, pStringRef fname) {
     if (!fname.startswith(cwd))
         return false;
 
-    i = find(config.diagFiles.begin(),
-             config.diagFiles.end(),
-             fname.substr(cwd.size()+1).str());
-    return (i != config.diagFiles.end());
+    return (diagFiles.find(fname.substr(cwd.size()+1).str()) != diagFiles.end());
 
 }
 
@@ -146,7 +153,7 @@ int main( int argc, char* argv[] )
         pConfigMgr::read(pStringRef(home)+"/.corvus", config);
     }
 
-    while ((opt = getopt_long(argc, argv, "tai:hve:d:c:", longopts,
+    while ((opt = getopt_long(argc, argv, "tai:hve:d:c:j:", longopts,
                               &idx
                               )
             ) != -1
@@ -166,6 +173,14 @@ int main( int argc, char* argv[] )
                 config.debugDiags = true;
                 continue;
             }
+            if (strcmp(longopts[idx].name,"db-on-disk") == 0) {
+                config.dbOnDisk = true;
+                continue;
+            }
+            if (strcmp(longopts[idx].name,"diag-files-only") == 0) {
+                config.diagFilesOnly = true;
+                continue;
+            }
             inputFiles.push_back(longopts[idx].name);
             continue;
         case 'a':
@@ -180,6 +195,9 @@ int main( int argc, char* argv[] )
         case 'i':
             config.includePaths.push_back(optarg);
             break;
+        case 'l':
+            config.modelLayer = optarg;
+            break;
         case 'c':
             if (!pConfigMgr::read(optarg, config)) {
                 std::cerr << "unable to load config file: " << optarg << std::endl;
@@ -197,11 +215,12 @@ int main( int argc, char* argv[] )
         case 'v':
             config.verbosity++;
             break;
+        case 'j':
+            config.jobs = atoi(optarg);
+            break;
         }
     }
 
-    sm.configure(config);
-
     if (optind < argc) {
         // if we have files on the command line, but there were already files
         // added via a config file, then instead of adding these files to
@@ -217,6 +236,10 @@ int main( int argc, char* argv[] )
         }
     }
 
+    // the source manager needs the diagnostic files to know whether it can
+    // leave out everything else
+    sm.configure(config);
+
     if (inputFiles.empty() && config.inputFiles.empty()) {
         std::cerr << "no input files" << std::endl;
         corvusVersion();
@@ -251,10 +274,11 @@ int main( int argc, char* argv[] )
     // render diagnostics
     llvm::SmallString<128> cwd;
     llvm::sys::fs::current_path(cwd);
+    DiagFileSet diagFiles(config.diagFiles.begin(), config.diagFiles.end());
     pSourceManager::DiagModuleListType mList = sm.getDiagModules();
     for (int i = 0; i < mList.size(); ++i) {
         // if we have diagfiles, only render for the ones in that list
-        if (!willRenderFor(cwd, config, mList[i]->fileName()))
+        if (!willRenderFor(cwd, diagFiles, mList[i]->fileName()))
             continue;
         pSourceModule::DiagListType dList = mList[i]->getDiagnostics();
         for (int j = 0; j < dList.size(); ++j) {
@@ -0,0 +1,12 @@
+<?php
+
+// lines end in \r\n, which is still one newline each
+function crlf() {
+    echo "a
+b";
+    echo $undefined2;
+}
+
+function after2($unused2) {
+    return 2;
+}
@@ -10,13 +10,23 @@
 
 #include <exception>
 #include <iostream>
+#include <fstream>
 #include <string>
+#include <set>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <utime.h>
+#include <time.h>
 
 #include "corvus/pSourceManager.h"
 #include "corvus/pConfig.h"
 #include "corvus/pDiagnostic.h"
 #include "corvus/pModel.h"
+#include "corvus/pSourceFile.h"
 #include <llvm/Support/FileSystem.h>
+#include <sqlite3.h>
 #include <sstream>
 
 using namespace llvm;
@@ -62,30 +72,284 @@ void cassert(pSourceRange a, pSourceRange b, int line, bool negate=false) {
     }
 }
 
-int main( int argc, char* argv[] )
-{
+// a scratch project for the incremental build tests, rewritten each run,
+// with its model in incr.db. child extends base, and user uses child's class.
+// other stands alone
+const char* incrFiles[] = {
+    "incr/base.php",
+    "incr/child.php",
+    "incr/user.php",
+    "incr/other.php"
+};
+enum { INCR_BASE, INCR_CHILD, INCR_USER, INCR_OTHER, INCR_COUNT };
+
+// the file is dated a minute ago. a module whose file is as new as the
+// model doesn't have its stat trusted, see pModel::setSourceModuleStat
+void writeFile(const char *name, const char *contents) {
+    {
+        std::ofstream out(name, std::ios::out | std::ios::binary | std::ios::trunc);
+        out << contents;
+    }
+    struct utimbuf times;
+    times.actime = times.modtime = time(NULL) - 60;
+    utime(name, &times);
+}
+
+// the name the source manager knows a file by
+std::string realPath(const char *name) {
+    char *rp = realpath(name, NULL);
+    std::string result(rp ? rp : name);
+    free(rp);
+    return result;
+}
+
+void addIncrFiles(pSourceManager& sm) {
+    sm.setModelDBName("incr.db");
+    for (int i = 0; i < INCR_COUNT; ++i)
+        sm.addSourceFile(incrFiles[i]);
+}
+
+// whether this run parsed it, rather than taking it from the model
+bool parsed(pSourceManager& sm, int file) {
+    return sm.getSourceModuleByRealpath(realPath(incrFiles[file]))->getAST() != NULL;
+}
+
+// unchanged modules are skipped before they're parsed. when one does
+// change, the classes that depend on it are rebuilt even though their
+// modules aren't parsed again
+void testSkipClean(void) {
+
+    mkdir("incr", 0755);
+    unlink("incr.db");
+    writeFile(incrFiles[INCR_BASE], "<?php\nclass incrbase {\n    const ONE = 1;\n}\n");
+    writeFile(incrFiles[INCR_CHILD], "<?php\nclass incrchild extends incrbase {\n}\n");
+    writeFile(incrFiles[INCR_USER], "<?php\nfunction incruser() {\n    return incrchild::ONE;\n}\n");
+    writeFile(incrFiles[INCR_OTHER], "<?php\nfunction incrother($a) {\n    return $b;\n}\n");
+
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+        for (int i = 0; i < INCR_COUNT; ++i)
+            ASSERT(parsed(sm, i), true);
+    }
+
+    // nothing changed
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+        for (int i = 0; i < INCR_COUNT; ++i)
+            ASSERT(parsed(sm, i), false);
+        ASSERT(sm.model()->invalidated().size(), 0);
+    }
+
+    // base changes (and its size, so it isn't taken as unchanged by its stat)
+    writeFile(incrFiles[INCR_BASE], "<?php\nclass incrbase {\n    const TWO = 22;\n}\n");
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+        ASSERT(parsed(sm, INCR_BASE), true);
+        ASSERT(parsed(sm, INCR_CHILD), false);
+        ASSERT(parsed(sm, INCR_USER), false);
+        ASSERT(parsed(sm, INCR_OTHER), false);
+
+        const pModel *m = sm.model();
+        const std::set<std::string>& invalidated = m->invalidated();
+        ASSERT(invalidated.size(), 2);
+        ASSERT(invalidated.count(realPath(incrFiles[INCR_CHILD])), 1);
+        ASSERT(invalidated.count(realPath(incrFiles[INCR_USER])), 1);
+
+        // child's class model has what base has now
+        pModel::ClassList c = m->queryClasses(m->getRootNamespaceOID(), "incrchild");
+        ASSERT(c.size(), 1);
+        ASSERT(m->queryClassDecls(c[0].id, "TWO").size(), 1);
+        ASSERT(m->queryClassDecls(c[0].id, "ONE").size(), 0);
+    }
+
+}
+
+// a module's diagnostics and where they are, to compare runs by
+std::string diagnostics(pSourceModule *m) {
+    std::stringstream result;
+    pSourceModule::DiagListType& list = m->getDiagnostics();
+    for (std::size_t i = 0; i < list.size(); ++i) {
+        pSourceRange r = list[i]->location().range();
+        result << r.startLine << ":" << r.startCol << ":" << r.endLine << ":" << r.endCol
+               << ": " << list[i]->msg().str() << "\n";
+    }
+    return result.str();
+}
+
+std::string diagnostics(pSourceManager& sm, int file) {
+    return diagnostics(sm.getSourceModuleByRealpath(realPath(incrFiles[file])));
+}
+
+// a module's diagnostics are replayed while neither it nor what it depends
+// on has changed. when a module it uses a class of changes, it's checked
+// again
+void testDiagnosticCache(void) {
+
+    std::string before[INCR_COUNT];
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+        sm.runDiagnostics();
+        for (int i = 0; i < INCR_COUNT; ++i)
+            before[i] = diagnostics(sm, i);
+        // base no longer has the constant user wants
+        ASSERT(before[INCR_USER].find("undefined class constant: incrchild::ONE") == std::string::npos, false);
+        ASSERT(before[INCR_OTHER].empty(), false);
+    }
+
+    // nothing changed, so nothing is checked again
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+        sm.runDiagnostics();
+        for (int i = 0; i < INCR_COUNT; ++i) {
+            ASSERT(diagnostics(sm, i), before[i]);
+            ASSERT(parsed(sm, i), false);
+        }
+    }
+
+    // base has the constant again. child and user are checked again, since
+    // they use base's class directly or through child's, and user's
+    // diagnostic is gone. other is still replayed
+    writeFile(incrFiles[INCR_BASE], "<?php\nclass incrbase {\n    const ONE = 1;\n    const TWO = 22;\n}\n");
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+        sm.runDiagnostics();
+        ASSERT(parsed(sm, INCR_CHILD), true);
+        ASSERT(parsed(sm, INCR_USER), true);
+        ASSERT(parsed(sm, INCR_OTHER), false);
+        ASSERT(diagnostics(sm, INCR_USER), "");
+        ASSERT(diagnostics(sm, INCR_OTHER), before[INCR_OTHER]);
+    }
+
+    // the same, but with the model built in one run and checked in the
+    // next, which only has the dependency fingerprints to go on
+    writeFile(incrFiles[INCR_BASE], "<?php\nclass incrbase {\n    const TWO = 22;\n}\n");
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+    }
+    {
+        pSourceManager sm;
+        addIncrFiles(sm);
+        sm.refreshModel();
+        ASSERT(sm.model()->invalidated().size(), 0);
+        sm.runDiagnostics();
+        ASSERT(parsed(sm, INCR_CHILD), true);
+        ASSERT(parsed(sm, INCR_USER), true);
+        ASSERT(parsed(sm, INCR_OTHER), false);
+        ASSERT(diagnostics(sm, INCR_USER), before[INCR_USER]);
+        ASSERT(diagnostics(sm, INCR_OTHER), before[INCR_OTHER]);
+    }
+
+}
+
+// a model whose modules were hashed by another hash function has them all
+// rehashed, rather than keeping hashes that will never match again. the
+// files haven't changed, so they still aren't parsed
+void testRehash(void) {
+
+    sqlite3 *db;
+    ASSERT(sqlite3_open("incr.db", &db), SQLITE_OK);
+    ASSERT(sqlite3_exec(db, "UPDATE corvus SET val='md5' WHERE key='hash'", NULL, NULL, NULL), SQLITE_OK);
+    ASSERT(sqlite3_exec(db, "UPDATE sourceModule SET hash='stale'", NULL, NULL, NULL), SQLITE_OK);
+    sqlite3_close(db);
 
     pSourceManager sm;
-    pConfig config;
-    std::vector<std::string> inputFiles;
+    addIncrFiles(sm);
+    sm.refreshModel();
 
-    //sm.setDebug(0,false,true);
-    config.exts = "php";
+    const pModel *m = sm.model();
+    ASSERT(m->getMeta("hash"), pSourceFile::hashName());
+    pModel::SourceModuleMap known;
+    m->getSourceModules(known);
+    for (int i = 0; i < INCR_COUNT; ++i) {
+        pSourceFile f(incrFiles[i]);
+        ASSERT(known[realPath(incrFiles[i])].hash, f.hash());
+        ASSERT(parsed(sm, i), false);
+    }
 
-    // try to read home directory config file
-    char *home = getenv("HOME");
-    if (home) {
-        // will ignore if not found
-        pConfigMgr::read(pStringRef(home)+"/.corvus", config);
+}
+
+// where the text first found in a file is, as the line table resolves it
+pSourceRange rangeOf(const pSourceFile *f, const char *text) {
+    pStringRef contents(f->contents()->getBuffer());
+    pUInt begin = contents.find(text);
+    return f->range(pSourceSpan(begin, begin + strlen(text)));
+}
+
+// lines are counted past heredocs, strings over several lines and \r\n, to
+// the statements after them. each scan for newlines finds the same ones
+void testLines(void) {
+
+    pSourceManager sm;
+    sm.addSourceFile("lines.php");
+    sm.addSourceFile("crlf.php");
+    sm.refreshModel();
+    sm.runDiagnostics();
+
+    pSourceModule *lines = sm.getSourceModuleByRealpath(realPath("lines.php"));
+    pSourceModule *crlf = sm.getSourceModuleByRealpath(realPath("crlf.php"));
+    ASSERT(diagnostics(lines), "14:0:0:0: $undefined1 used but not defined\n"
+                               "17:16:0:0: $unused1 unused\n");
+    ASSERT(diagnostics(crlf), "7:0:0:0: $undefined2 used but not defined\n"
+                              "10:17:0:0: $unused2 unused\n");
+
+    const pModel *m = sm.model();
+    pModel::oid ns = m->getNamespaceOID("\\");
+    pModel::FunctionList f;
+    f = m->queryFunctions(ns, pModel::NULLID, "after");
+    ASSERT(f.size(), 1);
+    ASSERT(f[0].range, pSourceRange(17,10,0,0));
+    f = m->queryFunctions(ns, pModel::NULLID, "after2");
+    ASSERT(f.size(), 1);
+    ASSERT(f[0].range, pSourceRange(10,10,0,0));
+
+    ASSERT(rangeOf(lines->source(), "\"a\nb\""), pSourceRange(12,10,13,3));
+    ASSERT(rangeOf(lines->source(), "return 1;"), pSourceRange(18,5,18,14));
+    ASSERT(rangeOf(crlf->source(), "\"a\r\nb\""), pSourceRange(5,10,6,3));
+    ASSERT(rangeOf(crlf->source(), "return 2;"), pSourceRange(11,5,11,14));
+
+    const pSourceFile *files[] = { lines->source(), crlf->source() };
+    for (int i = 0; i < 2; ++i) {
+        const char *begin = files[i]->contents()->getBufferStart();
+        const char *end = files[i]->contents()->getBufferEnd();
+        for (int scan = pSourceFile::SCAN_SCALAR; scan <= pSourceFile::SCAN_AVX2; ++scan) {
+            if (!pSourceFile::hasScan(static_cast<pSourceFile::newlineScan>(scan)))
+                continue;
+            std::vector<pUInt> starts(1, 0);
+            pSourceFile::findNewlines(begin, begin, end, starts,
+                                      static_cast<pSourceFile::newlineScan>(scan));
+            ASSERT(starts == files[i]->lineStarts(), true);
+        }
     }
 
+}
+
+// the model is opened by the first include dir, so it's named first
+void addTestSources(pSourceManager *sm, const pConfig& config) {
+
+    std::vector<std::string> inputFiles;
+
+    sm->setModelDBName("test.db");
+
     if (!config.includePaths.empty()) {
         for (unsigned i = 0; i != config.includePaths.size(); ++i) {
-            sm.addIncludeDir(config.includePaths[i], config.exts);
+            sm->addIncludeDir(config.includePaths[i], config.exts);
         }
     }
 
-    sm.setModelDBName("test.db");
     inputFiles.push_back("test1.php");
 
     for (unsigned i = 0; i != inputFiles.size(); ++i) {
@@ -93,24 +357,44 @@ int main( int argc, char* argv[] )
         sys::fs::file_status stat;
         sys::fs::status(inputFiles[i], stat);
         if (sys::fs::is_directory(stat))
-            sm.addSourceDir(inputFiles[i], config.exts);
+            sm->addSourceDir(inputFiles[i], config.exts);
         else if (sys::fs::is_regular_file(stat))
-            sm.addSourceFile(inputFiles[i]);
+            sm->addSourceFile(inputFiles[i]);
         else
             std::cerr << "skipping unknown path: " << inputFiles[i] << std::endl;
 
     }
 
+}
+
+int main( int argc, char* argv[] )
+{
+
+    pSourceManager *sm = new pSourceManager;
+    pConfig config;
+
+    //sm->setDebug(0,false,true);
+    config.exts = "php";
+
+    // try to read home directory config file
+    char *home = getenv("HOME");
+    if (home) {
+        // will ignore if not found
+        pConfigMgr::read(pStringRef(home)+"/.corvus", config);
+    }
+
+    addTestSources(sm, config);
+
     try {
-        sm.refreshModel();
-        sm.runDiagnostics();
+        sm->refreshModel();
+        sm->runDiagnostics();
     }
     catch (std::exception& e) {
         std::cout << "exception: " << e.what() << "\n";
         exit(1);
     }
 
-    pSourceManager::DiagModuleListType mList = sm.getDiagModules();
+    pSourceManager::DiagModuleListType mList = sm->getDiagModules();
 
     // 1 source module
     cassert(mList.size(), 1, __LINE__);
@@ -118,7 +402,7 @@ int main( int argc, char* argv[] )
     pSourceModule::DiagListType dList = mList[0]->getDiagnostics();
 
     // DIAG COUNT
-    cassert(dList.size(), 30, __LINE__);
+    cassert(dList.size(), 31, __LINE__);
 
     // DIAGS
 
@@ -132,6 +416,9 @@ int main( int argc, char* argv[] )
     i++;
     ASSERT(dList[i]->msg(), "class myclass2 implements noiface which is unresolved");
 
+    i++;
+    ASSERT(dList[i]->msg(), "class cyclic2 extends cyclic1 which is unresolved");
+
     i++;
     ASSERT(dList[i]->msg(), "$hello used but not defined");
 
@@ -209,7 +496,7 @@ int main( int argc, char* argv[] )
     ASSERT(dList[i]->msg(), "$vcheck3 used but not defined");
 
     // MODEL QUERIES
-    const pModel *m = sm.model();
+    const pModel *m = sm->model();
 
     // namespaces
     pModel::oid main_ns = m->getNamespaceOID("\\test_main");
@@ -239,9 +526,57 @@ int main( int argc, char* argv[] )
     // class constants
     pModel::ClassDeclList cdl;
     // \test_main\myclass::FOO
-    cdl = m->queryClassDecls(c[0].getID(), "FOO");
+    cdl = m->queryClassDecls(c[0].id, "FOO");
     ASSERT(cdl.size(), 1);
 
+    // cyclic classes are flattened, the first with the second's constants
+    // but not the other way around
+    c = m->queryClasses(main_ns, "cyclic1");
+    ASSERT(c.size(), 1);
+    ASSERT(m->queryClassDecls(c[0].id, "CYC1").size(), 1);
+    ASSERT(m->queryClassDecls(c[0].id, "CYC2").size(), 1);
+    c = m->queryClasses(main_ns, "cyclic2");
+    ASSERT(c.size(), 1);
+    ASSERT(m->queryClassDecls(c[0].id, "CYC1").size(), 0);
+    ASSERT(m->queryClassDecls(c[0].id, "CYC2").size(), 1);
+
+    // DIAGNOSTIC CACHE
+    // the same model again gives the same diagnostics, replayed from the
+    // cache without parsing test1
+    std::string firstDiags = diagnostics(mList[0]);
+    delete sm;
+    sm = new pSourceManager;
+    addTestSources(sm, config);
+    try {
+        sm->refreshModel();
+        sm->runDiagnostics();
+    }
+    catch (std::exception& e) {
+        std::cout << "exception: " << e.what() << "\n";
+        exit(1);
+    }
+    mList = sm->getDiagModules();
+    ASSERT(mList.size(), 1);
+    ASSERT(diagnostics(mList[0]), firstDiags);
+    ASSERT(mList[0]->getAST() == NULL, true);
+    delete sm;
+
+    try {
+        testSkipClean();
+        testRehash();
+        testDiagnosticCache();
+        testLines();
+    }
+    catch (std::exception& e) {
+        std::cout << "exception: " << e.what() << "\n";
+        exit(1);
+    }
+
+    for (int i = 0; i < INCR_COUNT; ++i)
+        unlink(incrFiles[i]);
+    unlink("incr.db");
+    rmdir("incr");
+
     std::cout << "all tests passing" << std::endl;
     return 0;
 
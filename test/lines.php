@@ -0,0 +1,19 @@
+<?php
+
+// a heredoc and a string over several lines, which count as lines
+function lines() {
+    $text = <<<EOT
+one
+two
+
+four
+EOT;
+    echo $text;
+    echo "a
+b";
+    echo $undefined1;
+}
+
+function after($unused1) {
+    return 1;
+}
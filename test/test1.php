@@ -87,6 +87,15 @@ class myclass2 extends noclass implements noiface, realiface {
   // futurediag: unimplemented interface method bar()
 }
 
+// DIAG: cyclic, the second is left unresolved
+class cyclic1 extends cyclic2 {
+  const CYC1 = 1;
+}
+
+class cyclic2 extends cyclic1 {
+  const CYC2 = 2;
+}
+
 // nodiag: extends/implements existing class/interface in another namespace
 class myclass3 extends \test_other\myclass implements \test_other\iface { }
 